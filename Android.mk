@@ -21,12 +21,16 @@ LOCAL_C_INCLUDES := jni/libraries/include/ \
 	jni/libraries/third_party/json-cpp/include
 LOCAL_SRC_FILES := \
 	src/accepted_socket.cc \
+	src/buffered_socket.cc \
 	src/client_socket.cc \
 	src/host.cc \
+	src/http.cc \
+	src/http_parser.cc \
 	src/log.cc \
 	src/mlab.cc \
 	src/ns.cc \
 	src/listen_socket.cc \
+	src/pacer.cc \
 	src/socket.cc
 LOCAL_STATIC_LIBRARIES := json-cpp
 
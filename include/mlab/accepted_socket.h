@@ -34,16 +34,86 @@ class AcceptedSocket : public Socket {
  public:
   virtual ~AcceptedSocket();
 
-  // Send |bytes| to a connected client. Sets |num_bytes| to the number of bytes
-  // actually sent.
-  virtual bool Send(const Packet& bytes, ssize_t *num_bytes) const;
+  // Send |length| bytes from |buffer| to a connected client. Sets |num_bytes|
+  // to the number of bytes actually sent.
+  virtual bool SendFrom(const void* buffer, size_t length,
+                        ssize_t* num_bytes) const;
 
-  // Attempts to receive |count| bytes from connected clients. Returns the
-  // received packet and sets |num_bytes| to the actual bytes received.
-  virtual Packet Receive(size_t count, ssize_t *num_bytes) const;
+  // Attempts to receive |count| bytes from connected clients into |buffer|.
+  // Sets |num_bytes| to the actual bytes received.
+  virtual bool ReceiveInto(void* buffer, size_t count,
+                           ssize_t* num_bytes) const;
+
+  // Vectored versions of |SendFrom| and |ReceiveInto|.
+  virtual bool SendV(const iovec* iov, size_t iovcnt,
+                     ssize_t* num_bytes) const;
+  virtual bool ReceiveV(const iovec* iov, size_t iovcnt,
+                        ssize_t* num_bytes) const;
+
+  // Batched UDP I/O. Receives up to |count| |datagrams| from any client,
+  // recording each sender in the datagram's |peer|, or sends |count|
+  // datagrams each to its own |peer|. Unlike |Receive| this does not touch
+  // the single stored client address. |num_datagrams| is the number of
+  // datagrams actually transferred.
+  bool SendBatch(Datagram* datagrams, size_t count,
+                 size_t* num_datagrams) const;
+  bool ReceiveBatch(Datagram* datagrams, size_t count,
+                    size_t* num_datagrams) const;
+
+  // UDP segmentation offload (Linux). Once enabled, a single send of a buffer
+  // larger than |segment_size| leaves the socket as |segment_size| datagrams
+  // (UDP_SEGMENT), and the kernel may coalesce received datagrams into one
+  // receive (UDP_GRO). Use |ReceiveBatch| to learn the coalesced segment size.
+  // A |segment_size| of zero turns offload off. Returns false if the kernel
+  // does not support it.
+  bool EnableSegmentationOffload(uint16_t segment_size) const;
+
+  // Kernel timestamping for UDP (Linux SO_TIMESTAMPING). After
+  // |EnableTimestamping|, each datagram from |ReceiveBatch| carries the time
+  // the kernel received it, and |GetSendTimestamp| returns the time each send
+  // left, in send order, waiting up to |timeout_ms| milliseconds (-1 for no
+  // limit) for the next. |hardware| also asks for interface timestamps where
+  // the network interface provides them. Returns false if there is no
+  // timestamp, or if the kernel does not support timestamping.
+  bool EnableTimestamping(bool hardware) const;
+  bool GetSendTimestamp(PacketTimestamp* timestamp, int timeout_ms) const;
+
+  // Paced sending. |EnablePacing| spreads sends out to |bits_per_second|, or
+  // turns pacing off if it is zero, and returns how the socket is paced. TCP
+  // is paced by the kernel (SO_MAX_PACING_RATE). UDP sets the same kernel
+  // rate, which takes effect under the fq qdisc, but since the qdisc can't be
+  // seen from the socket, each send also waits on a user-space token bucket.
+  // A send on a non-blocking socket that would have to wait fails with errno
+  // set to EAGAIN. |ReadPacingInterval| sets |bytes| to the bytes sent since
+  // the last call and |elapsed_us| to the time since then; it returns false
+  // if pacing is off.
+  PacingMode EnablePacing(uint64_t bits_per_second) const;
+  bool ReadPacingInterval(uint64_t* bytes, uint64_t* elapsed_us) const;
+
+  // Zero-copy transmit for TCP (Linux MSG_ZEROCOPY). After
+  // |EnableZeroCopy|, |SendZeroCopy| hands the bytes of |bytes| to the kernel
+  // without copying them. The socket keeps a reference to the packet until
+  // the kernel reports the transmission complete, so the storage stays valid;
+  // a caller writing through Packet::mutable_buffer meanwhile gets a copy.
+  bool EnableZeroCopy() const;
+  bool SendZeroCopy(const Packet& bytes, ssize_t* num_bytes) const;
+
+  // Zero-copy send of a caller-owned |buffer|, which must not be modified or
+  // freed until |IsZeroCopyComplete| returns true for |send_id|.
+  bool SendFromZeroCopy(const void* buffer, size_t length, ssize_t* num_bytes,
+                        uint32_t* send_id) const;
+  bool IsZeroCopyComplete(uint32_t send_id) const;
+
+  // Reads completion notifications from the socket error queue, releasing the
+  // packets they cover. If |block| is set and sends are outstanding, waits for
+  // at least one notification. Returns the number of sends still outstanding.
+  // Reap regularly: the kernel fails sends with ENOBUFS if too many are
+  // outstanding.
+  size_t ReapZeroCopyCompletions(bool block) const;
 
  private:
   friend class ListenSocket;
+  friend class UringLoop;
 
   AcceptedSocket(int accepted_fd, SocketType type, SocketFamily family);
 
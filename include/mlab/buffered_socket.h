@@ -0,0 +1,123 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_BUFFERED_SOCKET_H_
+#define _MLAB_BUFFERED_SOCKET_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "mlab/packet.h"
+
+namespace mlab {
+class Socket;
+
+// Reads a byte stream through a reusable buffer, so that line-based and
+// length-prefixed protocols take one receive per buffer-full rather than one
+// per field. The reader doesn't own the socket.
+//
+// Every read either completes or consumes nothing, so on a non-blocking
+// socket a read that fails with errno set to EAGAIN can simply be retried
+// once the socket is readable. That holds as long as what is asked for fits
+// in the buffer.
+class BufferedSocketReader {
+ public:
+  static const size_t kDefaultBufferSize;
+
+  explicit BufferedSocketReader(const Socket* socket);
+  BufferedSocketReader(const Socket* socket, size_t buffer_size);
+
+  // Read a line ending in "\n" into |line|, without the "\n" or a "\r"
+  // before it. Fails if the stream ends or errors first, or if the line
+  // doesn't fit in the buffer.
+  bool ReadLine(std::string* line);
+
+  // Read exactly |count| bytes into |buffer|. Reads larger than the buffer
+  // go straight to |buffer| and need a blocking socket.
+  bool ReadExactly(void* buffer, size_t count);
+
+  // Point |data| at the next |count| bytes without consuming them, receiving
+  // more if fewer are buffered. |count| can't exceed the buffer size. The
+  // bytes stay valid until the next read.
+  bool Peek(size_t count, const char** data);
+
+  // Discard |count| bytes, such as ones already examined with |Peek|. Skips
+  // larger than the buffer need a blocking socket.
+  bool Skip(size_t count);
+
+  // The number of bytes received but not yet read.
+  size_t buffered() const { return end_ - begin_; }
+
+  // Whether the peer has closed its end of the stream.
+  bool eof() const { return eof_; }
+
+ private:
+  // Receive until at least |count| bytes are buffered.
+  bool Fill(size_t count);
+
+  const Socket* socket_;
+  std::vector<char> buffer_;
+  size_t begin_;
+  size_t end_;
+  bool eof_;
+};
+
+// Coalesces small writes into one send per buffer-full. Nothing is sent until
+// the buffer fills or |Flush| is called, so flush after each message the peer
+// must answer. The writer doesn't own the socket.
+//
+// On a non-blocking socket a write or flush that fails with errno set to
+// EAGAIN keeps what it couldn't send; flush again once the socket is
+// writable.
+class BufferedSocketWriter {
+ public:
+  static const size_t kDefaultBufferSize;
+
+  explicit BufferedSocketWriter(const Socket* socket);
+  BufferedSocketWriter(const Socket* socket, size_t buffer_size);
+
+  // Flushes what is left, ignoring errors.
+  ~BufferedSocketWriter();
+
+  // Queue |length| bytes from |buffer|. Returns false if they could not be
+  // queued, in which case none of them were taken. Writes too large for the
+  // buffer are sent straight away, after what is already queued, and need a
+  // blocking socket.
+  bool Write(const void* buffer, size_t length);
+  bool Write(const Packet& bytes);
+  bool WriteLine(const std::string& line);  // Appends "\r\n".
+
+  // Send everything queued.
+  bool Flush();
+
+  // The number of bytes queued but not yet sent.
+  size_t buffered() const { return end_ - begin_; }
+
+ private:
+  // Send the queue until it has room for |length| more bytes.
+  bool MakeRoom(size_t length);
+  bool SendAll(const char* buffer, size_t length);
+
+  const Socket* socket_;
+  std::vector<char> buffer_;
+  size_t begin_;
+  size_t end_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_BUFFERED_SOCKET_H_
@@ -0,0 +1,128 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_CAPTURE_SOCKET_H_
+#define _MLAB_CAPTURE_SOCKET_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "mlab/packet.h"
+#include "mlab/socket_status.h"
+
+namespace mlab {
+
+struct CaptureOptions {
+  CaptureOptions()
+      : protocol(0x0003),  // ETH_P_ALL
+        block_size(1 << 20),
+        num_blocks(16),
+        block_timeout_ms(10) { }
+
+  // The interface to capture on, such as "eth0". Empty captures on all.
+  std::string interface;
+  // The ethertype to capture, in host byte order, such as 0x0800 for IPv4.
+  uint16_t protocol;
+  // The ring is |num_blocks| blocks of |block_size| bytes, a multiple of the
+  // page size. The kernel hands a block over when it is full, or
+  // |block_timeout_ms| milliseconds after its first packet.
+  size_t block_size;
+  size_t num_blocks;
+  uint32_t block_timeout_ms;
+};
+
+// One captured packet. |data| is a view into the ring, starting at the link
+// layer header, and is only valid until the next |WaitForBlock|; copy it
+// with Packet(data.buffer(), data.length()) to keep it longer.
+struct CapturedPacket {
+  Packet data;
+  // The length of the packet on the wire; |data| may be cut short of it.
+  size_t original_length;
+  // When the kernel received or sent the packet, in nanoseconds since the
+  // epoch.
+  uint64_t timestamp_ns;
+  int interface_index;
+  // The ethertype, in host byte order.
+  uint16_t protocol;
+  // Whether the packet was to this host, outgoing, and so on: a PACKET_*
+  // type from <linux/if_packet.h>.
+  uint8_t packet_type;
+};
+
+struct CaptureStats {
+  CaptureStats() : packets(0), drops(0) { }
+
+  uint64_t packets;
+  // Packets dropped because the ring was full.
+  uint64_t drops;
+};
+
+// Captures packets through an AF_PACKET socket with a TPACKET_V3 ring mapped
+// into memory, so the kernel writes packets straight into blocks that are
+// read in place: one poll hands over a block of many packets, and reading
+// them takes no system calls or copies. Use it where receiving one packet
+// per call would fall behind, such as collecting replies to probe bursts.
+//
+// Linux only; |Create| fails elsewhere. Needs root, or CAP_NET_RAW.
+class CaptureSocket {
+ public:
+  // Capture every packet on every interface.
+  static CaptureSocket* Create();
+  // On failure, this will return a NULL pointer. On success, the caller is
+  // responsible for eventually deleting the socket.
+  static CaptureSocket* Create(const CaptureOptions& options);
+
+  // See |Create| for details. On failure, this version FATALs.
+  static CaptureSocket* CreateOrDie();
+  static CaptureSocket* CreateOrDie(const CaptureOptions& options);
+
+  ~CaptureSocket();
+
+  // Returns the current block, if any, to the kernel, then waits until the
+  // kernel hands over the next, or until |deadline_us| on the monotonic
+  // clock (Socket::kNoDeadline to wait for ever).
+  SocketStatus WaitForBlock(uint64_t deadline_us);
+
+  // Steps through the packets of the current block: fills in |packet| with
+  // the next and returns true, or returns false at the end of the block.
+  bool NextPacket(CapturedPacket* packet);
+
+  // Counts since the socket was created.
+  bool GetStats(CaptureStats* stats);
+
+ private:
+  CaptureSocket(int socket_fd, char* ring, const CaptureOptions& options);
+
+  void ReleaseBlock();
+
+  int fd_;
+  char* ring_;
+  size_t block_size_;
+  size_t num_blocks_;
+
+  // The block being read, whether it has been handed over, and the next
+  // packet in it.
+  size_t block_;
+  bool holding_block_;
+  const char* next_packet_;
+  uint32_t packets_left_;
+
+  CaptureStats stats_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_CAPTURE_SOCKET_H_
@@ -33,6 +33,12 @@ class ClientSocket : public Socket {
                               SocketType type);
   static ClientSocket* Create(const Host& hostname, uint16_t port,
                               SocketType type, SocketFamily family);
+
+  // As above, applying the set |options| before connecting. Check
+  // |honored_options| for the ones the kernel honored.
+  static ClientSocket* Create(const Host& hostname, uint16_t port,
+                              SocketType type, SocketFamily family,
+                              const SocketOptions& options);
   static ClientSocket* Create(const Host& bindhost, uint16_t bindport,
                               const Host& connecthost, uint16_t connectport,
                               SocketType type, SocketFamily family);
@@ -45,20 +51,106 @@ class ClientSocket : public Socket {
                                    SocketType type);
   static ClientSocket* CreateOrDie(const Host& hostname, uint16_t port,
                                    SocketType type, SocketFamily family);
+  static ClientSocket* CreateOrDie(const Host& hostname, uint16_t port,
+                                   SocketType type, SocketFamily family,
+                                   const SocketOptions& options);
   static ClientSocket* CreateOrDie(const Host& bindhost, uint16_t bindport,
                                    const Host& connecthost,
                                    uint16_t connectport,
                                    SocketType type, SocketFamily family);
 
+  // Create a TCP socket connected to |hostname| on |port| by racing its
+  // addresses in the manner of Happy Eyeballs (RFC 8305). IPv6 and IPv4
+  // addresses are tried alternately, IPv6 first, with a new non-blocking
+  // connect started every 250ms or as soon as one fails. The first to connect
+  // wins and the others are abandoned. Gives up after |timeout_ms|
+  // milliseconds. On failure, this will return a NULL pointer. On success,
+  // the socket is blocking and the caller is responsible for eventually
+  // deleting it.
+  static ClientSocket* CreateHappyEyeballs(const Host& hostname, uint16_t port,
+                                           uint32_t timeout_ms);
+
+  // See |CreateHappyEyeballs| for details. On failure, this version FATALs.
+  static ClientSocket* CreateHappyEyeballsOrDie(const Host& hostname,
+                                                uint16_t port,
+                                                uint32_t timeout_ms);
+
   virtual ~ClientSocket();
 
-  // Send |bytes| to the connected server. |num_bytes| is the number of bytes
-  // actually sent.
-  virtual bool Send(const Packet& bytes, ssize_t *num_bytes) const;
+  // Send |length| bytes from |buffer| to the connected server. |num_bytes| is
+  // the number of bytes actually sent.
+  virtual bool SendFrom(const void* buffer, size_t length,
+                        ssize_t* num_bytes) const;
 
-  // Attempts to receive |count| bytes from connected clients. Returns the
-  // received packet. |num_bytes| is the number of bytes actually received.
-  virtual Packet Receive(size_t count, ssize_t *num_bytes) const;
+  // Attempts to receive |count| bytes from the connected server into |buffer|.
+  // |num_bytes| is the number of bytes actually received.
+  virtual bool ReceiveInto(void* buffer, size_t count,
+                           ssize_t* num_bytes) const;
+
+  // Vectored versions of |SendFrom| and |ReceiveInto|.
+  virtual bool SendV(const iovec* iov, size_t iovcnt,
+                     ssize_t* num_bytes) const;
+  virtual bool ReceiveV(const iovec* iov, size_t iovcnt,
+                        ssize_t* num_bytes) const;
+
+  // Batched UDP I/O. Sends |count| |datagrams| to the connected server, or
+  // receives up to |count| datagrams, moving many datagrams per syscall.
+  // |num_datagrams| is the number of datagrams actually transferred.
+  bool SendBatch(Datagram* datagrams, size_t count,
+                 size_t* num_datagrams) const;
+  bool ReceiveBatch(Datagram* datagrams, size_t count,
+                    size_t* num_datagrams) const;
+
+  // UDP segmentation offload (Linux). Once enabled, a single send of a buffer
+  // larger than |segment_size| leaves the socket as |segment_size| datagrams
+  // (UDP_SEGMENT), and the kernel may coalesce received datagrams into one
+  // receive (UDP_GRO). Use |ReceiveBatch| to learn the coalesced segment size.
+  // A |segment_size| of zero turns offload off. Returns false if the kernel
+  // does not support it.
+  bool EnableSegmentationOffload(uint16_t segment_size) const;
+
+  // Kernel timestamping for UDP (Linux SO_TIMESTAMPING). After
+  // |EnableTimestamping|, each datagram from |ReceiveBatch| carries the time
+  // the kernel received it, and |GetSendTimestamp| returns the time each send
+  // left, in send order, waiting up to |timeout_ms| milliseconds (-1 for no
+  // limit) for the next. |hardware| also asks for interface timestamps where
+  // the network interface provides them. Returns false if there is no
+  // timestamp, or if the kernel does not support timestamping.
+  bool EnableTimestamping(bool hardware) const;
+  bool GetSendTimestamp(PacketTimestamp* timestamp, int timeout_ms) const;
+
+  // Paced sending. |EnablePacing| spreads sends out to |bits_per_second|, or
+  // turns pacing off if it is zero, and returns how the socket is paced. TCP
+  // is paced by the kernel (SO_MAX_PACING_RATE). UDP sets the same kernel
+  // rate, which takes effect under the fq qdisc, but since the qdisc can't be
+  // seen from the socket, each send also waits on a user-space token bucket.
+  // A send on a non-blocking socket that would have to wait fails with errno
+  // set to EAGAIN. |ReadPacingInterval| sets |bytes| to the bytes sent since
+  // the last call and |elapsed_us| to the time since then; it returns false
+  // if pacing is off.
+  PacingMode EnablePacing(uint64_t bits_per_second) const;
+  bool ReadPacingInterval(uint64_t* bytes, uint64_t* elapsed_us) const;
+
+  // Zero-copy transmit for TCP (Linux MSG_ZEROCOPY). After
+  // |EnableZeroCopy|, |SendZeroCopy| hands the bytes of |bytes| to the kernel
+  // without copying them. The socket keeps a reference to the packet until
+  // the kernel reports the transmission complete, so the storage stays valid;
+  // a caller writing through Packet::mutable_buffer meanwhile gets a copy.
+  bool EnableZeroCopy() const;
+  bool SendZeroCopy(const Packet& bytes, ssize_t* num_bytes) const;
+
+  // Zero-copy send of a caller-owned |buffer|, which must not be modified or
+  // freed until |IsZeroCopyComplete| returns true for |send_id|.
+  bool SendFromZeroCopy(const void* buffer, size_t length, ssize_t* num_bytes,
+                        uint32_t* send_id) const;
+  bool IsZeroCopyComplete(uint32_t send_id) const;
+
+  // Reads completion notifications from the socket error queue, releasing the
+  // packets they cover. If |block| is set and sends are outstanding, waits for
+  // at least one notification. Returns the number of sends still outstanding.
+  // Reap regularly: the kernel fails sends with ENOBUFS if too many are
+  // outstanding.
+  size_t ReapZeroCopyCompletions(bool block) const;
 
   // Attempts to accumulate |count| bytes from connected clients. Returns the
   // received packet. |num_bytes| is the number of bytes actually received.
@@ -66,7 +158,10 @@ class ClientSocket : public Socket {
   virtual Packet ReceiveX(size_t count, ssize_t *num_bytes) const;
 
  private:
+  friend class UringLoop;
+
   ClientSocket(SocketType type, SocketFamily family);
+  ClientSocket(int connected_fd, SocketType type, SocketFamily family);
 
   bool Bind(const Host& host, uint16_t port);
   bool Connect(const Host& host, uint16_t port);
@@ -0,0 +1,91 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_DATAGRAM_H_
+#define _MLAB_DATAGRAM_H_
+
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+#include <sys/socket.h>
+#elif defined(OS_WINDOWS)
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#error Undefined platform
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+namespace mlab {
+
+// Kernel timestamps for one packet (SO_TIMESTAMPING, Linux only), in
+// nanoseconds since the epoch. Either is zero when it wasn't reported:
+// hardware timestamps need a network interface that supports them and has
+// them turned on (SIOCSHWTSTAMP). The kernel may take a few milliseconds to
+// start stamping receives after the first socket asks it to.
+struct PacketTimestamp {
+  uint64_t software_ns;
+  uint64_t hardware_ns;
+
+  // For a send timestamp, which send it is for: zero for the first datagram
+  // sent after timestamping was enabled, counting up by one per send.
+  uint32_t id;
+
+  PacketTimestamp() : software_ns(0), hardware_ns(0), id(0) { }
+};
+
+// One entry in a batched UDP send or receive. The caller owns |buffer|, so an
+// array of Datagrams can be reused across batches without allocating.
+struct Datagram {
+  // On send, the |length| bytes at |buffer| are sent. On receive, up to
+  // |length| bytes are written to |buffer|.
+  void* buffer;
+  size_t length;
+
+  // Set to the number of bytes actually sent or received.
+  ssize_t num_bytes;
+
+  // The peer this datagram was received from, or is to be sent to on sockets
+  // that are not connected. |peer_len| is zero when unset.
+  sockaddr_storage peer;
+  socklen_t peer_len;
+
+  // UDP segmentation offload (Linux only). On send, a non-zero value asks the
+  // kernel to split |buffer| into datagrams of this size (UDP_SEGMENT). On
+  // receive with offload enabled, a non-zero value means the kernel coalesced
+  // several datagrams of this size into |buffer| (UDP_GRO); the last may be
+  // shorter.
+  uint16_t segment_size;
+
+  // On receive with timestamping enabled, when the kernel received this
+  // datagram.
+  PacketTimestamp timestamp;
+
+  Datagram()
+      : buffer(NULL), length(0), num_bytes(0), peer_len(0), segment_size(0) {
+    memset(&peer, 0, sizeof(peer));
+  }
+
+  Datagram(void* buffer, size_t length)
+      : buffer(buffer), length(length), num_bytes(0), peer_len(0),
+        segment_size(0) {
+    memset(&peer, 0, sizeof(peer));
+  }
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_DATAGRAM_H_
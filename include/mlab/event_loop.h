@@ -0,0 +1,130 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_EVENT_LOOP_H_
+#define _MLAB_EVENT_LOOP_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <utility>
+
+namespace mlab {
+class Socket;
+
+enum EventType {
+  EVENT_READ = 1 << 0,
+  EVENT_WRITE = 1 << 1
+};
+
+// A single-threaded reactor that waits on many sockets at once (epoll on
+// Linux, poll elsewhere) and calls back when they are ready. Sockets should be
+// non-blocking; see |Socket::SetNonBlocking|. The loop doesn't own the sockets
+// or handlers registered with it.
+class EventLoop {
+ public:
+  class SocketHandler {
+   public:
+    virtual ~SocketHandler() { }
+
+    // Called when |socket| can be read without blocking, or when it has an
+    // error or the peer has hung up; the next receive reports which. For a
+    // ListenSocket, a connection is waiting to be accepted.
+    virtual void OnReadable(Socket* socket) = 0;
+
+    // Called when |socket| can be written without blocking.
+    virtual void OnWritable(Socket* socket) = 0;
+  };
+
+  class TimerHandler {
+   public:
+    virtual ~TimerHandler() { }
+
+    virtual void OnTimer(uint32_t timer_id) = 0;
+  };
+
+  // On failure, this will return a NULL pointer. On success, the caller is
+  // responsible for eventually deleting the loop.
+  static EventLoop* Create();
+
+  // See |Create| for details. On failure, this version FATALs.
+  static EventLoop* CreateOrDie();
+
+  ~EventLoop();
+
+  // Watch |socket| for |events|, a mask of EventTypes, calling |handler| when
+  // any are ready. A socket can be registered at most once and must be
+  // removed before it is deleted. It is safe to add, modify or remove
+  // sockets, including the one being handled, from within a callback.
+  bool Add(Socket* socket, int events, SocketHandler* handler);
+  bool Modify(Socket* socket, int events);
+  bool Remove(Socket* socket);
+
+  // Call |handler| once, at least |delay_ms| milliseconds from now. Returns an
+  // id that can be passed to |CancelTimer|.
+  uint32_t AddTimer(uint32_t delay_ms, TimerHandler* handler);
+  bool CancelTimer(uint32_t timer_id);
+
+  // Wait up to |timeout_ms| milliseconds (-1 for no limit) for a socket to be
+  // ready or a timer to expire, and dispatch the callbacks. Returns the number
+  // of callbacks made, or -1 on error.
+  int RunOnce(int timeout_ms);
+
+  // Dispatch callbacks until |Stop| is called or nothing is registered.
+  void Run();
+  void Stop();
+
+  // Make a |RunOnce| that is waiting, or the next one to wait, return early.
+  // Unlike everything else here, this may be called from any thread.
+  void Wake();
+
+ private:
+  struct Registration {
+    Socket* socket;
+    SocketHandler* handler;
+    int events;
+    uint32_t generation;
+  };
+
+  // Timers are ordered by deadline and then by id, so ties fire in the order
+  // they were added.
+  typedef std::pair<uint64_t, uint32_t> TimerKey;
+
+  EventLoop(int poll_fd, int wake_read_fd, int wake_write_fd);
+
+  int WaitAndDispatch(int timeout_ms);
+  int DispatchTimers();
+  int TimeoutUntilNextTimer(int timeout_ms) const;
+
+  // The epoll fd on Linux, unused elsewhere.
+  int poll_fd_;
+  bool stopped_;
+
+  // A pipe that |Wake| writes to, watched alongside the sockets.
+  int wake_read_fd_;
+  int wake_write_fd_;
+
+  // Registrations by fd. |generation| distinguishes a socket from one that
+  // reuses its fd after being removed during the same dispatch.
+  std::map<int, Registration> sockets_;
+  uint32_t next_generation_;
+
+  std::map<TimerKey, TimerHandler*> timers_;
+  std::map<uint32_t, uint64_t> timer_deadlines_;
+  uint32_t next_timer_id_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_EVENT_LOOP_H_
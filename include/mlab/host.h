@@ -43,9 +43,14 @@ typedef std::set<std::string> IPAddresses;
 class Host {
  public:
   // |hostname| can be a hostname or an IP address. Both will be checked for
-  // validity.
+  // validity. If |hostname| doesn't resolve, this FATALs.
   explicit Host(const std::string& hostname);
 
+  // See the constructor for details. On failure, this will return a NULL
+  // pointer. On success, the caller is responsible for eventually deleting
+  // the host.
+  static Host* Create(const std::string& hostname);
+
   // The hostname that was passed in to the constructor.
   std::string original_hostname;
 
@@ -56,9 +61,16 @@ class Host {
  private:
   typedef std::vector<sockaddr_storage> SocketAddressList;
 
+  Host() { }
+
+  // Fills in the addresses for |original_hostname|. Returns false if it
+  // doesn't resolve.
+  bool Resolve();
+
   friend class ClientSocket;
   friend class ServerSocket;
   friend class RawSocket;
+  friend class UringLoop;
 #if !defined(OS_ANDROID)
   FRIEND_TEST(HostTest, ResolveLocalHostIPv4);
   FRIEND_TEST(HostTest, ResolveLocalHostIPv6);
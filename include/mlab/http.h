@@ -16,26 +16,90 @@
 #define _MLAB_HTTP_H_
 
 #include <stdint.h>
+
+#include <deque>
+#include <map>
 #include <string>
+#include <vector>
+
+#include "mlab/http_parser.h"
 
 namespace mlab {
+class BufferedSocketReader;
+class ClientSocket;
+
 namespace http {
 
-// HTTP GET for |href| on host |hostname|. Returns the first |response_length|
-// bytes as a string.
+// HTTP GET for |href| on host |hostname|. Returns up to the first
+// |response_length| bytes of the response, status line and headers included,
+// receiving until the response ends or that many bytes have arrived.
 std::string Get(const std::string& hostname,
                 const std::string& href,
                 size_t response_length);
 
-// HTTP GET for |href| on host |hostname| at |port|. Returns the first
-// |response_length| bytes as a string.
+// As above, on host |hostname| at |port|.
 std::string Get(const std::string& hostname,
                 uint16_t port,
                 const std::string& href,
                 size_t response_length);
 
+// An HTTP/1.1 client that keeps connections alive between requests. Each
+// host and port has a pool of idle connections, so repeated requests skip
+// the DNS lookup and the TCP handshake. A request on a pooled connection the
+// server has since closed is retried on a new one.
+//
+// Not thread-safe; use one Client per thread.
+class Client {
+ public:
+  // The most idle connections kept per host when none is given.
+  static const size_t kDefaultMaxIdlePerHost;
+
+  Client();
+  explicit Client(size_t max_idle_per_host);
+
+  // Closes the pooled connections.
+  ~Client();
+
+  // GET |href| from |hostname| at |port| and read the whole response into
+  // |response|. Returns false if no response could be read.
+  bool Get(const std::string& hostname, uint16_t port,
+           const std::string& href, Response* response);
+
+  // Pipelined GETs: sends the requests for all |hrefs| on one connection
+  // before reading the first response. |responses| holds the responses in
+  // order. Requests the server didn't answer before closing the connection
+  // are sent again on a new one. Returns false unless every request was
+  // answered.
+  bool GetPipelined(const std::string& hostname, uint16_t port,
+                    const std::vector<std::string>& hrefs,
+                    std::vector<Response>* responses);
+
+  // The send and receive timeout for new connections; zero waits forever.
+  void set_timeout_ms(uint32_t timeout_ms) { timeout_ms_ = timeout_ms; }
+
+  // The number of idle connections across all hosts.
+  size_t idle_connections() const;
+
+ private:
+  struct Connection {
+    ClientSocket* socket;
+    BufferedSocketReader* reader;
+  };
+  typedef std::map<std::string, std::deque<Connection*> > Pool;
+
+  // Take an idle connection to |hostname| at |port| from the pool, or open
+  // a new one. Sets |reused| if it came from the pool.
+  Connection* Acquire(const std::string& hostname, uint16_t port,
+                      bool* reused);
+  void Release(const std::string& key, Connection* connection);
+  static void Close(Connection* connection);
+
+  const size_t max_idle_per_host_;
+  uint32_t timeout_ms_;
+  Pool pool_;
+};
+
 }  // namespace http
 }  // namespace mlab
 
 #endif  // _MLAB_HTTP_H_
-
@@ -0,0 +1,124 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_HTTP_PARSER_H_
+#define _MLAB_HTTP_PARSER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+
+namespace mlab {
+namespace http {
+
+struct Response {
+  Response() : status_code(0) { }
+
+  int status_code;
+  std::string reason;
+  // Header names are lower-cased, as they are case-insensitive.
+  std::map<std::string, std::string> headers;
+  // Empty if the parser hands the body to a BodyHandler instead.
+  std::string body;
+};
+
+// An incremental HTTP/1.1 response parser. Bytes are pushed in as they
+// arrive, in pieces of any size, and the response is complete once |done|.
+// The status line and headers are copied into the Response; the body is
+// appended to |Response::body|, or handed straight from the caller's buffer
+// to a BodyHandler without a copy. Bodies framed by Content-Length, by
+// chunked transfer encoding, or by the server closing the connection are
+// all supported.
+class ResponseParser {
+ public:
+  class BodyHandler {
+   public:
+    virtual ~BodyHandler() { }
+
+    // Called with each piece of the decoded body, in order. |data| points
+    // into the buffer passed to |Parse| and is only valid during the call.
+    virtual void OnBody(const char* data, size_t length) = 0;
+  };
+
+  // The longest status, header or chunk-size line accepted.
+  static const size_t kMaxLineLength;
+
+  // The largest body kept in |Response::body|. A response claiming or
+  // sending more is malformed, rather than left to exhaust memory. Bodies
+  // handed to a BodyHandler have no limit.
+  static const size_t kMaxBodyLength;
+
+  ResponseParser();
+  // The parser doesn't own |handler|.
+  explicit ResponseParser(BodyHandler* handler);
+
+  // Start parsing a new response into the caller-owned |response|, which
+  // must outlive the parse.
+  void Reset(Response* response);
+
+  // Parse up to |length| bytes from |data|. Sets |consumed| to the number
+  // used, which is less than |length| only if the response ended; the rest
+  // belong to the next response on the connection. Returns false if the
+  // response is malformed.
+  bool Parse(const char* data, size_t length, size_t* consumed);
+
+  // Call when the connection closes. Returns false if the response was cut
+  // short, and completes a response whose body runs to the close.
+  bool Finish();
+
+  bool done() const { return state_ == STATE_DONE; }
+
+  // Whether the connection can carry another response after this one.
+  bool keep_alive() const { return keep_alive_; }
+
+ private:
+  enum State {
+    STATE_STATUS_LINE,
+    STATE_HEADER,
+    STATE_BODY,          // Content-Length bytes remain.
+    STATE_BODY_TO_CLOSE,
+    STATE_CHUNK_SIZE,
+    STATE_CHUNK_DATA,
+    STATE_CHUNK_END,     // The CRLF after a chunk.
+    STATE_TRAILER,
+    STATE_DONE,
+    STATE_ERROR
+  };
+
+  bool IsLineState() const;
+  bool OnLine(const std::string& line);
+  bool OnStatusLine(const std::string& line);
+  bool OnHeader(const std::string& line);
+  bool OnHeadersEnd();
+  bool OnChunkSize(const std::string& line);
+  void OnBody(const char* data, size_t length);
+  // Whether |length| more body bytes fit under |kMaxBodyLength|.
+  bool BodyFits(uint64_t length) const;
+
+  BodyHandler* handler_;
+  Response* response_;
+  State state_;
+  int minor_version_;
+  bool keep_alive_;
+  uint64_t remaining_;
+  // A line split across calls to |Parse|.
+  std::string line_;
+};
+
+}  // namespace http
+}  // namespace mlab
+
+#endif  // _MLAB_HTTP_PARSER_H_
@@ -0,0 +1,68 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_LATENCY_HISTOGRAM_H_
+#define _MLAB_LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace mlab {
+
+// A fixed-size histogram of latencies in microseconds, for recording many
+// samples without keeping them. Values below |kSubBuckets| are counted
+// exactly; above that, each power of two is split into |kSubBuckets| equal
+// buckets, so percentiles are within 1/|kSubBuckets| of the true value.
+// Adding a sample is a few instructions and never allocates.
+class LatencyHistogram {
+ public:
+  static const size_t kSubBuckets = 16;
+  // Values from 2^|kMaxExponent| microseconds, about 19 hours, on are
+  // counted in the last bucket.
+  static const size_t kMaxExponent = 36;
+  static const size_t kNumBuckets = kSubBuckets * (kMaxExponent - 3);
+
+  LatencyHistogram();
+
+  void Add(uint64_t value_us);
+  void Clear();
+
+  // Adds the samples of |other| to this histogram.
+  void Merge(const LatencyHistogram& other);
+
+  uint64_t count() const { return count_; }
+  // Zero if there are no samples.
+  uint64_t min_us() const { return count_ == 0 ? 0 : min_us_; }
+  uint64_t max_us() const { return max_us_; }
+  uint64_t MeanUs() const;
+
+  // The value that |percentile| percent of the samples are at or below, for
+  // example 50 for the median. Zero if there are no samples.
+  uint64_t PercentileUs(double percentile) const;
+
+ private:
+  static size_t BucketFor(uint64_t value_us);
+  // The smallest value counted in |bucket|.
+  static uint64_t BucketLowerUs(size_t bucket);
+
+  uint32_t counts_[kNumBuckets];
+  uint64_t count_;
+  uint64_t sum_us_;
+  uint64_t min_us_;
+  uint64_t max_us_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_LATENCY_HISTOGRAM_H_
@@ -24,6 +24,8 @@
 #error Undefined platform
 #endif
 
+#include <vector>
+
 #include "mlab/host.h"
 #include "socket.h"
 
@@ -35,13 +37,33 @@ class ListenSocket : public Socket {
  public:
   // Create a socket to bind to and listen on |port|. Optionally supply the
   // |type| to be TCP or UDP (defaults to TCP) and the |family| to be IPv4 or
-  // IPv6 (defaults to IPv4). On failure, this will return a NULL pointer. On
-  // success, the caller is responsible for eventually deleting the socket.
+  // IPv6 (defaults to IPv4). A TCP socket queues up to |backlog| connections
+  // that have not yet been accepted (defaults to kDefaultBacklog). On failure,
+  // this will return a NULL pointer. On success, the caller is responsible for
+  // eventually deleting the socket.
   static ListenSocket* Create(uint16_t port);
   static ListenSocket* Create(uint16_t port, SocketFamily family);
   static ListenSocket* Create(uint16_t port, SocketType type);
   static ListenSocket* Create(uint16_t port, SocketType type,
                               SocketFamily family);
+  static ListenSocket* Create(uint16_t port, SocketType type,
+                              SocketFamily family, int backlog);
+
+  // As above, applying the set |options| before listening. Accepted sockets
+  // inherit them. Check |honored_options| for the ones the kernel honored.
+  static ListenSocket* Create(uint16_t port, SocketType type,
+                              SocketFamily family, int backlog,
+                              const SocketOptions& options);
+
+  // Create a group of |count| non-blocking sockets all listening on |port|
+  // with SO_REUSEPORT. The kernel spreads incoming connections (or datagrams)
+  // across the group, so each socket can be served by its own thread with its
+  // own accept queue. On failure, this will return false and |group| will be
+  // empty. On success, the caller is responsible for eventually deleting the
+  // sockets in |group|.
+  static bool CreateGroup(uint16_t port, SocketType type, SocketFamily family,
+                          int backlog, size_t count,
+                          std::vector<ListenSocket*>* group);
 
   // See |Create| for details. On failure, this version FATALs.
   static ListenSocket* CreateOrDie(uint16_t port);
@@ -49,28 +71,54 @@ class ListenSocket : public Socket {
   static ListenSocket* CreateOrDie(uint16_t port, SocketType type);
   static ListenSocket* CreateOrDie(uint16_t port, SocketType type,
                                    SocketFamily family);
+  static ListenSocket* CreateOrDie(uint16_t port, SocketType type,
+                                   SocketFamily family, int backlog);
+  static ListenSocket* CreateOrDie(uint16_t port, SocketType type,
+                                   SocketFamily family, int backlog,
+                                   const SocketOptions& options);
+
+  // The backlog used when none is given: the most the system allows.
+  static const int kDefaultBacklog;
+
+  // The send and receive timeout of listening and accepted sockets unless
+  // |options| sets them. See |Socket::SetSendTimeout|.
+  static const uint32_t kDefaultTimeoutMs;
 
   virtual ~ListenSocket();
 
-  // Start blocking until a client connects or |timeout| seconds have passed.
-  void Select();
-  void SelectWithTimeout(uint32_t timeout);
+  // Start blocking until a client connects, until |timeout| seconds have
+  // passed, or until |deadline_us| on the monotonic clock (see
+  // |Socket::DeadlineAfterMs|). Returns SOCKETSTATUS_TIMEOUT if no client
+  // connected in time.
+  SocketStatus Select();
+  SocketStatus SelectWithTimeout(uint32_t timeout);
+  SocketStatus SelectUntil(uint64_t deadline_us);
 
   // Accept the selected connection. Note, this may fail if the client
   // disconnects after Select succeeds. On success, a valid AcceptedSocket
-  // pointer is returned. Caller is responsible for deleting this.
+  // pointer is returned. Caller is responsible for deleting this. If this
+  // socket is non-blocking, so is the accepted socket, and NULL is returned
+  // when no connection is pending. Accepted sockets are close-on-exec.
   AcceptedSocket* Accept() const;
 
   // See |Accept| for details. On failure, this version FATALs.
   AcceptedSocket* AcceptOrDie() const;
 
-  virtual bool Send(const Packet&, ssize_t*) const;
-  virtual Packet Receive(size_t, ssize_t*) const;
+  virtual bool SendFrom(const void*, size_t, ssize_t*) const;
+  virtual bool ReceiveInto(void*, size_t, ssize_t*) const;
+  virtual bool SendV(const iovec*, size_t, ssize_t*) const;
+  virtual bool ReceiveV(const iovec*, size_t, ssize_t*) const;
 
  private:
-  ListenSocket(uint16_t port, SocketType type, SocketFamily family);
+  ListenSocket(SocketType type, SocketFamily family,
+               const SocketOptions& options);
+
+  // Bind to |port| and, for TCP, listen. Returns false, with the socket
+  // closed, if either fails.
+  bool Start(uint16_t port, int backlog, bool reuse_port);
 
-  void Start(uint16_t port);
+  // Applied to each accepted socket where the platform doesn't inherit them.
+  SocketOptions options_;
 };
 
 }  // namespace mlab
@@ -23,6 +23,9 @@
 namespace mlab {
 namespace ns {
 
+// The queries share one keep-alive connection to m-lab-ns. They are safe to
+// make from several threads, which take turns on it.
+
 // Query m-lab-ns for the given |tool| and return a valid host close to client
 // that can be used to open a connection.
 Host GetHostForTool(const std::string& tool);
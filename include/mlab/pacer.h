@@ -0,0 +1,85 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_PACER_H_
+#define _MLAB_PACER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace mlab {
+
+enum PacingMode {
+  PACING_OFF,
+  PACING_KERNEL,      // SO_MAX_PACING_RATE
+  PACING_USER_SPACE   // A Pacer in front of each send
+};
+
+// A token bucket that spreads sends out to a fixed rate. Before each send,
+// |Wait| (or |DelayUs| for callers that can't block) says when it may go;
+// afterwards, |Sent| takes the bytes actually sent out of the bucket. A send
+// may overdraw the bucket, and the next one then waits for the debt to be
+// repaid, so large sends keep the average rate exact.
+//
+// The pacer also counts the bytes sent, per interval and in total, so the
+// achieved rate can be checked against the target.
+class Pacer {
+ public:
+  // Pace to |bytes_per_second|, allowing bursts of up to |burst_bytes|. The
+  // default burst is a millisecond's worth of bytes, and at least one
+  // full-size Ethernet frame.
+  explicit Pacer(uint64_t bytes_per_second);
+  Pacer(uint64_t bytes_per_second, uint64_t burst_bytes);
+
+  // Block until the next send may go. Sleeps on the monotonic clock.
+  void Wait();
+
+  // Microseconds until the next send may go; zero if it may go now.
+  uint64_t DelayUs();
+
+  // Bytes that may go now without overdrawing the bucket.
+  uint64_t AvailableBytes();
+
+  // Account for |num_bytes| actually sent.
+  void Sent(size_t num_bytes);
+
+  // Sets |bytes| to the number sent since the last call (or since the pacer
+  // was created), and |elapsed_us| to the time since then, and starts a new
+  // interval.
+  void ReadInterval(uint64_t* bytes, uint64_t* elapsed_us);
+
+  uint64_t bytes_per_second() const { return bytes_per_second_; }
+  uint64_t total_bytes() const { return total_bytes_; }
+
+ private:
+  // Add the tokens earned since the last refill.
+  void Refill(uint64_t now_us);
+
+  const uint64_t bytes_per_second_;
+  const int64_t burst_bytes_;
+
+  // Available bytes; negative while repaying an overdraw.
+  int64_t tokens_;
+  // The part of a byte earned beyond |tokens_|, in millionths of a byte.
+  uint64_t remainder_;
+  uint64_t last_refill_us_;
+
+  uint64_t total_bytes_;
+  uint64_t interval_bytes_;
+  uint64_t interval_start_us_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_PACER_H_
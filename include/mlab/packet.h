@@ -17,42 +17,83 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
 namespace mlab {
 
+// An immutable view on a reference-counted byte buffer. Copying a Packet or
+// taking a |Slice| of it shares the underlying storage instead of copying the
+// bytes; the storage is freed when the last Packet referring to it goes away.
 // TODO(dominich): Should this take care of htonl/ntohl calls?
 class Packet {
  public:
+  Packet();
   explicit Packet(const std::vector<uint8_t>& data);
   explicit Packet(const std::string& data);
 
   // TODO(dominic): Maybe this can take a const T* instead?
   Packet(const char* buffer, size_t length);
 
-  template<typename T> Packet(const T& data) {
-    const uint8_t* buffer = reinterpret_cast<const uint8_t*>(&data);
-    size_t length = sizeof(T) / sizeof(uint8_t);
-    data_.assign(buffer, buffer + length);
+  template<typename T> Packet(const T& data) : storage_(NULL) {
+    Init(reinterpret_cast<const char*>(&data), sizeof(T) / sizeof(uint8_t));
   }
 
+  Packet(const Packet& other);
+  Packet& operator=(const Packet& other);
+  ~Packet();
+
+  // Returns a packet with |length| bytes of uninitialized storage that the
+  // caller fills through |mutable_buffer|. Used to receive straight into a
+  // packet without an intermediate copy.
+  static Packet Allocate(size_t length);
+
+  // Returns a packet that refers to the |length| bytes at |buffer| without
+  // copying or owning them, for example a packet in a capture ring. The bytes
+  // must stay valid and unchanged for as long as the packet, or any copy or
+  // slice of it, is used; |mutable_buffer| copies them first.
+  static Packet Unowned(const char* buffer, size_t length);
+
+  // Returns a packet covering |length| bytes starting at |offset| in this
+  // packet. The storage is shared, so this is O(1) and never copies. The range
+  // is clamped to the bytes available.
+  Packet Slice(size_t offset, size_t length) const;
+
   std::string str() const {
-    return length() == 0 ? std::string() : std::string(buffer(), 0, length());
+    return length() == 0 ? std::string() : std::string(buffer(), length());
   }
 
   const char* buffer() const {
-    return length() == 0 ? NULL : reinterpret_cast<const char*>(&data_[0]);
+    return length() == 0 ? NULL : reinterpret_cast<const char*>(begin_);
   }
-  const size_t length() const { return data_.size(); }
+  const size_t length() const { return length_; }
 
-  const std::vector<uint8_t>& data() const { return data_; }
+  // Writable access to the bytes of this packet. If the storage is shared with
+  // another packet it is copied first so the other packets are unaffected.
+  char* mutable_buffer();
+
+  // Returns a copy of the bytes of this packet.
+  std::vector<uint8_t> data() const {
+    return std::vector<uint8_t>(begin_, begin_ + length_);
+  }
 
   template<typename T> T as() const {
-    return length() == 0 ? T() : *(reinterpret_cast<const T*>(&data_[0]));
+    T value = T();
+    if (length() != 0)
+      memcpy(&value, begin_, length() < sizeof(T) ? length() : sizeof(T));
+    return value;
   }
+
  private:
-  std::vector<uint8_t> data_;
+  struct Storage;
+
+  void Init(const char* buffer, size_t length);
+  void Release();
+
+  Storage* storage_;
+  const uint8_t* begin_;
+  size_t length_;
 };
 
 }  // namespace mlab
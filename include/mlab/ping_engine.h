@@ -0,0 +1,172 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_PING_ENGINE_H_
+#define _MLAB_PING_ENGINE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "mlab/datagram.h"
+#include "mlab/host.h"
+#include "mlab/latency_histogram.h"
+#include "mlab/socket_family.h"
+
+namespace mlab {
+class RawSocket;
+
+struct PingStats {
+  PingStats() : sent(0), received(0), lost(0), late(0) { }
+
+  uint64_t sent;
+  uint64_t received;
+  // Probes with no reply within the timeout.
+  uint64_t lost;
+  // Replies that came after their probe timed out, or duplicates.
+  uint64_t late;
+  LatencyHistogram rtt;
+};
+
+// Sends ICMP or ICMPv6 echo requests to many destinations at once, with many
+// outstanding per destination, and streams the round trip times into a
+// histogram per destination. Each destination has its own echo identifier,
+// and replies are matched to their probes by identifier and sequence number
+// through a hash table, so matching costs the same however many probes are
+// outstanding. Probes time out through a timer wheel with a millisecond tick.
+// Replies are received in batches, after a socket filter has dropped the
+// other echo replies on the host in the kernel; nothing allocates once the
+// destinations are added.
+//
+// Needs root, for the raw socket.
+class PingEngine {
+ public:
+  // Ping over |family|, with up to |max_outstanding| probes awaiting a reply
+  // at a time, each waiting up to |timeout_ms| milliseconds. On failure, this
+  // will return a NULL pointer. On success, the caller is responsible for
+  // eventually deleting the engine.
+  static PingEngine* Create(SocketFamily family, size_t max_outstanding,
+                            uint32_t timeout_ms);
+
+  // See |Create| for details. On failure, this version FATALs.
+  static PingEngine* CreateOrDie(SocketFamily family, size_t max_outstanding,
+                                 uint32_t timeout_ms);
+
+  ~PingEngine();
+
+  // Adds |destination| and returns its index, or -1 if it has no address of
+  // the engine's family.
+  int AddDestination(const Host& destination);
+
+  // Sends one echo request to |destination|. Returns false if
+  // |max_outstanding| probes are already awaiting replies, or if the send
+  // failed.
+  bool Send(size_t destination);
+
+  // Receives replies and times out probes until |deadline_us| on the
+  // monotonic clock. Returns false if the socket failed.
+  bool Poll(uint64_t deadline_us);
+
+  // Waits until every outstanding probe has been answered or has timed out.
+  bool Finish();
+
+  // Sends |rounds| probes to every destination, spread evenly at
+  // |probes_per_second| in all, receiving replies in between, then waits for
+  // the last replies. Destinations are probed in turn, one per send.
+  bool Run(size_t rounds, uint32_t probes_per_second);
+
+  size_t num_destinations() const { return destinations_.size(); }
+  size_t outstanding() const { return outstanding_; }
+  size_t max_outstanding() const { return probes_.size(); }
+
+  const PingStats& stats(size_t destination) const {
+    return destinations_[destination].stats;
+  }
+
+ private:
+  struct Destination {
+    explicit Destination(const Host& host);
+
+    Host host;
+    // The address replies must come from: an in_addr or in6_addr.
+    char address[16];
+    uint16_t id;
+    uint16_t next_seq;
+    PingStats stats;
+  };
+
+  // A probe awaiting its reply, linked into the timer wheel slot for when it
+  // times out. Free probes are linked through |next|.
+  struct Probe {
+    uint32_t key;
+    uint32_t destination;
+    uint64_t sent_us;
+    uint32_t slot;
+    uint32_t next;
+    uint32_t prev;
+  };
+
+  PingEngine(RawSocket* socket, SocketFamily family, size_t max_outstanding,
+             uint32_t timeout_ms);
+
+  // Has the kernel drop echo replies for other processes, keeping those with
+  // the ids of the destinations added so far.
+  void AttachReplyFilter();
+
+  // The hash table, open addressed with linear probing, of probe indices by
+  // (id << 16 | seq).
+  size_t FindSlot(uint32_t key) const;
+  void Insert(uint32_t key, uint32_t probe);
+  void Erase(size_t slot);
+
+  void Schedule(uint32_t probe);
+  void Unschedule(uint32_t probe);
+  void Release(uint32_t probe);
+  // Times out the probes due by |now_us|.
+  void Expire(uint64_t now_us);
+
+  // Receives until |deadline_us|, or, if |until_idle|, until no probes are
+  // outstanding.
+  bool Receive(uint64_t deadline_us, bool until_idle);
+  void HandleReply(const char* packet, size_t length, const Datagram& from,
+                   uint64_t now_us);
+
+  RawSocket* socket_;
+  SocketFamily family_;
+  uint64_t timeout_us_;
+  uint16_t first_id_;
+  // The number of destinations whose ids the attached filter accepts.
+  size_t filtered_destinations_;
+
+  std::vector<Destination> destinations_;
+  std::vector<Probe> probes_;
+  uint32_t free_probe_;
+  size_t outstanding_;
+
+  std::vector<uint32_t> table_;
+  size_t table_mask_;
+
+  std::vector<uint32_t> wheel_;
+  size_t wheel_mask_;
+  // The last tick whose probes have been timed out.
+  uint64_t wheel_tick_;
+
+  std::vector<Datagram> batch_;
+  std::vector<char> buffers_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_PING_ENGINE_H_
@@ -39,8 +39,23 @@ namespace mlab {
 
 const int mlab_default_ttl = 64;
 
+// The Internet checksum of |len| bytes at |buffer|, which needn't be aligned,
+// ready to store in a header as it is. Uses SSE2 or AVX2 where the CPU has
+// them.
 uint16_t InternetCheckSum(const char* buffer, int len);
 
+// Incremental updates (RFC 1624): the new |checksum| after a field of the
+// checksummed bytes changes from |old_value| to |new_value|, without summing
+// the bytes again. All three are as stored in the packet, in network byte
+// order. A 16-bit field must start at an even offset in the checksummed
+// bytes; for a byte such as the TTL, pass the 16-bit word that holds it.
+uint16_t UpdateCheckSum(uint16_t checksum, uint16_t old_value,
+                        uint16_t new_value);
+// For a 32-bit field at an even offset, such as an ICMP echo's identifier
+// and sequence number together.
+uint16_t UpdateCheckSum32(uint16_t checksum, uint32_t old_value,
+                          uint32_t new_value);
+
 struct IP4Header {
   uint8_t  ver_hl;  // version header length
   uint8_t  type_of_service;
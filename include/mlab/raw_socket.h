@@ -16,6 +16,7 @@
 #define _MLAB_RAW_SOCKET_H_
 
 #include "mlab/socket.h"
+#include "mlab/socket_filter.h"
 
 namespace mlab {
 
@@ -33,18 +34,63 @@ class RawSocket : public Socket {
   virtual int Connect(const Host& host);
   virtual int Bind(const Host& host);
 
-  virtual bool Send(const Packet& bytes, ssize_t *num_bytes) const;
+  virtual bool SendFrom(const void* buffer, size_t length,
+                        ssize_t* num_bytes) const;
   virtual void SendToOrDie(const Host& host, const Packet& bytes,
                            ssize_t *num_bytes) const;
   virtual bool SendTo(const Host& host, const Packet& bytes,
                       ssize_t *num_bytes) const;
 
-  virtual Packet Receive(size_t count, ssize_t *num_bytes) const;
+  // Vectored I/O. |SendToV| sends the |iovcnt| buffers in |iov|, for example
+  // an IP4Header, an ICMP4Header and a shared payload, as one packet to |host|.
+  virtual bool SendV(const iovec* iov, size_t iovcnt,
+                     ssize_t* num_bytes) const;
+  virtual bool SendToV(const Host& host, const iovec* iov, size_t iovcnt,
+                       ssize_t* num_bytes) const;
+
+  virtual bool ReceiveInto(void* buffer, size_t count,
+                           ssize_t* num_bytes) const;
+  virtual bool ReceiveV(const iovec* iov, size_t iovcnt,
+                        ssize_t* num_bytes) const;
   virtual Packet ReceiveFromOrDie(size_t count, Host* host) const;
   virtual Packet ReceiveFrom(size_t count,
                              Host* host,
                              ssize_t* num_bytes) const;
 
+  // Receives up to |count| |datagrams|, one packet each, with as few syscalls
+  // as the platform allows, recording each sender in the datagram's |peer|.
+  // |num_datagrams| is the number of packets actually received.
+  bool ReceiveBatch(Datagram* datagrams, size_t count,
+                    size_t* num_datagrams) const;
+  // As |ReceiveBatch|, but waits for the first packet only until
+  // |deadline_us|, as |ReceiveUntil|.
+  SocketStatus ReceiveBatchUntil(Datagram* datagrams, size_t count,
+                                 uint64_t deadline_us,
+                                 size_t* num_datagrams) const;
+
+  // Kernel timestamping (Linux SO_TIMESTAMPING), for example to time probes
+  // without the scheduling noise of reading the clock in user space. After
+  // |EnableTimestamping|, each packet from |ReceiveBatch| carries the time the
+  // kernel received it, and |GetSendTimestamp| returns the time each send
+  // left, in send order, waiting up to |timeout_ms| milliseconds (-1 for no
+  // limit) for the next. |hardware| also asks for interface timestamps where
+  // the network interface provides them. Returns false if there is no
+  // timestamp, or if the kernel does not support timestamping.
+  bool EnableTimestamping(bool hardware) const;
+  bool GetSendTimestamp(PacketTimestamp* timestamp, int timeout_ms) const;
+
+  // Kernel-side filtering, so packets that aren't ours are dropped before
+  // they are queued. |AttachFilter| attaches a classic BPF |program|, such as
+  // one from socket_filter.h, replacing any attached before (Linux and Android
+  // only); packets already queued are still received. |DetachFilter| removes
+  // it.
+  bool AttachFilter(const FilterProgram& program) const;
+  bool DetachFilter() const;
+
+  // Which ICMPv6 types an IPv6 raw socket receives; see ICMP6Filter for the
+  // default.
+  bool SetICMP6Filter(const ICMP6Filter& filter) const;
+
   bool SetIPHDRINCL();  // only effective for IPv4, however won't fail on v6.
 
  private:
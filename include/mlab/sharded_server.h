@@ -0,0 +1,107 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_SHARDED_SERVER_H_
+#define _MLAB_SHARDED_SERVER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "mlab/event_loop.h"
+#include "mlab/socket_family.h"
+
+namespace mlab {
+class AcceptedSocket;
+class ListenSocket;
+
+// A TCP server with one worker thread per listener of a SO_REUSEPORT group
+// (see |ListenSocket::CreateGroup|). Each worker accepts from its own queue
+// and runs its own EventLoop, so accept throughput scales with the number of
+// workers.
+class ShardedServer {
+ public:
+  class Handler {
+   public:
+    virtual ~Handler() { }
+
+    // Called on the thread of the worker that accepted |socket|, which is
+    // non-blocking. The handler takes ownership of |socket| and may register
+    // it with |loop|, which only that worker runs. Calls from different
+    // workers can be concurrent.
+    virtual void OnAccept(EventLoop* loop, AcceptedSocket* socket) = 0;
+  };
+
+  // Create a server for |port| with |num_workers| listeners that each queue
+  // up to |backlog| connections. On failure, this will return a NULL pointer.
+  // On success, the caller is responsible for eventually deleting the server.
+  static ShardedServer* Create(uint16_t port, SocketFamily family,
+                               size_t num_workers, int backlog,
+                               Handler* handler);
+
+  // See |Create| for details. On failure, this version FATALs.
+  static ShardedServer* CreateOrDie(uint16_t port, SocketFamily family,
+                                    size_t num_workers, int backlog,
+                                    Handler* handler);
+
+  // Stops the server if it is running.
+  ~ShardedServer();
+
+  // Start the worker threads. Returns false if any failed to start, in which
+  // case none are left running.
+  bool Start();
+
+  // Ask the workers to leave their loops and wait until they have. Sockets the
+  // handler registered stay registered, and the loops stay valid until the
+  // server is deleted, so the handler can remove and delete them.
+  void Stop();
+
+  size_t num_workers() const { return workers_.size(); }
+
+ private:
+  class Worker : public EventLoop::SocketHandler {
+   public:
+    Worker(ShardedServer* server, ListenSocket* listener, EventLoop* loop);
+    virtual ~Worker();
+
+    virtual void OnReadable(Socket* socket);
+    virtual void OnWritable(Socket* socket);
+
+    static void* Run(void* worker);
+
+    ShardedServer* server_;
+    ListenSocket* listener_;
+    EventLoop* loop_;
+    pthread_t thread_;
+  };
+
+  explicit ShardedServer(Handler* handler);
+
+  // Set |stopping_| and wake the first |count| workers, or read it.
+  void StopWorkers(size_t count);
+  bool stopping();
+
+  Handler* handler_;
+  std::vector<Worker*> workers_;
+
+  // Guards |stopping_|, which the workers read between loop iterations.
+  pthread_mutex_t lock_;
+  bool stopping_;
+  bool running_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_SHARDED_SERVER_H_
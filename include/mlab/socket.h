@@ -15,34 +15,135 @@
 #ifndef _MLAB_SOCKET_H_
 #define _MLAB_SOCKET_H_
 
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+#include <sys/uio.h>
+#elif defined(OS_WINDOWS)
+#include <WinSock2.h>
+#else
+#error Undefined platform
+#endif
+
 #include <stdint.h>
+#include <sys/types.h>
+
+#include <deque>
 
+#include "mlab/datagram.h"
 #include "mlab/host.h"
+#include "mlab/pacer.h"
 #include "mlab/packet.h"
 #include "mlab/socket_family.h"
+#include "mlab/socket_options.h"
+#include "mlab/socket_status.h"
 #include "mlab/socket_type.h"
 
+#if defined(OS_WINDOWS)
+// Winsock has no iovec. Its WSABUF holds the same two fields in the other
+// order, so vectored I/O there copies between them.
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+#endif
+
 namespace mlab {
 
 class Socket {
  public:
   virtual ~Socket();
 
-  virtual bool Send(const Packet& bytes, ssize_t* num_bytes) const = 0;
-  virtual Packet Receive(size_t count, ssize_t* num_bytes) const = 0;
+  // Send |length| bytes from the caller-owned |buffer|. Sets |num_bytes| to
+  // the number of bytes actually sent.
+  virtual bool SendFrom(const void* buffer, size_t length,
+                        ssize_t* num_bytes) const = 0;
+
+  // Attempts to receive up to |count| bytes directly into the caller-owned
+  // |buffer|. Sets |num_bytes| to the number of bytes actually received. The
+  // buffer can be reused across calls so a receive loop need not allocate.
+  virtual bool ReceiveInto(void* buffer, size_t count,
+                           ssize_t* num_bytes) const = 0;
+
+  // Gather |iovcnt| buffers described by |iov| into a single send, or scatter
+  // a single receive across them, without first assembling them in one
+  // buffer. |num_bytes| is the total number of bytes actually transferred.
+  virtual bool SendV(const iovec* iov, size_t iovcnt,
+                     ssize_t* num_bytes) const = 0;
+  virtual bool ReceiveV(const iovec* iov, size_t iovcnt,
+                        ssize_t* num_bytes) const = 0;
+
+  // Packet wrappers around |SendFrom| and |ReceiveInto|.
+  bool Send(const Packet& bytes, ssize_t* num_bytes) const;
+  Packet Receive(size_t count, ssize_t* num_bytes) const;
 
   ssize_t SendOrDie(const Packet& bytes) const;
   Packet ReceiveOrDie(size_t count) const;
 
+  // Bulk send of |length| bytes read from the file |file_fd| starting at
+  // |offset| (sendfile), or from |from_fd| at its current position (splice,
+  // through an internal pipe unless |from_fd| is itself a pipe). The bytes
+  // move inside the kernel without a user-space copy. Stops early at end of
+  // input. |num_bytes| is the number of bytes actually sent, as for |Send|.
+  // On a non-blocking socket, bytes |Splice| has already moved into its
+  // internal pipe are still sent, waiting up to the send timeout for room.
+  // Connected TCP sockets on Linux only.
+  bool SendFile(int file_fd, off_t offset, size_t length,
+                ssize_t* num_bytes) const;
+  bool Splice(int from_fd, size_t length, ssize_t* num_bytes) const;
+
+  // Puts the socket in (or out of) non-blocking mode. A non-blocking send or
+  // receive that cannot proceed immediately fails with errno set to EAGAIN
+  // rather than waiting; see |EventLoop| for waiting on many sockets at once.
+  bool SetNonBlocking(bool non_blocking) const;
+  bool IsNonBlocking() const;
+
+  // Makes a send to a peer that has closed the connection fail with EPIPE
+  // rather than raising SIGPIPE, which kills the process unless handled.
+  // Covers every send on this socket, including |SendFile|, |Splice| and
+  // batched datagram sends. As sendfile and splice take no flag for this,
+  // those two block SIGPIPE on the calling thread for the duration.
+  bool SetNoSigPipe() const;
+
   bool SetSendBufferSize(size_t size) const;
   bool SetRecvBufferSize(size_t size) const;
   size_t GetSendBufferSize() const;
   size_t GetRecvBufferSize() const;
 
+  // How long a blocking send or receive waits (SO_SNDTIMEO and SO_RCVTIMEO),
+  // in milliseconds; zero waits forever, which is the default except for
+  // sockets from a ListenSocket. A call that times out having moved nothing
+  // fails with errno set to EAGAIN.
+  bool SetSendTimeout(uint32_t timeout_ms) const;
+  bool SetRecvTimeout(uint32_t timeout_ms) const;
+  uint32_t send_timeout_ms() const { return send_timeout_ms_; }
+  uint32_t recv_timeout_ms() const { return recv_timeout_ms_; }
+
+  // Deadline-based I/O for time-boxed work, on blocking and non-blocking
+  // sockets alike. |deadline_us| is a time on the monotonic clock, such as
+  // one from |DeadlineAfterMs|, or kNoDeadline. |ReceiveUntil| waits for
+  // bytes to arrive and receives them as |ReceiveInto| does. |SendUntil|
+  // sends all |length| bytes. Neither waits past the deadline: if it passes
+  // first they return SOCKETSTATUS_TIMEOUT, with |num_bytes| set to the
+  // number of bytes moved before it did.
+  static const uint64_t kNoDeadline;
+  static uint64_t DeadlineAfterMs(uint32_t timeout_ms);
+  SocketStatus ReceiveUntil(void* buffer, size_t count, uint64_t deadline_us,
+                            ssize_t* num_bytes) const;
+  SocketStatus SendUntil(const void* buffer, size_t length,
+                         uint64_t deadline_us, ssize_t* num_bytes) const;
+
   SocketType type() const {
     return type_ == SOCKETTYPE_ICMP ? SOCKETTYPE_RAW : type_;
   }
 
+  SocketFamily family() const { return family_; }
+
+  // A mask of the SocketOptions the kernel honored when the socket was
+  // created with a profile. See |SocketOptions|.
+  int honored_options() const { return honored_options_; }
+
+  // How sends are paced; see |ClientSocket::EnablePacing|.
+  PacingMode pacing_mode() const { return pacing_mode_; }
+
   int raw() const { return fd_; }
 
  protected:
@@ -51,9 +152,68 @@ class Socket {
   void CreateSocket();
   void DestroySocket();
 
+  // Paced sending shared by the connected sockets. |SetPacing| paces sends to
+  // |bits_per_second|, or turns pacing off if it is zero, and returns the mode
+  // used. |PaceSend| is called before each send and waits its turn, or fails
+  // with EAGAIN on a non-blocking socket; |PacedSent| counts what was sent.
+  PacingMode SetPacing(uint64_t bits_per_second) const;
+  bool PaceSend(ssize_t* num_bytes) const;
+  void PacedSent(ssize_t num_bytes) const;
+  bool ReadPacing(uint64_t* bytes, uint64_t* elapsed_us) const;
+
+  // Wait until the socket is readable, or writable if |write| is set, or
+  // until |deadline_us| passes.
+  SocketStatus WaitUntil(bool write, uint64_t deadline_us) const;
+
+  // Apply the options set in |options|, recording which were honored.
+  void ApplyOptions(const SocketOptions& options);
+
+  // Total number of bytes described by |iovcnt| entries of |iov|.
+  static size_t IOVecLength(const iovec* iov, size_t iovcnt);
+
+  // Batched datagram I/O shared by the UDP sockets. Moves up to |count|
+  // |datagrams| with as few syscalls as the platform allows (sendmmsg and
+  // recvmmsg on Linux) and sets |num_datagrams| to the number transferred.
+  // If |use_peer| is set each datagram is sent to its own |peer|. A receive
+  // blocks for the first datagram only and always fills in |peer|.
+  bool SendDatagrams(Datagram* datagrams, size_t count, bool use_peer,
+                     size_t* num_datagrams) const;
+  bool ReceiveDatagrams(Datagram* datagrams, size_t count,
+                        size_t* num_datagrams) const;
+
+  // Sets UDP_SEGMENT to |segment_size| and enables UDP_GRO, or disables both
+  // if |segment_size| is zero.
+  bool SetSegmentationOffload(uint16_t segment_size) const;
+
+  // Zero-copy transmit shared by the TCP sockets. |SendZeroCopyBuffer| sends
+  // with MSG_ZEROCOPY and keeps a reference to |hold| until the kernel reports
+  // the send complete through the error queue, which |ReapZeroCopy| reads.
+  bool SetZeroCopy() const;
+  bool SendZeroCopyBuffer(const void* buffer, size_t length,
+                          const Packet& hold, ssize_t* num_bytes,
+                          uint32_t* send_id) const;
+  size_t ReapZeroCopy(bool block) const;
+  bool ZeroCopySendComplete(uint32_t send_id) const;
+
+  // Kernel timestamping shared by the datagram sockets (Linux SO_TIMESTAMPING).
+  // Once set, |ReceiveDatagrams| fills in each datagram's receive timestamp and
+  // every send queues its transmit timestamp on the error queue, which
+  // |ReadSendTimestamp| reads, waiting up to |timeout_ms| milliseconds (-1 for
+  // no limit). |hardware| also asks for timestamps from the interface.
+  bool SetTimestamping(bool hardware) const;
+  bool ReadSendTimestamp(PacketTimestamp* timestamp, int timeout_ms) const;
+
   int fd_;
   SocketFamily family_;
   int protocol_;
+  int honored_options_;
+
+  // Mutable as the timeouts are set from the const setters.
+  mutable uint32_t send_timeout_ms_;
+  mutable uint32_t recv_timeout_ms_;
+
+  // Flags for every stream send, such as MSG_NOSIGNAL.
+  mutable int send_flags_;
 
  private:
   enum BufferType {
@@ -61,10 +221,29 @@ class Socket {
     BUFFERTYPE_RECV
   };
 
+  // A zero-copy send the kernel has not yet released.
+  struct ZeroCopySend {
+    uint32_t id;
+    bool done;
+    Packet packet;
+  };
+
   bool SetBufferSize(const size_t& size, BufferType type) const;
+  bool SetTimeoutOption(int name, uint32_t timeout_ms) const;
   size_t GetBufferSize(BufferType type) const;
 
+  void CompleteZeroCopy(uint32_t first_id, uint32_t last_id) const;
+
   SocketType type_;
+
+  // Zero-copy state is mutable as it changes from the const send methods.
+  mutable bool zerocopy_enabled_;
+  mutable uint32_t zerocopy_next_id_;
+  mutable std::deque<ZeroCopySend> zerocopy_pending_;
+
+  // Set when pacing, in either mode, to pace and count the sends.
+  mutable Pacer* pacer_;
+  mutable PacingMode pacing_mode_;
 };
 
 }  // namespace mlab
@@ -0,0 +1,74 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_SOCKET_FILTER_H_
+#define _MLAB_SOCKET_FILTER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "mlab/socket_family.h"
+
+namespace mlab {
+
+// One classic BPF instruction, as the kernel's struct sock_filter.
+struct FilterInstruction {
+  uint16_t code;
+  uint8_t jump_true;
+  uint8_t jump_false;
+  uint32_t k;
+};
+
+typedef std::vector<FilterInstruction> FilterProgram;
+
+// Prebuilt programs for |RawSocket::AttachFilter| on a raw ICMP socket of
+// |family|, so the kernel drops what isn't ours before it is queued. The
+// ranges are inclusive, and wrap around past 0xffff if |first| is greater
+// than |last|. Programs are empty where sockets can't take them, which is
+// everywhere but Linux and Android.
+//
+// Echo replies with an identifier from |first_id| to |last_id|.
+FilterProgram EchoReplyFilter(SocketFamily family, uint16_t first_id,
+                              uint16_t last_id);
+// Time Exceeded and Destination Unreachable errors quoting a UDP datagram
+// sent from a port from |first_port| to |last_port|. IPv6 errors quoting
+// extension headers are dropped.
+FilterProgram UDPErrorFilter(SocketFamily family, uint16_t first_port,
+                             uint16_t last_port);
+
+// The set of ICMPv6 types an IPv6 raw ICMP socket receives, for
+// |RawSocket::SetICMP6Filter|.
+class ICMP6Filter {
+ public:
+  // Passes echo replies, Time Exceeded and Destination Unreachable, which is
+  // what raw ICMPv6 sockets receive until told otherwise.
+  ICMP6Filter();
+
+  void PassAll();
+  void BlockAll();
+  void Pass(uint8_t type);
+  void Block(uint8_t type);
+
+  bool passes(uint8_t type) const {
+    return (pass_[type >> 5] & (1U << (type & 31))) != 0;
+  }
+
+ private:
+  uint32_t pass_[8];
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_SOCKET_FILTER_H_
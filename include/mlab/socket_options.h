@@ -0,0 +1,136 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_SOCKET_OPTIONS_H_
+#define _MLAB_SOCKET_OPTIONS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+namespace mlab {
+
+enum SocketOption {
+  SOCKETOPTION_NODELAY = 1 << 0,         // TCP_NODELAY
+  SOCKETOPTION_CORK = 1 << 1,            // TCP_CORK, or TCP_NOPUSH on BSD
+  SOCKETOPTION_NOTSENT_LOWAT = 1 << 2,   // TCP_NOTSENT_LOWAT
+  SOCKETOPTION_CONGESTION = 1 << 3,      // TCP_CONGESTION (Linux)
+  SOCKETOPTION_BUSY_POLL = 1 << 4,       // SO_BUSY_POLL (Linux)
+  SOCKETOPTION_PRIORITY = 1 << 5,        // SO_PRIORITY (Linux)
+  SOCKETOPTION_SEND_BUFFER = 1 << 6,     // SO_SNDBUF
+  SOCKETOPTION_RECV_BUFFER = 1 << 7,     // SO_RCVBUF
+  SOCKETOPTION_SEND_TIMEOUT = 1 << 8,    // SO_SNDTIMEO
+  SOCKETOPTION_RECV_TIMEOUT = 1 << 9     // SO_RCVTIMEO
+};
+
+// A profile of socket options to apply when a socket is created, before it
+// connects or listens. Only the options that have been set are applied; the
+// rest keep the system defaults. TCP options are skipped on other sockets.
+//
+// A socket created with a profile records which options the kernel honored,
+// that is, accepted and reads back as set, in |Socket::honored_options|. A
+// buffer size is honored if the kernel gave at least what was asked for.
+class SocketOptions {
+ public:
+  SocketOptions()
+      : options_(0),
+        nodelay_(false),
+        cork_(false),
+        notsent_lowat_(0),
+        busy_poll_us_(0),
+        priority_(0),
+        send_buffer_size_(0),
+        recv_buffer_size_(0),
+        send_timeout_ms_(0),
+        recv_timeout_ms_(0) { }
+
+  // Each setter also marks its option to be applied.
+  void set_nodelay(bool nodelay) {
+    nodelay_ = nodelay;
+    options_ |= SOCKETOPTION_NODELAY;
+  }
+  void set_cork(bool cork) {
+    cork_ = cork;
+    options_ |= SOCKETOPTION_CORK;
+  }
+  // The most unsent bytes to queue before the socket stops being writable.
+  void set_notsent_lowat(uint32_t bytes) {
+    notsent_lowat_ = bytes;
+    options_ |= SOCKETOPTION_NOTSENT_LOWAT;
+  }
+  // The congestion control algorithm, such as "cubic" or "bbr".
+  void set_congestion(const std::string& algorithm) {
+    congestion_ = algorithm;
+    options_ |= SOCKETOPTION_CONGESTION;
+  }
+  // How long a blocking receive busy-polls the device before sleeping.
+  void set_busy_poll_us(uint32_t us) {
+    busy_poll_us_ = us;
+    options_ |= SOCKETOPTION_BUSY_POLL;
+  }
+  void set_priority(int priority) {
+    priority_ = priority;
+    options_ |= SOCKETOPTION_PRIORITY;
+  }
+  void set_send_buffer_size(size_t size) {
+    send_buffer_size_ = size;
+    options_ |= SOCKETOPTION_SEND_BUFFER;
+  }
+  void set_recv_buffer_size(size_t size) {
+    recv_buffer_size_ = size;
+    options_ |= SOCKETOPTION_RECV_BUFFER;
+  }
+  // How long a blocking send or receive waits; zero waits forever.
+  void set_send_timeout_ms(uint32_t ms) {
+    send_timeout_ms_ = ms;
+    options_ |= SOCKETOPTION_SEND_TIMEOUT;
+  }
+  void set_recv_timeout_ms(uint32_t ms) {
+    recv_timeout_ms_ = ms;
+    options_ |= SOCKETOPTION_RECV_TIMEOUT;
+  }
+
+  // A mask of the SocketOptions that have been set.
+  int options() const { return options_; }
+  bool has(SocketOption option) const { return (options_ & option) != 0; }
+
+  bool nodelay() const { return nodelay_; }
+  bool cork() const { return cork_; }
+  uint32_t notsent_lowat() const { return notsent_lowat_; }
+  const std::string& congestion() const { return congestion_; }
+  uint32_t busy_poll_us() const { return busy_poll_us_; }
+  int priority() const { return priority_; }
+  size_t send_buffer_size() const { return send_buffer_size_; }
+  size_t recv_buffer_size() const { return recv_buffer_size_; }
+  uint32_t send_timeout_ms() const { return send_timeout_ms_; }
+  uint32_t recv_timeout_ms() const { return recv_timeout_ms_; }
+
+ private:
+  int options_;
+  bool nodelay_;
+  bool cork_;
+  uint32_t notsent_lowat_;
+  std::string congestion_;
+  uint32_t busy_poll_us_;
+  int priority_;
+  size_t send_buffer_size_;
+  size_t recv_buffer_size_;
+  uint32_t send_timeout_ms_;
+  uint32_t recv_timeout_ms_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_SOCKET_OPTIONS_H_
@@ -0,0 +1,25 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_SOCKET_STATUS_H_
+#define _MLAB_SOCKET_STATUS_H_
+
+// The outcome of an operation that waits no later than a deadline.
+enum SocketStatus {
+  SOCKETSTATUS_OK,
+  SOCKETSTATUS_TIMEOUT,  // The deadline passed first.
+  SOCKETSTATUS_ERROR     // errno says why.
+};
+
+#endif  //  _MLAB_SOCKET_STATUS_H_
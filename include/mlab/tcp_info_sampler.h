@@ -0,0 +1,153 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_TCP_INFO_SAMPLER_H_
+#define _MLAB_TCP_INFO_SAMPLER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "mlab/event_loop.h"
+
+namespace mlab {
+class Socket;
+
+// One snapshot of a connection's TCP_INFO. Fields the running kernel doesn't
+// report are zero.
+struct TcpInfoSample {
+  // When the sample was taken, in microseconds on the monotonic clock.
+  uint64_t time_us;
+
+  // The id |TcpInfoSampler::Add| returned for the connection.
+  uint32_t flow;
+
+  uint8_t state;
+  uint8_t ca_state;
+
+  // The congestion window and slow start threshold are in segments of
+  // |snd_mss| bytes.
+  uint32_t snd_cwnd;
+  uint32_t snd_ssthresh;
+  uint32_t snd_mss;
+
+  // Smoothed round-trip time and its variation, in microseconds.
+  uint32_t rtt_us;
+  uint32_t rttvar_us;
+
+  // Segments in flight, lost and retransmitted over the connection's life.
+  uint32_t unacked;
+  uint32_t lost;
+  uint32_t total_retrans;
+
+  // Bytes per second. |delivery_rate| is the most recent estimate of how
+  // fast data is being delivered; |pacing_rate| is what the sender is
+  // pacing at.
+  uint64_t delivery_rate;
+  uint64_t pacing_rate;
+
+  uint64_t bytes_acked;
+  uint64_t bytes_received;
+};
+
+// Samples TCP_INFO from many connections at a fixed interval, as web100
+// snapshots used to, to explain how a transfer behaved over time. Samples go
+// into a ring buffer allocated up front; when it is full the oldest samples
+// are overwritten, so read them out regularly with |Read|.
+//
+// Sampling is driven either by a timer on a caller's EventLoop or by a
+// background thread. Adding, removing and reading are safe from any thread.
+// The sampler doesn't own the sockets, which must be removed before they are
+// deleted. Linux only; |Create| fails elsewhere.
+class TcpInfoSampler : public EventLoop::TimerHandler {
+ public:
+  // Sample every |interval_ms| milliseconds into a ring of |capacity|
+  // samples. On failure, this will return a NULL pointer. On success, the
+  // caller is responsible for eventually deleting the sampler.
+  static TcpInfoSampler* Create(uint32_t interval_ms, size_t capacity);
+
+  // See |Create| for details. On failure, this version FATALs.
+  static TcpInfoSampler* CreateOrDie(uint32_t interval_ms, size_t capacity);
+
+  // Stops sampling if it is running.
+  virtual ~TcpInfoSampler();
+
+  // Start sampling the connected TCP |socket|, a ClientSocket or an
+  // AcceptedSocket. Returns the flow id its samples carry. Ids of removed
+  // flows are reused.
+  uint32_t Add(const Socket* socket);
+  void Remove(uint32_t flow);
+
+  // Sample every flow once now. Returns the number of samples taken.
+  size_t SampleNow();
+
+  // Sample from timers on |loop|, which must be run by the caller, or from a
+  // thread the sampler owns. Only one can be active at a time. |Stop| must be
+  // called on the thread running |loop|.
+  bool Start(EventLoop* loop);
+  bool StartThread();
+  void Stop();
+
+  // Move up to |count| of the oldest samples into |samples|. Returns the
+  // number moved.
+  size_t Read(TcpInfoSample* samples, size_t count);
+
+  // The number of samples waiting to be read, and the number overwritten
+  // before they were read.
+  size_t size() const;
+  uint64_t overwritten() const;
+
+  size_t num_flows() const;
+  uint32_t interval_ms() const { return interval_ms_; }
+
+  virtual void OnTimer(uint32_t timer_id);
+
+ private:
+  TcpInfoSampler(uint32_t interval_ms, size_t capacity);
+
+  static void* RunThread(void* sampler);
+
+  // Take a sample of |socket| into the next ring slot. Must hold |lock_|.
+  bool Sample(uint32_t flow, const Socket* socket, uint64_t now_us);
+
+  const uint32_t interval_ms_;
+
+  // Guards everything below.
+  mutable pthread_mutex_t lock_;
+
+  // Indexed by flow id; NULL where a flow was removed.
+  std::vector<const Socket*> flows_;
+  std::vector<uint32_t> free_flows_;
+  size_t num_flows_;
+
+  // Samples are written at |head_| and read from |head_| - |size_|.
+  std::vector<TcpInfoSample> ring_;
+  size_t head_;
+  size_t size_;
+  uint64_t overwritten_;
+
+  EventLoop* loop_;
+  uint32_t timer_id_;
+
+  pthread_t thread_;
+  pthread_cond_t wake_;
+  bool thread_running_;
+  bool stopping_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_TCP_INFO_SAMPLER_H_
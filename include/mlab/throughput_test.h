@@ -0,0 +1,114 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_THROUGHPUT_TEST_H_
+#define _MLAB_THROUGHPUT_TEST_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "mlab/host.h"
+#include "mlab/socket_family.h"
+
+struct pollfd;
+
+namespace mlab {
+class ListenSocket;
+class Socket;
+
+enum ThroughputDirection {
+  THROUGHPUT_SEND,
+  THROUGHPUT_RECEIVE
+};
+
+// Drives bulk data over N parallel TCP streams for a fixed duration, to fill
+// paths that a single stream can't. Each side either sends as fast as the
+// streams allow or receives and discards. All streams are served from one
+// thread, and the I/O loop doesn't allocate.
+class ThroughputTest {
+ public:
+  class Observer {
+   public:
+    virtual ~Observer() { }
+
+    // Called at the end of each report interval, and for the final partial
+    // interval. Use the |test| accessors for the per-stream figures.
+    virtual void OnInterval(const ThroughputTest& test) = 0;
+  };
+
+  // Open |num_streams| connections to |hostname| on |port|, or accept
+  // |num_streams| connections from the blocking |listener|. On failure, this
+  // will return a NULL pointer. On success, the caller is responsible for
+  // eventually deleting the test, which closes the streams.
+  static ThroughputTest* CreateClient(const Host& hostname, uint16_t port,
+                                      SocketFamily family, size_t num_streams,
+                                      ThroughputDirection direction);
+  static ThroughputTest* CreateServer(const ListenSocket& listener,
+                                      size_t num_streams,
+                                      ThroughputDirection direction);
+
+  ~ThroughputTest();
+
+  // Move data for |duration_ms| milliseconds, or until every stream has
+  // closed or failed, calling |observer| (which may be NULL) every
+  // |interval_ms| milliseconds. Returns false if the streams could not be
+  // polled.
+  bool Run(uint32_t duration_ms, uint32_t interval_ms, Observer* observer);
+
+  size_t num_streams() const { return streams_.size(); }
+  ThroughputDirection direction() const { return direction_; }
+
+  // Whether |stream| is still open.
+  bool active(size_t stream) const;
+
+  // Milliseconds since |Run| started, and the length of the last interval.
+  uint64_t elapsed_ms() const { return elapsed_ms_; }
+  uint64_t interval_ms() const { return interval_ms_; }
+
+  // Bytes moved in the last interval and since |Run| started.
+  uint64_t interval_bytes(size_t stream) const {
+    return interval_bytes_[stream];
+  }
+  uint64_t total_bytes(size_t stream) const { return total_bytes_[stream]; }
+  uint64_t interval_bytes() const;
+  uint64_t total_bytes() const;
+
+  // Goodput in megabits per second over the last interval and since |Run|
+  // started.
+  double IntervalMbps(size_t stream) const;
+  double IntervalMbps() const;
+  double TotalMbps() const;
+
+ private:
+  ThroughputTest(ThroughputDirection direction,
+                 const std::vector<Socket*>& streams);
+
+  void Transfer(size_t stream);
+
+  ThroughputDirection direction_;
+  std::vector<Socket*> streams_;
+  pollfd* fds_;
+  std::vector<char> buffer_;
+
+  uint64_t elapsed_ms_;
+  uint64_t interval_ms_;
+  std::vector<uint64_t> interval_bytes_;
+  std::vector<uint64_t> total_bytes_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_THROUGHPUT_TEST_H_
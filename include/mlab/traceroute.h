@@ -0,0 +1,110 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_TRACEROUTE_H_
+#define _MLAB_TRACEROUTE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "mlab/host.h"
+
+namespace mlab {
+class RawSocket;
+
+struct TracerouteOptions {
+  TracerouteOptions()
+      : first_ttl(1),
+        max_ttl(30),
+        probes_per_hop(1),
+        paris(true),
+        source_port(0),
+        dest_port(33434),
+        timeout_ms(2000) { }
+
+  uint8_t first_ttl;
+  uint8_t max_ttl;
+  int probes_per_hop;
+  // Paris traceroute: every probe has the same ports and payload, so load
+  // balancers that hash the flow send them all down one path, and probes
+  // are told apart by their IP ID. Otherwise each probe goes to its own
+  // destination port, counting up from |dest_port|, as classic traceroute.
+  bool paris;
+  // The UDP source port, which also tells this trace's replies from any
+  // other's. Zero picks one.
+  uint16_t source_port;
+  uint16_t dest_port;
+  // How long to wait for replies after the probes are sent.
+  uint32_t timeout_ms;
+};
+
+struct TracerouteProbe {
+  uint8_t ttl;
+  int attempt;
+  bool answered;
+  // The router or host that answered, and with which ICMP message.
+  std::string responder;
+  uint8_t icmp_type;
+  uint8_t icmp_code;
+  uint64_t rtt_us;
+};
+
+struct TracerouteResult {
+  TracerouteResult() : reached(false), destination_ttl(0) { }
+
+  // Ordered by TTL, then attempt. If the destination was reached, probes
+  // with a larger TTL than |destination_ttl| are left out.
+  std::vector<TracerouteProbe> probes;
+  bool reached;
+  uint8_t destination_ttl;
+};
+
+// Traces the path to a host with UDP probes, sending the probes for every
+// TTL at once rather than one hop at a time, so a trace takes about one
+// round trip plus the time for the last replies to arrive. Replies, ICMP
+// Time Exceeded from the routers on the way and Destination Unreachable from
+// the destination, are matched to their probes by the IP and UDP headers
+// they quote. A socket filter keeps other ICMP out of the receive queue.
+//
+// IPv4 only. Needs root, for the raw sockets.
+class TracerouteEngine {
+ public:
+  // On failure, this will return a NULL pointer. On success, the caller is
+  // responsible for eventually deleting the engine.
+  static TracerouteEngine* Create();
+
+  // See |Create| for details. On failure, this version FATALs.
+  static TracerouteEngine* CreateOrDie();
+
+  ~TracerouteEngine();
+
+  // Trace the path to |destination|, filling in |result|. Returns false if
+  // the probes couldn't be sent or the replies received; a trace that
+  // doesn't reach the destination still succeeds.
+  bool Trace(const Host& destination, const TracerouteOptions& options,
+             TracerouteResult* result);
+
+ private:
+  TracerouteEngine(RawSocket* probe_socket, RawSocket* icmp_socket);
+
+  RawSocket* probe_socket_;
+  RawSocket* icmp_socket_;
+  uint16_t next_session_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_TRACEROUTE_H_
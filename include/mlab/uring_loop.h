@@ -0,0 +1,133 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_URING_LOOP_H_
+#define _MLAB_URING_LOOP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <set>
+
+#include "mlab/host.h"
+#include "mlab/socket_family.h"
+#include "mlab/socket_type.h"
+
+struct io_uring_sqe;
+
+namespace mlab {
+class AcceptedSocket;
+class ClientSocket;
+class ListenSocket;
+class Socket;
+
+// A completion-based I/O loop on Linux io_uring. Accepts, connects, sends and
+// receives are queued and handed to the kernel together, so a busy loop makes
+// one syscall per batch rather than one per operation. Accept and receive can
+// be multishot: a single request keeps completing until it fails or the
+// stream ends. Multishot receives land in buffers the kernel picks from a
+// provided buffer ring (see |ProvideReceiveBuffers|).
+//
+// |Create| returns NULL when the kernel lacks io_uring or the operations used
+// here (Linux 5.11); callers should fall back to |EventLoop| or blocking I/O.
+// Multishot operations and provided buffer rings need Linux 5.19; older kernels
+// fail them with -EINVAL. The loop doesn't own the sockets or handlers passed
+// to it, and sockets must outlive their operations; |Cancel| ends them early.
+class UringLoop {
+ public:
+  class Handler {
+   public:
+    virtual ~Handler() { }
+
+    // Each |result| is what the equivalent syscall would have returned, or
+    // -errno on failure. The handler owns |accepted| and |connected|, which
+    // are blocking and NULL when |result| is negative.
+    virtual void OnAccept(ListenSocket* listener, AcceptedSocket* accepted,
+                          int result) { }
+    virtual void OnConnect(ClientSocket* connected, int result) { }
+    virtual void OnSend(Socket* socket, int result) { }
+
+    // |buffer| holds the |result| bytes received. For a multishot receive it
+    // is a provided buffer that is only valid during the call. A multishot
+    // receive that runs out of buffers is resubmitted without a callback, so
+    // a negative |result| is always final.
+    virtual void OnReceive(Socket* socket, const void* buffer, int result) { }
+  };
+
+  // On failure, this will return a NULL pointer. On success, the caller is
+  // responsible for eventually deleting the loop. |entries| bounds the
+  // number of operations queued between calls to |RunOnce|.
+  static UringLoop* Create(unsigned entries);
+
+  // See |Create| for details. On failure, this version FATALs.
+  static UringLoop* CreateOrDie(unsigned entries);
+
+  // Whether this kernel supports |UringLoop|.
+  static bool IsSupported();
+
+  ~UringLoop();
+
+  // Provide the kernel a ring of |count| buffers of |size| bytes for
+  // multishot receives (IORING_REGISTER_PBUF_RING). |count| must be a power of
+  // two. Can only be called once.
+  bool ProvideReceiveBuffers(size_t count, size_t size);
+
+  // Queue operations. Each calls back |handler| once when it completes, or,
+  // for multishot operations, once per connection or receive. |buffer| must
+  // stay valid until the callback. Return false if the operation could not be
+  // queued.
+  bool Accept(ListenSocket* listener, bool multishot, Handler* handler);
+  bool Connect(const Host& host, uint16_t port, SocketType type,
+               SocketFamily family, Handler* handler);
+  bool Send(Socket* socket, const void* buffer, size_t length,
+            Handler* handler);
+  bool Receive(Socket* socket, void* buffer, size_t length, Handler* handler);
+  bool ReceiveMultishot(Socket* socket, Handler* handler);
+
+  // Cancel every operation on |socket|. Each calls back with -ECANCELED.
+  bool Cancel(Socket* socket);
+
+  // Submit queued operations, wait up to |timeout_ms| milliseconds (-1 for no
+  // limit) for at least one to complete, and dispatch the callbacks. Returns
+  // the number of callbacks made, or -1 on error.
+  int RunOnce(int timeout_ms);
+
+  // Dispatch callbacks until no operations are outstanding.
+  void Run();
+
+  // The number of operations queued or in flight.
+  size_t pending() const { return operations_.size(); }
+
+ private:
+  struct Operation;
+  struct Ring;
+  struct BufferPool;
+
+  explicit UringLoop(Ring* ring);
+
+  Operation* NewOperation(int type, Socket* socket, Handler* handler);
+  io_uring_sqe* NextSqe();
+  bool Queue(Operation* operation);
+  int Submit(unsigned wait_for, int timeout_ms);
+  void Complete(Operation* operation, int result, uint32_t flags);
+  void RecycleBuffer(uint16_t buffer_id);
+
+  Ring* ring_;
+  BufferPool* buffers_;
+  std::set<Operation*> operations_;
+};
+
+}  // namespace mlab
+
+#endif  // _MLAB_URING_LOOP_H_
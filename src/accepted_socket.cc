@@ -50,22 +50,25 @@ AcceptedSocket::~AcceptedSocket() {
   }
 }
 
-bool AcceptedSocket::Send(const Packet& bytes, ssize_t *num_bytes) const {
+bool AcceptedSocket::SendFrom(const void* buffer, size_t length,
+                              ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
+  if (!PaceSend(num_bytes))
+    return false;
 
-  LOG(VERBOSE, "Sending %zu bytes\n", bytes.length());
+  LOG(VERBOSE, "Sending %zu bytes\n", length);
 
   ssize_t num = -1;
   switch (type()) {
     case SOCK_STREAM:
       ASSERT(client_addr_len_ == 0);
-      while ((num = send(fd_, bytes.buffer(), bytes.length(), 0)) == -1 &&
-              errno == EINTR) { }
+      while ((num = send(fd_, buffer, length, send_flags_)) == -1 &&
+             errno == EINTR) { }
       break;
 
     case SOCK_DGRAM:
       ASSERT(client_addr_len_ != 0);
-      while ((num = sendto(fd_, bytes.buffer(), bytes.length(), 0,
+      while ((num = sendto(fd_, buffer, length, 0,
                            reinterpret_cast<const sockaddr*>(&client_addr_),
                            client_addr_len_)) == -1 && errno == EINTR) { }
       break;
@@ -77,37 +80,36 @@ bool AcceptedSocket::Send(const Packet& bytes, ssize_t *num_bytes) const {
 
   if (num_bytes != NULL)
     *num_bytes = num;
+  PacedSent(num);
   if (num < 0) {  // errno won't change before return
-    LOG(ERROR, "Failed to send: %s [%d]", strerror(errno), errno);
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to send: %s [%d]",
+        strerror(errno), errno);
     return false;
   }
 
-  if (static_cast<size_t>(num) != bytes.length()) {
-    LOG(VERBOSE, "Failed to send %zu bytes; sent %zd bytes.",
-        bytes.length(), num);
+  if (static_cast<size_t>(num) != length) {
+    LOG(VERBOSE, "Failed to send %zu bytes; sent %zd bytes.", length, num);
   }
   return true;
 }
 
-Packet AcceptedSocket::Receive(size_t count, ssize_t *num_bytes) const {
+bool AcceptedSocket::ReceiveInto(void* buffer, size_t count,
+                                 ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
   ASSERT(count > 0);
 
   LOG(VERBOSE, "Receiving %zu bytes.", count);
 
-  char buffer[count];
-
   ssize_t num = -1;
   switch (type()) {
     case SOCK_STREAM:
-      while ((num = recv(fd_, &buffer[0], count, 0)) == -1 && errno == EINTR) {
-      }
+      while ((num = recv(fd_, buffer, count, 0)) == -1 && errno == EINTR) { }
       break;
 
     case SOCK_DGRAM:
       client_addr_len_ = sizeof(sockaddr_storage);
       while ((num = recvfrom(fd_,
-                             &buffer[0],
+                             buffer,
                              count,
                              0,
                              reinterpret_cast<sockaddr*>(&client_addr_),
@@ -124,16 +126,166 @@ Packet AcceptedSocket::Receive(size_t count, ssize_t *num_bytes) const {
   if (num_bytes != NULL)
     *num_bytes = num;
   if (num < 0) {
-    LOG(ERROR, "Failed to receive: %s [%d]", strerror(errno), errno);
-    return Packet("", 0);
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to receive: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+
+  if (static_cast<size_t>(num) != count) {
+    LOG(VERBOSE, "Tried to receive %zu bytes; received %zd bytes.",
+        count, num);
+  }
+  return true;
+}
+
+bool AcceptedSocket::SendV(const iovec* iov, size_t iovcnt,
+                           ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+  if (!PaceSend(num_bytes))
+    return false;
+
+  const size_t length = IOVecLength(iov, iovcnt);
+  LOG(VERBOSE, "Sending %zu bytes in %zu buffers", length, iovcnt);
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  switch (type()) {
+    case SOCK_STREAM:
+      ASSERT(client_addr_len_ == 0);
+      break;
+
+    case SOCK_DGRAM:
+      ASSERT(client_addr_len_ != 0);
+      msg.msg_name = &client_addr_;
+      msg.msg_namelen = client_addr_len_;
+      break;
+
+    default:
+      LOG(FATAL, "Unexpected socket type.");
+      break;
+  }
+
+  ssize_t num;
+  while ((num = sendmsg(fd_, &msg, send_flags_)) == -1 && errno == EINTR) { }
+
+  if (num_bytes != NULL)
+    *num_bytes = num;
+  PacedSent(num);
+  if (num < 0) {
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to sendmsg: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+
+  if (static_cast<size_t>(num) != length) {
+    LOG(VERBOSE, "Failed to send %zu bytes; sent %zd bytes.", length, num);
+  }
+  return true;
+}
+
+bool AcceptedSocket::ReceiveV(const iovec* iov, size_t iovcnt,
+                              ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+
+  const size_t count = IOVecLength(iov, iovcnt);
+  ASSERT(count > 0);
+
+  LOG(VERBOSE, "Receiving %zu bytes in %zu buffers.", count, iovcnt);
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  switch (type()) {
+    case SOCK_STREAM:
+      break;
+
+    case SOCK_DGRAM:
+      msg.msg_name = &client_addr_;
+      msg.msg_namelen = sizeof(sockaddr_storage);
+      break;
+
+    default:
+      LOG(FATAL, "Unexpected socket type.");
+      break;
+  }
+
+  ssize_t num;
+  while ((num = recvmsg(fd_, &msg, 0)) == -1 && errno == EINTR) { }
+  if (type() == SOCKETTYPE_UDP && num >= 0)
+    client_addr_len_ = msg.msg_namelen;
+
+  if (num_bytes != NULL)
+    *num_bytes = num;
+  if (num < 0) {
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to recvmsg: %s [%d]",
+        strerror(errno), errno);
+    return false;
   }
 
   if (static_cast<size_t>(num) != count) {
     LOG(VERBOSE, "Tried to receive %zu bytes; received %zd bytes.",
         count, num);
   }
+  return true;
+}
+
+bool AcceptedSocket::SendBatch(Datagram* datagrams, size_t count,
+                               size_t* num_datagrams) const {
+  return SendDatagrams(datagrams, count, true, num_datagrams);
+}
+
+bool AcceptedSocket::ReceiveBatch(Datagram* datagrams, size_t count,
+                                  size_t* num_datagrams) const {
+  return ReceiveDatagrams(datagrams, count, num_datagrams);
+}
+
+bool AcceptedSocket::EnableSegmentationOffload(uint16_t segment_size) const {
+  return SetSegmentationOffload(segment_size);
+}
+
+bool AcceptedSocket::EnableTimestamping(bool hardware) const {
+  return SetTimestamping(hardware);
+}
+
+bool AcceptedSocket::GetSendTimestamp(PacketTimestamp* timestamp,
+                                      int timeout_ms) const {
+  return ReadSendTimestamp(timestamp, timeout_ms);
+}
+
+PacingMode AcceptedSocket::EnablePacing(uint64_t bits_per_second) const {
+  return SetPacing(bits_per_second);
+}
+
+bool AcceptedSocket::ReadPacingInterval(uint64_t* bytes,
+                                        uint64_t* elapsed_us) const {
+  return ReadPacing(bytes, elapsed_us);
+}
+
+bool AcceptedSocket::EnableZeroCopy() const {
+  return SetZeroCopy();
+}
+
+bool AcceptedSocket::SendZeroCopy(const Packet& bytes, ssize_t* num_bytes) const {
+  return SendZeroCopyBuffer(bytes.buffer(), bytes.length(), bytes, num_bytes,
+                            NULL);
+}
+
+bool AcceptedSocket::SendFromZeroCopy(const void* buffer, size_t length,
+                                      ssize_t* num_bytes,
+                                      uint32_t* send_id) const {
+  return SendZeroCopyBuffer(buffer, length, Packet(), num_bytes, send_id);
+}
+
+bool AcceptedSocket::IsZeroCopyComplete(uint32_t send_id) const {
+  return ZeroCopySendComplete(send_id);
+}
 
-  LOG(VERBOSE, "Received %s.", buffer);
-  return Packet(buffer, num);
+size_t AcceptedSocket::ReapZeroCopyCompletions(bool block) const {
+  return ReapZeroCopy(block);
 }
 }  // namespace mlab
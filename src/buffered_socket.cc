@@ -0,0 +1,250 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/buffered_socket.h"
+
+#include <string.h>
+
+#include "log.h"
+#include "mlab/socket.h"
+
+namespace mlab {
+
+const size_t BufferedSocketReader::kDefaultBufferSize = 16 * 1024;
+const size_t BufferedSocketWriter::kDefaultBufferSize = 16 * 1024;
+
+BufferedSocketReader::BufferedSocketReader(const Socket* socket)
+    : socket_(socket),
+      buffer_(kDefaultBufferSize),
+      begin_(0),
+      end_(0),
+      eof_(false) {
+  ASSERT(socket != NULL);
+}
+
+BufferedSocketReader::BufferedSocketReader(const Socket* socket,
+                                           size_t buffer_size)
+    : socket_(socket),
+      buffer_(buffer_size),
+      begin_(0),
+      end_(0),
+      eof_(false) {
+  ASSERT(socket != NULL);
+  ASSERT(buffer_size > 0);
+}
+
+bool BufferedSocketReader::ReadLine(std::string* line) {
+  ASSERT(line != NULL);
+
+  // Only search the bytes that arrived since the last pass.
+  size_t searched = 0;
+  const char* newline;
+  while ((newline = static_cast<const char*>(
+              memchr(&buffer_[0] + begin_ + searched, '\n',
+                     buffered() - searched))) == NULL) {
+    if (buffered() == buffer_.size()) {
+      LOG(ERROR, "Line is longer than the %zu byte buffer.", buffer_.size());
+      return false;
+    }
+    searched = buffered();
+    if (!Fill(buffered() + 1))
+      return false;
+  }
+
+  const char* start = &buffer_[begin_];
+  size_t length = newline - start;
+  begin_ += length + 1;
+  if (length > 0 && start[length - 1] == '\r')
+    --length;
+  line->assign(start, length);
+  return true;
+}
+
+bool BufferedSocketReader::ReadExactly(void* buffer, size_t count) {
+  ASSERT(buffer != NULL);
+
+  char* out = static_cast<char*>(buffer);
+  if (count <= buffer_.size()) {
+    if (!Fill(count))
+      return false;
+    memcpy(out, &buffer_[begin_], count);
+    begin_ += count;
+    return true;
+  }
+
+  // Too large to stage: drain the buffer, then receive the rest in place.
+  size_t offset = buffered();
+  memcpy(out, &buffer_[0] + begin_, offset);
+  begin_ = end_ = 0;
+  while (offset < count) {
+    ssize_t num_bytes;
+    if (!socket_->ReceiveInto(out + offset, count - offset, &num_bytes))
+      return false;
+    if (num_bytes == 0) {
+      eof_ = true;
+      LOG(ERROR, "Stream ended %zu bytes short.", count - offset);
+      return false;
+    }
+    offset += num_bytes;
+  }
+  return true;
+}
+
+bool BufferedSocketReader::Peek(size_t count, const char** data) {
+  ASSERT(data != NULL);
+  ASSERT(count <= buffer_.size());
+
+  if (!Fill(count))
+    return false;
+  *data = &buffer_[begin_];
+  return true;
+}
+
+bool BufferedSocketReader::Skip(size_t count) {
+  if (count <= buffer_.size()) {
+    if (!Fill(count))
+      return false;
+    begin_ += count;
+    return true;
+  }
+
+  while (count > buffered()) {
+    count -= buffered();
+    begin_ = end_ = 0;
+    if (!Fill(1))
+      return false;
+  }
+  begin_ += count;
+  return true;
+}
+
+bool BufferedSocketReader::Fill(size_t count) {
+  ASSERT(count <= buffer_.size());
+
+  if (begin_ == end_)
+    begin_ = end_ = 0;
+
+  while (buffered() < count) {
+    // Slide what is left to the front only when the tail is too short.
+    if (buffer_.size() - begin_ < count) {
+      memmove(&buffer_[0], &buffer_[begin_], buffered());
+      end_ -= begin_;
+      begin_ = 0;
+    }
+
+    ssize_t num_bytes;
+    if (!socket_->ReceiveInto(&buffer_[end_], buffer_.size() - end_,
+                              &num_bytes)) {
+      return false;
+    }
+    if (num_bytes == 0) {
+      eof_ = true;
+      LOG(VERBOSE, "Stream ended with %zu bytes buffered.", buffered());
+      return false;
+    }
+    end_ += num_bytes;
+  }
+  return true;
+}
+
+BufferedSocketWriter::BufferedSocketWriter(const Socket* socket)
+    : socket_(socket),
+      buffer_(kDefaultBufferSize),
+      begin_(0),
+      end_(0) {
+  ASSERT(socket != NULL);
+}
+
+BufferedSocketWriter::BufferedSocketWriter(const Socket* socket,
+                                           size_t buffer_size)
+    : socket_(socket),
+      buffer_(buffer_size),
+      begin_(0),
+      end_(0) {
+  ASSERT(socket != NULL);
+  ASSERT(buffer_size > 0);
+}
+
+BufferedSocketWriter::~BufferedSocketWriter() {
+  if (buffered() > 0 && !Flush())
+    LOG(WARNING, "Dropped %zu unsent bytes.", buffered());
+}
+
+bool BufferedSocketWriter::Write(const void* buffer, size_t length) {
+  ASSERT(buffer != NULL || length == 0);
+
+  if (length >= buffer_.size()) {
+    return Flush() && SendAll(static_cast<const char*>(buffer), length);
+  }
+
+  if (!MakeRoom(length))
+    return false;
+  memcpy(&buffer_[end_], buffer, length);
+  end_ += length;
+  return true;
+}
+
+bool BufferedSocketWriter::Write(const Packet& bytes) {
+  return Write(bytes.buffer(), bytes.length());
+}
+
+bool BufferedSocketWriter::WriteLine(const std::string& line) {
+  const size_t length = line.length() + 2;
+  if (length >= buffer_.size())
+    return Write(line.data(), line.length()) && Write("\r\n", 2);
+
+  // Queue the line and its terminator together, or neither.
+  if (!MakeRoom(length))
+    return false;
+  memcpy(&buffer_[end_], line.data(), line.length());
+  memcpy(&buffer_[end_ + line.length()], "\r\n", 2);
+  end_ += length;
+  return true;
+}
+
+bool BufferedSocketWriter::Flush() {
+  while (begin_ < end_) {
+    ssize_t num_bytes;
+    if (!socket_->SendFrom(&buffer_[begin_], buffered(), &num_bytes))
+      return false;
+    begin_ += num_bytes;
+  }
+  begin_ = end_ = 0;
+  return true;
+}
+
+bool BufferedSocketWriter::MakeRoom(size_t length) {
+  if (buffer_.size() - end_ >= length)
+    return true;
+  if (buffer_.size() - buffered() >= length && begin_ > 0) {
+    memmove(&buffer_[0], &buffer_[begin_], buffered());
+    end_ -= begin_;
+    begin_ = 0;
+    return true;
+  }
+  return Flush() && buffer_.size() >= length;
+}
+
+bool BufferedSocketWriter::SendAll(const char* buffer, size_t length) {
+  size_t offset = 0;
+  while (offset < length) {
+    ssize_t num_bytes;
+    if (!socket_->SendFrom(buffer + offset, length - offset, &num_bytes))
+      return false;
+    offset += num_bytes;
+  }
+  return true;
+}
+
+}  // namespace mlab
@@ -0,0 +1,261 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/capture_socket.h"
+
+#if defined(OS_LINUX)
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "clock.h"
+#include "log.h"
+#include "mlab/socket.h"
+
+namespace mlab {
+#if defined(OS_LINUX)
+namespace {
+// The kernel sets a block's status from under us.
+uint32_t BlockStatus(const tpacket_block_desc* block) {
+  return *const_cast<const volatile uint32_t*>(&block->hdr.bh1.block_status);
+}
+}  // namespace
+#endif
+
+// static
+CaptureSocket* CaptureSocket::Create() {
+  return Create(CaptureOptions());
+}
+
+// static
+CaptureSocket* CaptureSocket::Create(const CaptureOptions& options) {
+  ASSERT(options.block_size > 0);
+  ASSERT(options.num_blocks > 0);
+
+#if defined(OS_LINUX)
+  const int socket_fd = socket(AF_PACKET, SOCK_RAW, htons(options.protocol));
+  if (socket_fd == -1) {
+    LOG(ERROR, "Failed to create capture socket: %s [%d]. Are you root?",
+        strerror(errno), errno);
+    return NULL;
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) != 0) {
+    LOG(ERROR, "Failed to set TPACKET_V3: %s [%d]", strerror(errno), errno);
+    close(socket_fd);
+    return NULL;
+  }
+
+  // TPACKET_V3 packs packets of any size into the blocks; the frame size
+  // only has to divide the block.
+  tpacket_req3 request;
+  memset(&request, 0, sizeof(request));
+  request.tp_block_size = options.block_size;
+  request.tp_block_nr = options.num_blocks;
+  request.tp_frame_size = TPACKET_ALIGNMENT << 7;
+  request.tp_frame_nr =
+      options.block_size / request.tp_frame_size * options.num_blocks;
+  request.tp_retire_blk_tov = options.block_timeout_ms;
+  if (setsockopt(socket_fd, SOL_PACKET, PACKET_RX_RING, &request,
+                 sizeof(request)) != 0) {
+    LOG(ERROR, "Failed to set up the capture ring: %s [%d]",
+        strerror(errno), errno);
+    close(socket_fd);
+    return NULL;
+  }
+
+  void* ring = mmap(NULL, options.block_size * options.num_blocks,
+                    PROT_READ | PROT_WRITE, MAP_SHARED, socket_fd, 0);
+  if (ring == MAP_FAILED) {
+    LOG(ERROR, "Failed to map the capture ring: %s [%d]",
+        strerror(errno), errno);
+    close(socket_fd);
+    return NULL;
+  }
+
+  // Bound only once the ring is set up, so no packet misses it.
+  sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(options.protocol);
+  if (!options.interface.empty()) {
+    address.sll_ifindex = if_nametoindex(options.interface.c_str());
+    if (address.sll_ifindex == 0) {
+      LOG(ERROR, "No interface %s.", options.interface.c_str());
+      munmap(ring, options.block_size * options.num_blocks);
+      close(socket_fd);
+      return NULL;
+    }
+  }
+  if (bind(socket_fd, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0) {
+    LOG(ERROR, "Failed to bind capture socket: %s [%d]",
+        strerror(errno), errno);
+    munmap(ring, options.block_size * options.num_blocks);
+    close(socket_fd);
+    return NULL;
+  }
+
+  return new CaptureSocket(socket_fd, static_cast<char*>(ring), options);
+#else
+  LOG(ERROR, "Packet capture is not supported on this platform.");
+  return NULL;
+#endif
+}
+
+// static
+CaptureSocket* CaptureSocket::CreateOrDie() {
+  return CreateOrDie(CaptureOptions());
+}
+
+// static
+CaptureSocket* CaptureSocket::CreateOrDie(const CaptureOptions& options) {
+  CaptureSocket* socket = Create(options);
+  if (socket == NULL)
+    LOG(FATAL, "Failed to create capture socket.");
+  return socket;
+}
+
+CaptureSocket::~CaptureSocket() {
+#if defined(OS_LINUX)
+  munmap(ring_, block_size_ * num_blocks_);
+  close(fd_);
+#endif
+}
+
+SocketStatus CaptureSocket::WaitForBlock(uint64_t deadline_us) {
+#if defined(OS_LINUX)
+  ReleaseBlock();
+
+  tpacket_block_desc* block =
+      reinterpret_cast<tpacket_block_desc*>(ring_ + block_ * block_size_);
+  while ((BlockStatus(block) & TP_STATUS_USER) == 0) {
+    int wait = -1;
+    if (deadline_us != Socket::kNoDeadline) {
+      const uint64_t now_us = MonotonicNowUs();
+      if (now_us >= deadline_us)
+        return SOCKETSTATUS_TIMEOUT;
+      wait = std::min<uint64_t>((deadline_us - now_us + 999) / 1000, INT_MAX);
+    }
+    pollfd entry = { fd_, POLLIN | POLLERR, 0 };
+    if (poll(&entry, 1, wait) == -1 && errno != EINTR) {
+      LOG(ERROR, "Failed to poll: %s [%d]", strerror(errno), errno);
+      return SOCKETSTATUS_ERROR;
+    }
+  }
+  // Read the packets only after seeing the kernel hand the block over.
+  __sync_synchronize();
+
+  holding_block_ = true;
+  packets_left_ = block->hdr.bh1.num_pkts;
+  next_packet_ = reinterpret_cast<const char*>(block) +
+                 block->hdr.bh1.offset_to_first_pkt;
+  LOG(VERBOSE, "Block %zu has %u packets.", block_, packets_left_);
+  return SOCKETSTATUS_OK;
+#else
+  return SOCKETSTATUS_ERROR;
+#endif
+}
+
+bool CaptureSocket::NextPacket(CapturedPacket* packet) {
+  ASSERT(packet != NULL);
+  if (packets_left_ == 0)
+    return false;
+
+#if defined(OS_LINUX)
+  const tpacket3_hdr* header =
+      reinterpret_cast<const tpacket3_hdr*>(next_packet_);
+  const sockaddr_ll* address = reinterpret_cast<const sockaddr_ll*>(
+      next_packet_ + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+
+  packet->data = Packet::Unowned(next_packet_ + header->tp_mac,
+                                 header->tp_snaplen);
+  packet->original_length = header->tp_len;
+  packet->timestamp_ns =
+      static_cast<uint64_t>(header->tp_sec) * 1000000000 + header->tp_nsec;
+  packet->interface_index = address->sll_ifindex;
+  packet->protocol = ntohs(address->sll_protocol);
+  packet->packet_type = address->sll_pkttype;
+
+  next_packet_ += header->tp_next_offset;
+  --packets_left_;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool CaptureSocket::GetStats(CaptureStats* stats) {
+  ASSERT(stats != NULL);
+
+#if defined(OS_LINUX)
+  // The kernel's counts reset on every read.
+  tpacket_stats_v3 kernel_stats;
+  socklen_t length = sizeof(kernel_stats);
+  if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &kernel_stats,
+                 &length) != 0) {
+    LOG(ERROR, "Failed to read capture statistics: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+  // The kernel counts the drops among the packets too.
+  stats_.packets += kernel_stats.tp_packets;
+  stats_.drops += kernel_stats.tp_drops;
+  *stats = stats_;
+  return true;
+#else
+  return false;
+#endif
+}
+
+CaptureSocket::CaptureSocket(int socket_fd, char* ring,
+                             const CaptureOptions& options)
+    : fd_(socket_fd),
+      ring_(ring),
+      block_size_(options.block_size),
+      num_blocks_(options.num_blocks),
+      block_(0),
+      holding_block_(false),
+      next_packet_(NULL),
+      packets_left_(0) { }
+
+void CaptureSocket::ReleaseBlock() {
+#if defined(OS_LINUX)
+  if (!holding_block_)
+    return;
+  tpacket_block_desc* block =
+      reinterpret_cast<tpacket_block_desc*>(ring_ + block_ * block_size_);
+  // Done with the packets before handing the block back.
+  __sync_synchronize();
+  block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+  block_ = (block_ + 1) % num_blocks_;
+  holding_block_ = false;
+  next_packet_ = NULL;
+  packets_left_ = 0;
+#endif
+}
+
+}  // namespace mlab
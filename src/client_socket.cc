@@ -30,17 +30,114 @@ typedef SSIZE_T ssize_t;
 #error Undefined platform
 #endif
 #include <errno.h>
+#include <limits.h>
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 #if defined(OS_LINUX)
 #include <malloc.h>
 #endif
 #include <string.h>
 
+#include <algorithm>
 #include <vector>
 
+#include "clock.h"
 #include "log.h"
 #include "mlab/host.h"
 
 namespace mlab {
+namespace {
+// The Connection Attempt Delay recommended by RFC 8305.
+const uint64_t kConnectionAttemptDelayMs = 250;
+
+bool SameAddress(const sockaddr_storage& a, const sockaddr_storage& b) {
+  if (a.ss_family != b.ss_family)
+    return false;
+  if (a.ss_family == AF_INET) {
+    return memcmp(&reinterpret_cast<const sockaddr_in&>(a).sin_addr,
+                  &reinterpret_cast<const sockaddr_in&>(b).sin_addr,
+                  sizeof(in_addr)) == 0;
+  }
+  return memcmp(&reinterpret_cast<const sockaddr_in6&>(a).sin6_addr,
+                &reinterpret_cast<const sockaddr_in6&>(b).sin6_addr,
+                sizeof(in6_addr)) == 0;
+}
+
+// Orders |addrs| for Happy Eyeballs: alternating families, IPv6 first, each
+// address once.
+std::vector<sockaddr_storage> InterleaveFamilies(
+    const std::vector<sockaddr_storage>& addrs) {
+  std::vector<sockaddr_storage> ipv6;
+  std::vector<sockaddr_storage> ipv4;
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    std::vector<sockaddr_storage>& family =
+        addrs[i].ss_family == AF_INET6 ? ipv6 : ipv4;
+    bool seen = false;
+    for (size_t j = 0; j < family.size() && !seen; ++j)
+      seen = SameAddress(family[j], addrs[i]);
+    if (!seen)
+      family.push_back(addrs[i]);
+  }
+
+  std::vector<sockaddr_storage> ordered;
+  for (size_t i = 0; i < std::max(ipv6.size(), ipv4.size()); ++i) {
+    if (i < ipv6.size())
+      ordered.push_back(ipv6[i]);
+    if (i < ipv4.size())
+      ordered.push_back(ipv4[i]);
+  }
+  return ordered;
+}
+
+#if !defined(OS_WINDOWS)
+// Starts a non-blocking connect to |addr| on |port|. Returns the socket, or
+// -1 if the attempt failed at once. Sets |connected| if it has already
+// succeeded.
+int StartConnect(sockaddr_storage addr, uint16_t port, bool* connected) {
+  socklen_t addrlen;
+  if (addr.ss_family == AF_INET) {
+    reinterpret_cast<sockaddr_in*>(&addr)->sin_port = htons(port);
+    addrlen = sizeof(sockaddr_in);
+  } else {
+    reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port = htons(port);
+    addrlen = sizeof(sockaddr_in6);
+  }
+
+#if defined(OS_LINUX)
+  // Set the attempt's flags in the same syscall.
+  int attempt_fd = socket(addr.ss_family,
+                          SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (attempt_fd == -1) {
+#else
+  int attempt_fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (attempt_fd == -1 ||
+      fcntl(attempt_fd, F_SETFD, FD_CLOEXEC) == -1 ||
+      fcntl(attempt_fd, F_SETFL, fcntl(attempt_fd, F_GETFL, 0) | O_NONBLOCK)
+          == -1) {
+#endif
+    LOG(WARNING, "Failed to create socket: %s [%d]", strerror(errno), errno);
+    if (attempt_fd != -1)
+      close(attempt_fd);
+    return -1;
+  }
+
+  int result;
+  while ((result = connect(attempt_fd, reinterpret_cast<sockaddr*>(&addr),
+                           addrlen)) == -1 && errno == EINTR) { }
+  *connected = result == 0;
+  if (result == -1 && errno != EINPROGRESS) {
+    LOG(VERBOSE, "Connect attempt failed: %s [%d]", strerror(errno), errno);
+    close(attempt_fd);
+    return -1;
+  }
+  return attempt_fd;
+}
+#endif
+}  // namespace
+
 // static
 ClientSocket* ClientSocket::Create(const Host& hostname, uint16_t port) {
   return Create(hostname, port, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4);
@@ -65,6 +162,15 @@ ClientSocket* ClientSocket::Create(const Host& hostname,
                                    uint16_t port,
                                    SocketType type,
                                    SocketFamily family) {
+  return Create(hostname, port, type, family, SocketOptions());
+}
+
+// static
+ClientSocket* ClientSocket::Create(const Host& hostname,
+                                   uint16_t port,
+                                   SocketType type,
+                                   SocketFamily family,
+                                   const SocketOptions& options) {
   ClientSocket* socket = new ClientSocket(type, family);
 
   if (socket->fd_ == -1) {
@@ -72,10 +178,13 @@ ClientSocket* ClientSocket::Create(const Host& hostname,
     return NULL;
   }
 
+  if (options.options() != 0)
+    socket->ApplyOptions(options);
+
   if (!socket->Connect(hostname, port)) {
-    socket->DestroySocket();
-    LOG(FATAL, "Failed to connect to host %s|%d.",
+    LOG(ERROR, "Failed to connect to host %s|%d.",
         hostname.original_hostname.c_str(), port);
+    delete socket;
     return NULL;
   }
 
@@ -132,7 +241,14 @@ ClientSocket* ClientSocket::CreateOrDie(const Host& hostname, uint16_t port,
 // static
 ClientSocket* ClientSocket::CreateOrDie(const Host& hostname, uint16_t port,
                                         SocketType type, SocketFamily family) {
-  ClientSocket* socket = Create(hostname, port, type, family);
+  return CreateOrDie(hostname, port, type, family, SocketOptions());
+}
+
+// static
+ClientSocket* ClientSocket::CreateOrDie(const Host& hostname, uint16_t port,
+                                        SocketType type, SocketFamily family,
+                                        const SocketOptions& options) {
+  ClientSocket* socket = Create(hostname, port, type, family, options);
   if (!socket) {
     LOG(FATAL, "Failed to create client socket for %s:%d",
         hostname.original_hostname.c_str(), port);
@@ -155,6 +271,129 @@ ClientSocket* ClientSocket::CreateOrDie(const Host& bindhost, uint16_t bindport,
   return socket;
 }
 
+// static
+ClientSocket* ClientSocket::CreateHappyEyeballs(const Host& hostname,
+                                                uint16_t port,
+                                                uint32_t timeout_ms) {
+#if defined(OS_WINDOWS)
+  LOG(ERROR, "Happy Eyeballs is not supported on this platform.");
+  return NULL;
+#else
+  const std::vector<sockaddr_storage> candidates =
+      InterleaveFamilies(hostname.sockaddr_);
+  const uint64_t deadline = MonotonicNowMs() + timeout_ms;
+  uint64_t next_attempt = 0;
+  size_t next_candidate = 0;
+
+  // Attempts in flight, and the family of each.
+  std::vector<pollfd> attempts;
+  std::vector<int> families;
+  int winner_fd = -1;
+  int winner_family = AF_UNSPEC;
+
+  while (winner_fd == -1) {
+    const uint64_t now = MonotonicNowMs();
+    if (now >= deadline)
+      break;
+
+    if (next_candidate < candidates.size() &&
+        (now >= next_attempt || attempts.empty())) {
+      const sockaddr_storage& addr = candidates[next_candidate++];
+      bool connected = false;
+      int attempt_fd = StartConnect(addr, port, &connected);
+      if (connected) {
+        winner_fd = attempt_fd;
+        winner_family = addr.ss_family;
+      } else if (attempt_fd != -1) {
+        pollfd attempt;
+        attempt.fd = attempt_fd;
+        attempt.events = POLLOUT;
+        attempt.revents = 0;
+        attempts.push_back(attempt);
+        families.push_back(addr.ss_family);
+        next_attempt = now + kConnectionAttemptDelayMs;
+      } else {
+        // Failed at once, so start the next attempt without waiting out the
+        // delay (RFC 8305, section 5).
+        next_attempt = now;
+      }
+      continue;
+    }
+    if (attempts.empty())
+      break;
+
+    uint64_t wake = deadline;
+    if (next_candidate < candidates.size())
+      wake = std::min(wake, next_attempt);
+    const int wait = std::min<uint64_t>(wake - now, INT_MAX);
+    int ready = poll(&attempts[0], attempts.size(), wait);
+    if (ready == -1 && errno != EINTR) {
+      LOG(ERROR, "Failed to poll connect attempts: %s [%d]",
+          strerror(errno), errno);
+      break;
+    }
+
+    for (size_t i = attempts.size(); i > 0 && ready > 0; --i) {
+      const size_t index = i - 1;
+      if (attempts[index].revents == 0)
+        continue;
+      int error = 0;
+      socklen_t error_len = sizeof(error);
+      if (getsockopt(attempts[index].fd, SOL_SOCKET, SO_ERROR, &error,
+                     &error_len) == -1) {
+        error = errno;
+      }
+      if (error == 0) {
+        winner_fd = attempts[index].fd;
+        winner_family = families[index];
+      } else {
+        LOG(VERBOSE, "Connect attempt failed: %s [%d]", strerror(error),
+            error);
+        close(attempts[index].fd);
+        // Start the next attempt without waiting out the delay.
+        next_attempt = now;
+      }
+      attempts.erase(attempts.begin() + index);
+      families.erase(families.begin() + index);
+      if (winner_fd != -1)
+        break;
+    }
+  }
+
+  for (size_t i = 0; i < attempts.size(); ++i)
+    close(attempts[i].fd);
+
+  if (winner_fd == -1) {
+    LOG(ERROR, "Failed to connect to %s on port %d (timeout %u ms).",
+        hostname.original_hostname.c_str(), port, timeout_ms);
+    return NULL;
+  }
+
+  ClientSocket* socket = new ClientSocket(
+      winner_fd, SOCKETTYPE_TCP,
+      winner_family == AF_INET6 ? SOCKETFAMILY_IPV6 : SOCKETFAMILY_IPV4);
+  if (!socket->SetNonBlocking(false)) {
+    delete socket;
+    return NULL;
+  }
+  LOG(INFO, "Connected to %s on port %d", hostname.original_hostname.c_str(),
+      port);
+  return socket;
+#endif
+}
+
+// static
+ClientSocket* ClientSocket::CreateHappyEyeballsOrDie(const Host& hostname,
+                                                     uint16_t port,
+                                                     uint32_t timeout_ms) {
+  ClientSocket* socket = CreateHappyEyeballs(hostname, port, timeout_ms);
+  if (!socket) {
+    LOG(FATAL, "Failed to connect to host %s|%d.",
+        hostname.original_hostname.c_str(), port);
+  }
+  return socket;
+}
+
 ClientSocket::~ClientSocket() { }
 
 bool ClientSocket::Bind(const Host& host, uint16_t port) {
@@ -276,35 +515,39 @@ bool ClientSocket::Connect(const Host& host, uint16_t port) {
   return false;
 }
 
-bool ClientSocket::Send(const Packet& bytes, ssize_t *num_bytes) const {
+bool ClientSocket::SendFrom(const void* buffer, size_t length,
+                            ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
+  if (!PaceSend(num_bytes))
+    return false;
 
   ssize_t num;
-  while ((num = send(fd_, bytes.buffer(), bytes.length(), 0)) == -1 &&
+  while ((num = send(fd_, buffer, length, send_flags_)) == -1 &&
          errno == EINTR) { }
   if (num_bytes != NULL)
     *num_bytes = num;
+  PacedSent(num);
 
   if (num < 0) {
-    LOG(ERROR, "Failed to send: %s [%d]", strerror(errno), errno);
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to send: %s [%d]",
+        strerror(errno), errno);
     return false;
   }
 
-  if (static_cast<size_t>(num) != bytes.length()) {
-    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.",
-        bytes.length(), num);
+  if (static_cast<size_t>(num) != length) {
+    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.", length, num);
   }
 
   return true;
 }
 
-Packet ClientSocket::Receive(size_t count, ssize_t *num_bytes) const {
+bool ClientSocket::ReceiveInto(void* buffer, size_t count,
+                               ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
   ASSERT(count > 0);
 
   LOG(VERBOSE, "Receiving %zu bytes.", count);
 
-  char buffer[count];
   ssize_t num;
   while ((num = recv(fd_, buffer, count, 0)) == -1 && errno == EINTR) { }
   if (num_bytes != NULL)
@@ -312,7 +555,7 @@ Packet ClientSocket::Receive(size_t count, ssize_t *num_bytes) const {
 
   if (num < 0) {
     LOG(VERBOSE, "Failed to recv: %s [%d]", strerror(errno), errno);
-    return Packet("", 0);
+    return false;
   }
 
   if (num == 0) {
@@ -322,7 +565,126 @@ Packet ClientSocket::Receive(size_t count, ssize_t *num_bytes) const {
         num);
   }
 
-  return Packet(buffer, num);
+  return true;
+}
+
+bool ClientSocket::SendV(const iovec* iov, size_t iovcnt,
+                         ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+  if (!PaceSend(num_bytes))
+    return false;
+
+  const size_t length = IOVecLength(iov, iovcnt);
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  ssize_t num;
+  while ((num = sendmsg(fd_, &msg, send_flags_)) == -1 && errno == EINTR) { }
+  if (num_bytes != NULL)
+    *num_bytes = num;
+  PacedSent(num);
+
+  if (num < 0) {
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to sendmsg: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+
+  if (static_cast<size_t>(num) != length) {
+    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.", length, num);
+  }
+
+  return true;
+}
+
+bool ClientSocket::ReceiveV(const iovec* iov, size_t iovcnt,
+                            ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+
+  const size_t count = IOVecLength(iov, iovcnt);
+  ASSERT(count > 0);
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  ssize_t num;
+  while ((num = recvmsg(fd_, &msg, 0)) == -1 && errno == EINTR) { }
+  if (num_bytes != NULL)
+    *num_bytes = num;
+
+  if (num < 0) {
+    LOG(VERBOSE, "Failed to recvmsg: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+
+  if (num == 0) {
+    LOG(WARNING, "Failed to recvmsg: No bytes available.");
+  } else if (static_cast<size_t>(num) != count) {
+    LOG(VERBOSE, "Tried to recv %zu bytes; recv %zd bytes instead.", count,
+        num);
+  }
+
+  return true;
+}
+
+bool ClientSocket::SendBatch(Datagram* datagrams, size_t count,
+                             size_t* num_datagrams) const {
+  return SendDatagrams(datagrams, count, false, num_datagrams);
+}
+
+bool ClientSocket::ReceiveBatch(Datagram* datagrams, size_t count,
+                                size_t* num_datagrams) const {
+  return ReceiveDatagrams(datagrams, count, num_datagrams);
+}
+
+bool ClientSocket::EnableSegmentationOffload(uint16_t segment_size) const {
+  return SetSegmentationOffload(segment_size);
+}
+
+bool ClientSocket::EnableTimestamping(bool hardware) const {
+  return SetTimestamping(hardware);
+}
+
+bool ClientSocket::GetSendTimestamp(PacketTimestamp* timestamp,
+                                    int timeout_ms) const {
+  return ReadSendTimestamp(timestamp, timeout_ms);
+}
+
+PacingMode ClientSocket::EnablePacing(uint64_t bits_per_second) const {
+  return SetPacing(bits_per_second);
+}
+
+bool ClientSocket::ReadPacingInterval(uint64_t* bytes,
+                                      uint64_t* elapsed_us) const {
+  return ReadPacing(bytes, elapsed_us);
+}
+
+bool ClientSocket::EnableZeroCopy() const {
+  return SetZeroCopy();
+}
+
+bool ClientSocket::SendZeroCopy(const Packet& bytes, ssize_t* num_bytes) const {
+  return SendZeroCopyBuffer(bytes.buffer(), bytes.length(), bytes, num_bytes,
+                            NULL);
+}
+
+bool ClientSocket::SendFromZeroCopy(const void* buffer, size_t length,
+                                    ssize_t* num_bytes,
+                                    uint32_t* send_id) const {
+  return SendZeroCopyBuffer(buffer, length, Packet(), num_bytes, send_id);
+}
+
+bool ClientSocket::IsZeroCopyComplete(uint32_t send_id) const {
+  return ZeroCopySendComplete(send_id);
+}
+
+size_t ClientSocket::ReapZeroCopyCompletions(bool block) const {
+  return ReapZeroCopy(block);
 }
 
 Packet ClientSocket::ReceiveX(size_t count, ssize_t *num_bytes) const {
@@ -331,7 +693,8 @@ Packet ClientSocket::ReceiveX(size_t count, ssize_t *num_bytes) const {
 
   LOG(VERBOSE, "Receiving %zu bytes.", count);
 
-  char buffer[count];
+  Packet packet = Packet::Allocate(count);
+  char* buffer = packet.mutable_buffer();
   size_t offset = 0;
 
   while (offset < count) {
@@ -343,7 +706,7 @@ Packet ClientSocket::ReceiveX(size_t count, ssize_t *num_bytes) const {
       if (num_bytes != NULL)
         *num_bytes = offset;
       LOG(VERBOSE, "Failed to recv: %s [%d]", strerror(errno), errno);
-      return Packet(buffer, offset);
+      return packet.Slice(0, offset);
     }
 
     if (num == 0)
@@ -361,11 +724,17 @@ Packet ClientSocket::ReceiveX(size_t count, ssize_t *num_bytes) const {
         offset);
   }
 
-  return Packet(buffer, offset);
+  return packet.Slice(0, offset);
 }
 
 ClientSocket::ClientSocket(SocketType type, SocketFamily family)
     : Socket(type, family) {
   CreateSocket();
 }
+
+ClientSocket::ClientSocket(int connected_fd, SocketType type,
+                           SocketFamily family)
+    : Socket(type, family) {
+  fd_ = connected_fd;
+}
 }  // namespace mlab
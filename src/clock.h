@@ -0,0 +1,45 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MLAB_CLOCK_H_
+#define _MLAB_CLOCK_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+namespace mlab {
+
+// Microseconds on a clock that doesn't jump with the wall clock, for
+// measuring intervals and deadlines.
+inline uint64_t MonotonicNowUs() {
+#if defined(OS_LINUX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+#else
+  timeval now;
+  gettimeofday(&now, NULL);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_usec;
+#endif
+}
+
+inline uint64_t MonotonicNowMs() {
+  return MonotonicNowUs() / 1000;
+}
+
+}  // namespace mlab
+
+#endif  // _MLAB_CLOCK_H_
@@ -0,0 +1,411 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/event_loop.h"
+
+#if defined(OS_LINUX)
+#include <sys/epoll.h>
+#endif
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <string.h>
+
+#include <vector>
+
+#include "clock.h"
+#include "log.h"
+#include "mlab/socket.h"
+
+namespace mlab {
+namespace {
+// The most ready sockets collected per wait.
+const int kMaxEventsPerWait = 64;
+
+#if defined(OS_LINUX)
+uint32_t EpollEventsFor(int events) {
+  uint32_t epoll_events = 0;
+  if (events & EVENT_READ)
+    epoll_events |= EPOLLIN;
+  if (events & EVENT_WRITE)
+    epoll_events |= EPOLLOUT;
+  return epoll_events;
+}
+
+uint64_t EpollDataFor(int socket_fd, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << 32) |
+      static_cast<uint32_t>(socket_fd);
+}
+#endif
+
+#if !defined(OS_WINDOWS)
+// Create a non-blocking, close-on-exec pipe in |pipe_fds|.
+bool CreateWakePipe(int pipe_fds[2]) {
+  if (pipe(pipe_fds) == -1) {
+    LOG(ERROR, "Failed to create wake pipe: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (fcntl(pipe_fds[i], F_SETFD, FD_CLOEXEC) == -1 ||
+        fcntl(pipe_fds[i], F_SETFL,
+              fcntl(pipe_fds[i], F_GETFL, 0) | O_NONBLOCK) == -1) {
+      LOG(ERROR, "Failed to set up wake pipe: %s [%d]", strerror(errno),
+          errno);
+      close(pipe_fds[0]);
+      close(pipe_fds[1]);
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+}  // namespace
+
+// static
+EventLoop* EventLoop::Create() {
+#if defined(OS_WINDOWS)
+  LOG(ERROR, "EventLoop is not supported on this platform.");
+  return NULL;
+#else
+  int wake_fds[2];
+  if (!CreateWakePipe(wake_fds))
+    return NULL;
+#if defined(OS_LINUX)
+  int poll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (poll_fd == -1) {
+    LOG(ERROR, "Failed to create epoll instance: %s [%d]",
+        strerror(errno), errno);
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    return NULL;
+  }
+  // No socket is registered with the wake pipe's fd, so it needs no
+  // generation to tell it apart.
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = EpollDataFor(wake_fds[0], 0);
+  if (epoll_ctl(poll_fd, EPOLL_CTL_ADD, wake_fds[0], &event) == -1) {
+    LOG(ERROR, "Failed to add wake pipe to epoll: %s [%d]",
+        strerror(errno), errno);
+    close(poll_fd);
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    return NULL;
+  }
+  return new EventLoop(poll_fd, wake_fds[0], wake_fds[1]);
+#else
+  return new EventLoop(-1, wake_fds[0], wake_fds[1]);
+#endif
+#endif
+}
+
+// static
+EventLoop* EventLoop::CreateOrDie() {
+  EventLoop* loop = Create();
+  if (!loop)
+    LOG(FATAL, "Failed to create event loop.");
+  return loop;
+}
+
+EventLoop::EventLoop(int poll_fd, int wake_read_fd, int wake_write_fd)
+    : poll_fd_(poll_fd),
+      stopped_(false),
+      wake_read_fd_(wake_read_fd),
+      wake_write_fd_(wake_write_fd),
+      next_generation_(0),
+      next_timer_id_(0) { }
+
+EventLoop::~EventLoop() {
+#if defined(OS_LINUX)
+  close(poll_fd_);
+#endif
+#if !defined(OS_WINDOWS)
+  close(wake_read_fd_);
+  close(wake_write_fd_);
+#endif
+}
+
+bool EventLoop::Add(Socket* socket, int events, SocketHandler* handler) {
+  ASSERT(socket != NULL);
+  ASSERT(handler != NULL);
+
+  const int socket_fd = socket->raw();
+  if (sockets_.find(socket_fd) != sockets_.end()) {
+    LOG(ERROR, "Socket with fd %d is already registered.", socket_fd);
+    return false;
+  }
+
+  Registration registration;
+  registration.socket = socket;
+  registration.handler = handler;
+  registration.events = events;
+  registration.generation = next_generation_++;
+
+#if defined(OS_LINUX)
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EpollEventsFor(events);
+  event.data.u64 = EpollDataFor(socket_fd, registration.generation);
+  if (epoll_ctl(poll_fd_, EPOLL_CTL_ADD, socket_fd, &event) == -1) {
+    LOG(ERROR, "Failed to add fd %d to epoll: %s [%d]", socket_fd,
+        strerror(errno), errno);
+    return false;
+  }
+#endif
+
+  sockets_[socket_fd] = registration;
+  LOG(VERBOSE, "Added fd %d to event loop.", socket_fd);
+  return true;
+}
+
+bool EventLoop::Modify(Socket* socket, int events) {
+  ASSERT(socket != NULL);
+
+  const int socket_fd = socket->raw();
+  std::map<int, Registration>::iterator it = sockets_.find(socket_fd);
+  if (it == sockets_.end() || it->second.socket != socket) {
+    LOG(ERROR, "Socket with fd %d is not registered.", socket_fd);
+    return false;
+  }
+
+#if defined(OS_LINUX)
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EpollEventsFor(events);
+  event.data.u64 = EpollDataFor(socket_fd, it->second.generation);
+  if (epoll_ctl(poll_fd_, EPOLL_CTL_MOD, socket_fd, &event) == -1) {
+    LOG(ERROR, "Failed to modify fd %d in epoll: %s [%d]",
+        socket_fd, strerror(errno), errno);
+    return false;
+  }
+#endif
+
+  it->second.events = events;
+  return true;
+}
+
+bool EventLoop::Remove(Socket* socket) {
+  ASSERT(socket != NULL);
+
+  const int socket_fd = socket->raw();
+  std::map<int, Registration>::iterator it = sockets_.find(socket_fd);
+  if (it == sockets_.end() || it->second.socket != socket) {
+    LOG(ERROR, "Socket with fd %d is not registered.", socket_fd);
+    return false;
+  }
+
+#if defined(OS_LINUX)
+  // The kernel drops closed fds itself, so a failure here is not an error.
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  if (epoll_ctl(poll_fd_, EPOLL_CTL_DEL, socket_fd, &event) == -1)
+    LOG(VERBOSE, "Failed to remove fd %d from epoll: %s [%d]",
+        socket_fd, strerror(errno), errno);
+#endif
+
+  sockets_.erase(it);
+  LOG(VERBOSE, "Removed fd %d from event loop.", socket_fd);
+  return true;
+}
+
+uint32_t EventLoop::AddTimer(uint32_t delay_ms, TimerHandler* handler) {
+  ASSERT(handler != NULL);
+
+  const uint32_t timer_id = next_timer_id_++;
+  const uint64_t deadline = MonotonicNowMs() + delay_ms;
+  timers_[TimerKey(deadline, timer_id)] = handler;
+  timer_deadlines_[timer_id] = deadline;
+  return timer_id;
+}
+
+bool EventLoop::CancelTimer(uint32_t timer_id) {
+  std::map<uint32_t, uint64_t>::iterator it = timer_deadlines_.find(timer_id);
+  if (it == timer_deadlines_.end())
+    return false;
+
+  timers_.erase(TimerKey(it->second, timer_id));
+  timer_deadlines_.erase(it);
+  return true;
+}
+
+int EventLoop::RunOnce(int timeout_ms) {
+  int dispatched = WaitAndDispatch(TimeoutUntilNextTimer(timeout_ms));
+  if (dispatched < 0)
+    return -1;
+  return dispatched + DispatchTimers();
+}
+
+void EventLoop::Run() {
+  stopped_ = false;
+  while (!stopped_ && (!sockets_.empty() || !timers_.empty())) {
+    if (RunOnce(-1) < 0)
+      break;
+  }
+}
+
+void EventLoop::Stop() {
+  stopped_ = true;
+}
+
+void EventLoop::Wake() {
+#if !defined(OS_WINDOWS)
+  // A full pipe already has a wake-up pending.
+  const char byte = 0;
+  ssize_t written;
+  while ((written = write(wake_write_fd_, &byte, 1)) == -1 &&
+         errno == EINTR) { }
+  if (written == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    LOG(ERROR, "Failed to wake event loop: %s [%d]", strerror(errno), errno);
+#endif
+}
+
+int EventLoop::TimeoutUntilNextTimer(int timeout_ms) const {
+  if (timers_.empty())
+    return timeout_ms;
+
+  const uint64_t now = MonotonicNowMs();
+  const uint64_t deadline = timers_.begin()->first.first;
+  const int until = deadline <= now ? 0 : static_cast<int>(deadline - now);
+  return (timeout_ms < 0 || until < timeout_ms) ? until : timeout_ms;
+}
+
+int EventLoop::WaitAndDispatch(int timeout_ms) {
+  // Collect the ready fds before dispatching any, then look each one up again
+  // as a callback may have removed it.
+  std::vector<std::pair<int, uint32_t> > ready;  // (fd, generation)
+  std::vector<int> ready_events;
+
+#if defined(OS_LINUX)
+  epoll_event events[kMaxEventsPerWait];
+  int num;
+  while ((num = epoll_wait(poll_fd_, events, kMaxEventsPerWait,
+                           timeout_ms)) == -1 && errno == EINTR) { }
+  if (num < 0) {
+    LOG(ERROR, "Failed to wait on epoll: %s [%d]", strerror(errno), errno);
+    return -1;
+  }
+  for (int i = 0; i < num; ++i) {
+    int ready_mask = 0;
+    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+      ready_mask |= EVENT_READ;
+    if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+      ready_mask |= EVENT_WRITE;
+    ready.push_back(std::make_pair(static_cast<int>(events[i].data.u64),
+                                   static_cast<uint32_t>(
+                                       events[i].data.u64 >> 32)));
+    ready_events.push_back(ready_mask);
+  }
+#elif !defined(OS_WINDOWS)
+  std::vector<pollfd> fds;
+  std::vector<uint32_t> generations;
+  pollfd wake_entry;
+  wake_entry.fd = wake_read_fd_;
+  wake_entry.events = POLLIN;
+  wake_entry.revents = 0;
+  fds.push_back(wake_entry);
+  generations.push_back(0);
+  for (std::map<int, Registration>::const_iterator it = sockets_.begin();
+       it != sockets_.end(); ++it) {
+    pollfd entry;
+    entry.fd = it->first;
+    entry.events = 0;
+    entry.revents = 0;
+    if (it->second.events & EVENT_READ)
+      entry.events |= POLLIN;
+    if (it->second.events & EVENT_WRITE)
+      entry.events |= POLLOUT;
+    fds.push_back(entry);
+    generations.push_back(it->second.generation);
+  }
+  int num;
+  while ((num = poll(&fds[0], fds.size(), timeout_ms)) == -1 &&
+         errno == EINTR) { }
+  if (num < 0) {
+    LOG(ERROR, "Failed to poll: %s [%d]", strerror(errno), errno);
+    return -1;
+  }
+  for (size_t i = 0; i < fds.size() && num > 0; ++i) {
+    if (fds[i].revents == 0)
+      continue;
+    --num;
+    int ready_mask = 0;
+    if (fds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+      ready_mask |= EVENT_READ;
+    if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL))
+      ready_mask |= EVENT_WRITE;
+    ready.push_back(std::make_pair(fds[i].fd, generations[i]));
+    ready_events.push_back(ready_mask);
+  }
+#endif
+
+  int dispatched = 0;
+  for (size_t i = 0; i < ready.size(); ++i) {
+    const int socket_fd = ready[i].first;
+    const uint32_t generation = ready[i].second;
+
+#if !defined(OS_WINDOWS)
+    if (socket_fd == wake_read_fd_) {
+      char drain[64];
+      while (read(wake_read_fd_, drain, sizeof(drain)) > 0) { }
+      continue;
+    }
+#endif
+
+    std::map<int, Registration>::iterator it = sockets_.find(socket_fd);
+    if (it != sockets_.end() && it->second.generation == generation &&
+        (it->second.events & ready_events[i] & EVENT_READ)) {
+      it->second.handler->OnReadable(it->second.socket);
+      ++dispatched;
+    }
+
+    it = sockets_.find(socket_fd);
+    if (it != sockets_.end() && it->second.generation == generation &&
+        (it->second.events & ready_events[i] & EVENT_WRITE)) {
+      it->second.handler->OnWritable(it->second.socket);
+      ++dispatched;
+    }
+  }
+  return dispatched;
+}
+
+int EventLoop::DispatchTimers() {
+  // Collect the expired timers first so that one added by a callback waits
+  // for the next pass, even with no delay.
+  const uint64_t now = MonotonicNowMs();
+  std::vector<TimerKey> expired;
+  for (std::map<TimerKey, TimerHandler*>::const_iterator it = timers_.begin();
+       it != timers_.end() && it->first.first <= now; ++it) {
+    expired.push_back(it->first);
+  }
+
+  int dispatched = 0;
+  for (size_t i = 0; i < expired.size(); ++i) {
+    // A callback may have cancelled this timer.
+    std::map<TimerKey, TimerHandler*>::iterator it = timers_.find(expired[i]);
+    if (it == timers_.end())
+      continue;
+    TimerHandler* handler = it->second;
+    timers_.erase(it);
+    timer_deadlines_.erase(expired[i].second);
+    handler->OnTimer(expired[i].second);
+    ++dispatched;
+  }
+  return dispatched;
+}
+
+}  // namespace mlab
@@ -37,6 +37,22 @@
 namespace mlab {
 
 Host::Host(const std::string& hostname) : original_hostname(hostname) {
+  if (!Resolve())
+    LOG(FATAL, "Failed to resolve %s.", hostname.c_str());
+}
+
+// static
+Host* Host::Create(const std::string& hostname) {
+  Host* host = new Host();
+  host->original_hostname = hostname;
+  if (!host->Resolve()) {
+    delete host;
+    return NULL;
+  }
+  return host;
+}
+
+bool Host::Resolve() {
   addrinfo hints;
   memset(&hints, 0, sizeof(hints));
   hints.ai_family = AF_UNSPEC;
@@ -44,8 +60,13 @@ Host::Host(const std::string& hostname) : original_hostname(hostname) {
   hints.ai_protocol = 0;
 
   addrinfo* servinfo;
-  if (int rv = getaddrinfo(hostname.c_str(), NULL, &hints, &servinfo) != 0)
-    LOG(FATAL, "Failed to resolve %s: %s", hostname.c_str(), gai_strerror(rv));
+  const int rv = getaddrinfo(original_hostname.c_str(), NULL, &hints,
+                             &servinfo);
+  if (rv != 0) {
+    LOG(ERROR, "Failed to resolve %s: %s", original_hostname.c_str(),
+        gai_strerror(rv));
+    return false;
+  }
 
   for (addrinfo* p = servinfo; p != NULL; p = p->ai_next) {
     sockaddr_storage saddr;
@@ -83,6 +104,7 @@ Host::Host(const std::string& hostname) : original_hostname(hostname) {
       LOG(VERBOSE, "Resolved: %s", address.c_str());
   }
   freeaddrinfo(servinfo);
+  return true;
 }
 
 }  // namespace mlab
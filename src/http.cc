@@ -14,9 +14,16 @@
 
 #include "mlab/http.h"
 
+#if defined(OS_WINDOWS)
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
+#include <algorithm>
 #include <sstream>
 
 #include "log.h"
+#include "mlab/buffered_socket.h"
 #include "mlab/client_socket.h"
 #include "scoped_ptr.h"
 
@@ -29,8 +36,67 @@ namespace {
 
 const uint16_t default_port = 80;
 
+std::string PoolKey(const std::string& hostname, uint16_t port) {
+  std::stringstream key;
+  key << hostname << ":" << port;
+  return key.str();
+}
+
+// An idle keep-alive connection has nothing to read. If it is readable the
+// server has closed it, or sent something unasked, and it can't be reused.
+bool IsStale(const ClientSocket* socket) {
+  pollfd entry = { socket->raw(), POLLIN, 0 };
+#if defined(OS_WINDOWS)
+  return WSAPoll(&entry, 1, 0) != 0;
+#else
+  return poll(&entry, 1, 0) != 0;
+#endif
+}
+
+void WriteRequest(const std::string& hostname, uint16_t port,
+                  const std::string& href, BufferedSocketWriter* writer) {
+  std::stringstream host;
+  host << hostname;
+  if (port != default_port)
+    host << ":" << port;
+
+  writer->WriteLine("GET /" + href + " HTTP/1.1");
+  writer->WriteLine("Host: " + host.str());
+  writer->WriteLine("User-Agent: " + get_user_agent());
+  writer->WriteLine("Connection: keep-alive");
+  writer->WriteLine("");
+}
+
+// Read one response into |response| with |parser|.
+bool ReadResponse(BufferedSocketReader* reader, ResponseParser* parser,
+                  Response* response) {
+  parser->Reset(response);
+  const char* data;
+  while (!parser->done()) {
+    if (!reader->Peek(1, &data))
+      return reader->eof() && parser->Finish();
+    // Parse everything buffered in place; what the parser leaves belongs to
+    // the next response.
+    const size_t length = reader->buffered();
+    reader->Peek(length, &data);
+    size_t consumed;
+    if (!parser->Parse(data, length, &consumed))
+      return false;
+    reader->Skip(consumed);
+  }
+  return true;
+}
+
+// Frames a response without keeping its body.
+class DiscardBody : public ResponseParser::BodyHandler {
+ public:
+  virtual void OnBody(const char*, size_t) { }
+};
+
 }  // namespace
 
+const size_t Client::kDefaultMaxIdlePerHost = 4;
+
 std::string Get(const std::string& hostname,
                 const std::string& href,
                 size_t response_length) {
@@ -45,22 +111,173 @@ std::string Get(const std::string& hostname,
   // dependencies and make cross-platform support simpler.
   Host host(hostname);
 
-  scoped_ptr<ClientSocket> socket(ClientSocket::CreateOrDie(host,
-                                                            default_port));
+  scoped_ptr<ClientSocket> socket(ClientSocket::CreateOrDie(host, port));
 
   std::stringstream request;
   request << "GET http://" << hostname << "/" << href << " HTTP/1.1\r\n";
-  request << "Host: " << *host.resolved_ips.begin() << ":" << default_port <<
-             "\r\n";
+  request << "Host: " << *host.resolved_ips.begin() << ":" << port << "\r\n";
   request << "User-Agent: " << get_user_agent() << "\r\n";
   request << "\r\n";
   LOG(VERBOSE, "Sending request: %s", request.str().c_str());
   Packet p(request.str());
   socket->SendOrDie(p);
 
-  // TODO(dominich): Better management of receive buffer than a fixed guess of
-  // the length.
-  return socket->ReceiveOrDie(response_length).str();;
+  // Receive until the response ends, rather than guessing at its length.
+  std::string response;
+  DiscardBody discard;
+  ResponseParser parser(&discard);
+  Response parsed;
+  parser.Reset(&parsed);
+  char buffer[4096];
+  while (response.length() < response_length && !parser.done()) {
+    ssize_t num_bytes;
+    if (!socket->ReceiveInto(buffer, sizeof(buffer), &num_bytes))
+      LOG(FATAL, "Failed to receive the response from %s.", hostname.c_str());
+    if (num_bytes == 0)
+      break;
+    response.append(buffer, std::min<size_t>(num_bytes,
+                                             response_length -
+                                             response.length()));
+    size_t consumed;
+    if (!parser.Parse(buffer, num_bytes, &consumed))
+      break;
+  }
+  return response;
+}
+
+Client::Client()
+    : max_idle_per_host_(kDefaultMaxIdlePerHost),
+      timeout_ms_(0) { }
+
+Client::Client(size_t max_idle_per_host)
+    : max_idle_per_host_(max_idle_per_host),
+      timeout_ms_(0) { }
+
+Client::~Client() {
+  for (Pool::iterator it = pool_.begin(); it != pool_.end(); ++it) {
+    for (size_t i = 0; i < it->second.size(); ++i)
+      Close(it->second[i]);
+  }
+}
+
+bool Client::Get(const std::string& hostname, uint16_t port,
+                 const std::string& href, Response* response) {
+  ASSERT(response != NULL);
+
+  std::vector<Response> responses;
+  if (!GetPipelined(hostname, port, std::vector<std::string>(1, href),
+                    &responses)) {
+    return false;
+  }
+  *response = responses[0];
+  return true;
+}
+
+bool Client::GetPipelined(const std::string& hostname, uint16_t port,
+                          const std::vector<std::string>& hrefs,
+                          std::vector<Response>* responses) {
+  ASSERT(responses != NULL);
+
+  const std::string key = PoolKey(hostname, port);
+  responses->clear();
+  responses->reserve(hrefs.size());
+  while (responses->size() < hrefs.size()) {
+    bool reused;
+    Connection* connection = Acquire(hostname, port, &reused);
+    if (connection == NULL)
+      return false;
+
+    const size_t first = responses->size();
+    bool sent;
+    {
+      BufferedSocketWriter writer(connection->socket);
+      for (size_t i = first; i < hrefs.size(); ++i)
+        WriteRequest(hostname, port, hrefs[i], &writer);
+      sent = writer.Flush();
+    }
+    LOG(VERBOSE, "Sent %zu requests to %s.", hrefs.size() - first,
+        key.c_str());
+
+    // The responses are parsed in place, straight into |responses|.
+    ResponseParser parser;
+    bool keep_alive = sent;
+    while (keep_alive && responses->size() < hrefs.size()) {
+      responses->push_back(Response());
+      if (!ReadResponse(connection->reader, &parser, &responses->back())) {
+        responses->pop_back();
+        keep_alive = false;
+        break;
+      }
+      keep_alive = parser.keep_alive();
+    }
+
+    if (keep_alive)
+      Release(key, connection);
+    else
+      Close(connection);
+
+    // A pooled connection may have been closed by the server while idle;
+    // only a new connection that gets nowhere is a failure.
+    if (responses->size() == first && !reused) {
+      LOG(ERROR, "No response from %s.", key.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t Client::idle_connections() const {
+  size_t idle = 0;
+  for (Pool::const_iterator it = pool_.begin(); it != pool_.end(); ++it)
+    idle += it->second.size();
+  return idle;
+}
+
+Client::Connection* Client::Acquire(const std::string& hostname,
+                                    uint16_t port, bool* reused) {
+  std::deque<Connection*>& idle = pool_[PoolKey(hostname, port)];
+  while (!idle.empty()) {
+    // The most recently used connection is the least likely to be stale.
+    Connection* connection = idle.back();
+    idle.pop_back();
+    if (!IsStale(connection->socket)) {
+      *reused = true;
+      return connection;
+    }
+    Close(connection);
+  }
+
+  *reused = false;
+  scoped_ptr<Host> host(Host::Create(hostname));
+  if (host.get() == NULL)
+    return NULL;
+  ClientSocket* socket = ClientSocket::Create(*host.get(), port);
+  if (socket == NULL)
+    return NULL;
+  if (timeout_ms_ != 0) {
+    socket->SetSendTimeout(timeout_ms_);
+    socket->SetRecvTimeout(timeout_ms_);
+  }
+  Connection* connection = new Connection;
+  connection->socket = socket;
+  connection->reader = new BufferedSocketReader(socket);
+  return connection;
+}
+
+void Client::Release(const std::string& key, Connection* connection) {
+  std::deque<Connection*>& idle = pool_[key];
+  if (idle.size() >= max_idle_per_host_) {
+    Close(connection);
+    return;
+  }
+  idle.push_back(connection);
+}
+
+// static
+void Client::Close(Connection* connection) {
+  delete connection->reader;
+  delete connection->socket;
+  delete connection;
 }
 
 }  // namespace http
@@ -0,0 +1,305 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/http_parser.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "log.h"
+
+namespace mlab {
+namespace http {
+namespace {
+
+std::string ToLower(const std::string& s) {
+  std::string lower(s);
+  for (size_t i = 0; i < lower.length(); ++i)
+    lower[i] = tolower(lower[i]);
+  return lower;
+}
+
+std::string Trim(const std::string& s) {
+  const size_t begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+    return std::string();
+  return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+// Whether the comma-separated header |value| contains |token|.
+bool HasToken(const std::string& value, const char* token) {
+  std::stringstream tokens(value);
+  std::string item;
+  while (std::getline(tokens, item, ',')) {
+    if (ToLower(Trim(item)) == token)
+      return true;
+  }
+  return false;
+}
+
+// Parse the unsigned number in |digits|, in |base|, which must be all of it
+// but for any ";" chunk extension.
+bool ParseNumber(const std::string& digits, int base, uint64_t* value) {
+  const std::string number = Trim(digits.substr(0, digits.find(';')));
+  if (number.empty() || number.length() > 16)
+    return false;
+  *value = 0;
+  for (size_t i = 0; i < number.length(); ++i) {
+    const char c = tolower(number[i]);
+    int digit;
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' && c < 'a' + base - 10)
+      digit = c - 'a' + 10;
+    else
+      return false;
+    *value = *value * base + digit;
+  }
+  return true;
+}
+}  // namespace
+
+const size_t ResponseParser::kMaxLineLength = 8 * 1024;
+const size_t ResponseParser::kMaxBodyLength = 64 * 1024 * 1024;
+
+ResponseParser::ResponseParser()
+    : handler_(NULL),
+      response_(NULL),
+      state_(STATE_ERROR),
+      minor_version_(1),
+      keep_alive_(false),
+      remaining_(0) { }
+
+ResponseParser::ResponseParser(BodyHandler* handler)
+    : handler_(handler),
+      response_(NULL),
+      state_(STATE_ERROR),
+      minor_version_(1),
+      keep_alive_(false),
+      remaining_(0) {
+  ASSERT(handler != NULL);
+}
+
+void ResponseParser::Reset(Response* response) {
+  ASSERT(response != NULL);
+
+  response_ = response;
+  *response_ = Response();
+  state_ = STATE_STATUS_LINE;
+  minor_version_ = 1;
+  keep_alive_ = false;
+  remaining_ = 0;
+  line_.clear();
+}
+
+bool ResponseParser::Parse(const char* data, size_t length,
+                           size_t* consumed) {
+  ASSERT(response_ != NULL);
+  ASSERT(data != NULL || length == 0);
+  ASSERT(consumed != NULL);
+
+  size_t offset = 0;
+  while (offset < length && state_ != STATE_DONE && state_ != STATE_ERROR) {
+    const char* begin = data + offset;
+    const size_t available = length - offset;
+
+    if (IsLineState()) {
+      const char* newline =
+          static_cast<const char*>(memchr(begin, '\n', available));
+      const size_t line_length =
+          newline == NULL ? available : newline - begin;
+      if (line_.length() + line_length > kMaxLineLength) {
+        LOG(ERROR, "HTTP line longer than %zu bytes.", kMaxLineLength);
+        state_ = STATE_ERROR;
+        break;
+      }
+      line_.append(begin, line_length);
+      offset += line_length;
+      if (newline == NULL)
+        break;
+      ++offset;
+      if (!line_.empty() && line_[line_.length() - 1] == '\r')
+        line_.erase(line_.length() - 1);
+      if (!OnLine(line_))
+        state_ = STATE_ERROR;
+      line_.clear();
+      continue;
+    }
+
+    size_t body_length = available;
+    if (state_ != STATE_BODY_TO_CLOSE) {
+      body_length = std::min<uint64_t>(available, remaining_);
+    } else if (!BodyFits(body_length)) {
+      state_ = STATE_ERROR;
+      break;
+    }
+    OnBody(begin, body_length);
+    offset += body_length;
+    if (state_ == STATE_BODY_TO_CLOSE)
+      continue;
+    remaining_ -= body_length;
+    if (remaining_ == 0)
+      state_ = state_ == STATE_BODY ? STATE_DONE : STATE_CHUNK_END;
+  }
+
+  *consumed = offset;
+  return state_ != STATE_ERROR;
+}
+
+bool ResponseParser::Finish() {
+  if (state_ == STATE_BODY_TO_CLOSE)
+    state_ = STATE_DONE;
+  if (state_ != STATE_DONE) {
+    LOG(ERROR, "HTTP response ended early.");
+    return false;
+  }
+  return true;
+}
+
+bool ResponseParser::IsLineState() const {
+  return state_ == STATE_STATUS_LINE || state_ == STATE_HEADER ||
+         state_ == STATE_CHUNK_SIZE || state_ == STATE_CHUNK_END ||
+         state_ == STATE_TRAILER;
+}
+
+bool ResponseParser::OnLine(const std::string& line) {
+  switch (state_) {
+    case STATE_STATUS_LINE:
+      return OnStatusLine(line);
+
+    case STATE_HEADER:
+      return line.empty() ? OnHeadersEnd() : OnHeader(line);
+
+    case STATE_CHUNK_SIZE:
+      return OnChunkSize(line);
+
+    case STATE_CHUNK_END:
+      if (!line.empty()) {
+        LOG(ERROR, "Expected the end of a chunk, found '%s'.", line.c_str());
+        return false;
+      }
+      state_ = STATE_CHUNK_SIZE;
+      return true;
+
+    case STATE_TRAILER:
+      // Trailers are skipped.
+      if (line.empty())
+        state_ = STATE_DONE;
+      return true;
+
+    default:
+      ASSERT(false);
+      return false;
+  }
+}
+
+bool ResponseParser::OnStatusLine(const std::string& line) {
+  int consumed = 0;
+  if (sscanf(line.c_str(), "HTTP/1.%d %3d%n", &minor_version_,
+             &response_->status_code, &consumed) < 2 ||
+      (line[consumed] != ' ' && line[consumed] != '\0')) {
+    LOG(ERROR, "Bad HTTP status line '%s'.", line.c_str());
+    return false;
+  }
+  response_->reason = Trim(line.substr(consumed));
+  state_ = STATE_HEADER;
+  return true;
+}
+
+bool ResponseParser::OnHeader(const std::string& line) {
+  const size_t separator = line.find(':');
+  if (separator == std::string::npos) {
+    LOG(ERROR, "Bad HTTP header '%s'.", line.c_str());
+    return false;
+  }
+  std::string& value =
+      response_->headers[ToLower(Trim(line.substr(0, separator)))];
+  if (!value.empty())
+    value += ", ";
+  value += Trim(line.substr(separator + 1));
+  return true;
+}
+
+bool ResponseParser::OnHeadersEnd() {
+  std::map<std::string, std::string>& headers = response_->headers;
+
+  // Skip interim responses, such as 100 Continue.
+  if (response_->status_code / 100 == 1) {
+    headers.clear();
+    state_ = STATE_STATUS_LINE;
+    return true;
+  }
+
+  const std::string& connection = headers["connection"];
+  keep_alive_ = minor_version_ >= 1 ? !HasToken(connection, "close")
+                                    : HasToken(connection, "keep-alive");
+
+  if (response_->status_code == 204 || response_->status_code == 304) {
+    state_ = STATE_DONE;
+  } else if (HasToken(headers["transfer-encoding"], "chunked")) {
+    state_ = STATE_CHUNK_SIZE;
+  } else if (headers.count("content-length") != 0) {
+    if (!ParseNumber(headers["content-length"], 10, &remaining_)) {
+      LOG(ERROR, "Bad Content-Length '%s'.",
+          headers["content-length"].c_str());
+      return false;
+    }
+    if (!BodyFits(remaining_))
+      return false;
+    if (handler_ == NULL)
+      response_->body.reserve(remaining_);
+    state_ = remaining_ == 0 ? STATE_DONE : STATE_BODY;
+  } else {
+    // The body runs until the server closes the connection.
+    keep_alive_ = false;
+    state_ = STATE_BODY_TO_CLOSE;
+  }
+  return true;
+}
+
+bool ResponseParser::OnChunkSize(const std::string& line) {
+  if (!ParseNumber(line, 16, &remaining_)) {
+    LOG(ERROR, "Bad chunk size '%s'.", line.c_str());
+    return false;
+  }
+  if (!BodyFits(remaining_))
+    return false;
+  state_ = remaining_ == 0 ? STATE_TRAILER : STATE_CHUNK_DATA;
+  return true;
+}
+
+bool ResponseParser::BodyFits(uint64_t length) const {
+  if (handler_ != NULL ||
+      length <= kMaxBodyLength - response_->body.length()) {
+    return true;
+  }
+  LOG(ERROR, "HTTP body longer than %zu bytes.", kMaxBodyLength);
+  return false;
+}
+
+void ResponseParser::OnBody(const char* data, size_t length) {
+  if (length == 0)
+    return;
+  if (handler_ != NULL)
+    handler_->OnBody(data, length);
+  else
+    response_->body.append(data, length);
+}
+
+}  // namespace http
+}  // namespace mlab
@@ -0,0 +1,116 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/latency_histogram.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "log.h"
+
+namespace mlab {
+namespace {
+// log2(kSubBuckets).
+const size_t kSubBucketBits = 4;
+}  // namespace
+
+const size_t LatencyHistogram::kSubBuckets;
+const size_t LatencyHistogram::kMaxExponent;
+const size_t LatencyHistogram::kNumBuckets;
+
+LatencyHistogram::LatencyHistogram() {
+  Clear();
+}
+
+void LatencyHistogram::Add(uint64_t value_us) {
+  ++counts_[BucketFor(value_us)];
+  ++count_;
+  sum_us_ += value_us;
+  min_us_ = std::min(min_us_, value_us);
+  max_us_ = std::max(max_us_, value_us);
+}
+
+void LatencyHistogram::Clear() {
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  sum_us_ = 0;
+  min_us_ = static_cast<uint64_t>(-1);
+  max_us_ = 0;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kNumBuckets; ++i)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  sum_us_ += other.sum_us_;
+  min_us_ = std::min(min_us_, other.min_us_);
+  max_us_ = std::max(max_us_, other.max_us_);
+}
+
+uint64_t LatencyHistogram::MeanUs() const {
+  return count_ == 0 ? 0 : sum_us_ / count_;
+}
+
+uint64_t LatencyHistogram::PercentileUs(double percentile) const {
+  ASSERT(percentile >= 0.0 && percentile <= 100.0);
+  if (count_ == 0)
+    return 0;
+
+  // The rank of the sample wanted, counting from one.
+  uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * count_ + 0.5);
+  // The first and last samples are known exactly.
+  if (rank <= 1)
+    return min_us_;
+  if (rank >= count_)
+    return max_us_;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += counts_[i];
+    if (seen < rank)
+      continue;
+    if (i == kNumBuckets - 1)
+      return max_us_;
+    // The middle of the bucket, kept within the values actually seen.
+    const uint64_t lower = BucketLowerUs(i);
+    const uint64_t middle = lower + (BucketLowerUs(i + 1) - lower - 1) / 2;
+    return std::min(std::max(middle, min_us_), max_us_);
+  }
+  return max_us_;
+}
+
+// static
+size_t LatencyHistogram::BucketFor(uint64_t value_us) {
+  if (value_us < kSubBuckets)
+    return value_us;
+
+  // The power of two at or below |value_us|.
+  size_t exponent = kSubBucketBits;
+  while (exponent < kMaxExponent && (value_us >> (exponent + 1)) != 0)
+    ++exponent;
+  if (exponent == kMaxExponent)
+    return kNumBuckets - 1;
+  return kSubBuckets * (exponent - kSubBucketBits + 1) +
+         ((value_us >> (exponent - kSubBucketBits)) - kSubBuckets);
+}
+
+// static
+uint64_t LatencyHistogram::BucketLowerUs(size_t bucket) {
+  if (bucket < kSubBuckets)
+    return bucket;
+  const size_t exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+  return (kSubBuckets + bucket % kSubBuckets) << (exponent - kSubBucketBits);
+}
+
+}  // namespace mlab
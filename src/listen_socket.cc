@@ -35,13 +35,14 @@ typedef SSIZE_T ssize_t;
 
 #include <string.h>
 
+#include "clock.h"
 #include "log.h"
 #include "mlab/accepted_socket.h"
 
 namespace mlab {
-namespace {
-const timeval kDefaultTimeout = {5, 0};
-}  // namespace
+
+const int ListenSocket::kDefaultBacklog = SOMAXCONN;
+const uint32_t ListenSocket::kDefaultTimeoutMs = 5000;
 
 // static
 ListenSocket* ListenSocket::Create(uint16_t port) {
@@ -61,14 +62,57 @@ ListenSocket* ListenSocket::Create(uint16_t port, SocketType type) {
 // static
 ListenSocket* ListenSocket::Create(uint16_t port, SocketType type,
                                    SocketFamily family) {
-  ListenSocket* socket = new ListenSocket(port, type, family);
-  if (socket->fd_ != -1)
+  return Create(port, type, family, kDefaultBacklog);
+}
+
+// static
+ListenSocket* ListenSocket::Create(uint16_t port, SocketType type,
+                                   SocketFamily family, int backlog) {
+  return Create(port, type, family, backlog, SocketOptions());
+}
+
+// static
+ListenSocket* ListenSocket::Create(uint16_t port, SocketType type,
+                                   SocketFamily family, int backlog,
+                                   const SocketOptions& options) {
+  ListenSocket* socket = new ListenSocket(type, family, options);
+  if (socket->Start(port, backlog, false))
     return socket;
 
   delete socket;
   return NULL;
 }
 
+// static
+bool ListenSocket::CreateGroup(uint16_t port, SocketType type,
+                               SocketFamily family, int backlog, size_t count,
+                               std::vector<ListenSocket*>* group) {
+  ASSERT(group != NULL);
+  ASSERT(group->empty());
+
+#if defined(SO_REUSEPORT)
+  for (size_t i = 0; i < count; ++i) {
+    ListenSocket* socket = new ListenSocket(type, family, SocketOptions());
+    if (!socket->Start(port, backlog, true) || !socket->SetNonBlocking(true)) {
+      delete socket;
+      break;
+    }
+    group->push_back(socket);
+  }
+  if (group->size() == count)
+    return true;
+
+  LOG(ERROR, "Failed to create listen group of %zu on port %d.", count, port);
+  for (size_t i = 0; i < group->size(); ++i)
+    delete (*group)[i];
+  group->clear();
+  return false;
+#else
+  LOG(ERROR, "SO_REUSEPORT is not supported on this platform.");
+  return false;
+#endif
+}
+
 // static
 ListenSocket* ListenSocket::CreateOrDie(uint16_t port) {
   return CreateOrDie(port, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4);
@@ -87,7 +131,20 @@ ListenSocket* ListenSocket::CreateOrDie(uint16_t port, SocketType type) {
 // static
 ListenSocket* ListenSocket::CreateOrDie(uint16_t port, SocketType type,
                                         SocketFamily family) {
-  ListenSocket* socket = Create(port, type, family);
+  return CreateOrDie(port, type, family, kDefaultBacklog);
+}
+
+// static
+ListenSocket* ListenSocket::CreateOrDie(uint16_t port, SocketType type,
+                                        SocketFamily family, int backlog) {
+  return CreateOrDie(port, type, family, backlog, SocketOptions());
+}
+
+// static
+ListenSocket* ListenSocket::CreateOrDie(uint16_t port, SocketType type,
+                                        SocketFamily family, int backlog,
+                                        const SocketOptions& options) {
+  ListenSocket* socket = Create(port, type, family, backlog, options);
   if (!socket)
     LOG(FATAL, "Failed to create server socket on port %d", port);
   return socket;
@@ -95,57 +152,82 @@ ListenSocket* ListenSocket::CreateOrDie(uint16_t port, SocketType type,
 
 ListenSocket::~ListenSocket() { }
 
-void ListenSocket::Select() {
-  SelectWithTimeout((uint32_t) -1);
+SocketStatus ListenSocket::Select() {
+  return SelectUntil(kNoDeadline);
+}
+
+SocketStatus ListenSocket::SelectWithTimeout(uint32_t timeout) {
+  if (timeout == (uint32_t) -1)
+    return SelectUntil(kNoDeadline);
+  // |timeout| is in seconds; past 49 days that is too many milliseconds for
+  // DeadlineAfterMs.
+  const uint64_t timeout_us = static_cast<uint64_t>(timeout) * 1000000;
+  return SelectUntil(MonotonicNowUs() + timeout_us);
 }
 
-void ListenSocket::SelectWithTimeout(uint32_t timeout) {
+SocketStatus ListenSocket::SelectUntil(uint64_t deadline_us) {
   ASSERT(fd_ != -1);
 
   if (type() != SOCKETTYPE_TCP)
-    return;
-
-  fd_set active_fds;
-  FD_ZERO(&active_fds);
-  FD_SET(fd_, &active_fds);
+    return SOCKETSTATUS_OK;
 
-  timeval timeout_val = { timeout, 0 };
-  timeval* timeout_ptr = (timeout == (uint32_t) -1 ? NULL : &timeout_val);
-
-  fd_set read_fds = active_fds;
   LOG(VERBOSE, "Selecting fd %d", fd_);
-  int connected = select(FD_SETSIZE, &read_fds, NULL, NULL, timeout_ptr);
-  if (connected == -1) {
-    LOG(FATAL, "Error when attempting to select connection: %s [%d]",
-        strerror(errno), errno);
-  } else if (connected == 0) {
-    LOG(FATAL, "Timeout when attempting to select connection: %s [%d]",
-        strerror(errno), errno);
-  } else {
-    ASSERT(connected == 1);
+  const SocketStatus status = WaitUntil(false, deadline_us);
+  if (status == SOCKETSTATUS_OK) {
     LOG(INFO, "Selected connection.");
+  } else if (status == SOCKETSTATUS_TIMEOUT) {
+    LOG(WARNING, "Timed out waiting for a connection.");
   }
+  return status;
 }
 
 AcceptedSocket* ListenSocket::Accept() const {
   ASSERT(fd_ != -1);
 
   if (type() != SOCKETTYPE_TCP) {
-    return new AcceptedSocket(fd_, type(), family_);
+    AcceptedSocket* accepted = new AcceptedSocket(fd_, type(), family_);
+    accepted->honored_options_ = honored_options_;
+    accepted->send_timeout_ms_ = send_timeout_ms_;
+    accepted->recv_timeout_ms_ = recv_timeout_ms_;
+    return accepted;
   }
 
   sockaddr_storage sock_storage;
   sockaddr* saddr = reinterpret_cast<sockaddr*>(&sock_storage);
   socklen_t saddrlen = sizeof(sock_storage);
+  const bool non_blocking = IsNonBlocking();
   int client_fd;
+#if defined(OS_LINUX)
+  // Set the accepted socket's flags in the same syscall.
+  const int flags = SOCK_CLOEXEC | (non_blocking ? SOCK_NONBLOCK : 0);
+  while ((client_fd = accept4(fd_, saddr, &saddrlen, flags)) == -1 &&
+         errno == EINTR) { }
+#else
   while ((client_fd = accept(fd_, saddr, &saddrlen)) == -1 && errno == EINTR) { }
+#endif
   if (client_fd == -1) {
-    LOG(ERROR, "Failed to accept connection: %s [%d]",
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to accept connection: %s [%d]",
         strerror(errno), errno);
     return NULL;
   }
   LOG(INFO, "Accepted connection.");
-  return new AcceptedSocket(client_fd, type(), family_);
+  AcceptedSocket* accepted = new AcceptedSocket(client_fd, type(), family_);
+  // Accepted connections inherit the listener's timeouts.
+  accepted->send_timeout_ms_ = send_timeout_ms_;
+  accepted->recv_timeout_ms_ = recv_timeout_ms_;
+#if defined(OS_LINUX)
+  // Linux copies the listener's options to the connections it accepts.
+  accepted->honored_options_ = honored_options_;
+#else
+  // Accepted sockets don't inherit O_NONBLOCK on every platform.
+  if (non_blocking && !accepted->SetNonBlocking(true)) {
+    delete accepted;
+    return NULL;
+  }
+  if (options_.options() != 0)
+    accepted->ApplyOptions(options_);
+#endif
+  return accepted;
 }
 
 AcceptedSocket* ListenSocket::AcceptOrDie() const {
@@ -154,23 +236,35 @@ AcceptedSocket* ListenSocket::AcceptOrDie() const {
   return accepted;
 }
 
-bool ListenSocket::Send(const Packet&, ssize_t*) const {
+bool ListenSocket::SendFrom(const void*, size_t, ssize_t*) const {
   LOG(FATAL, "It's an error to send on a ListenSocket.");
   return false;
 }
 
-Packet ListenSocket::Receive(size_t, ssize_t*) const {
+bool ListenSocket::ReceiveInto(void*, size_t, ssize_t*) const {
   LOG(FATAL, "It's an error to receive on a ListenSocket.");
-  return Packet(std::string());
+  return false;
 }
 
-ListenSocket::ListenSocket(uint16_t port, SocketType type, SocketFamily family)
-    : Socket(type, family) {
-  Start(port);
+bool ListenSocket::SendV(const iovec*, size_t, ssize_t*) const {
+  LOG(FATAL, "It's an error to send on a ListenSocket.");
+  return false;
 }
 
-void ListenSocket::Start(uint16_t port) {
+bool ListenSocket::ReceiveV(const iovec*, size_t, ssize_t*) const {
+  LOG(FATAL, "It's an error to receive on a ListenSocket.");
+  return false;
+}
+
+ListenSocket::ListenSocket(SocketType type, SocketFamily family,
+                           const SocketOptions& options)
+    : Socket(type, family),
+      options_(options) { }
+
+bool ListenSocket::Start(uint16_t port, int backlog, bool reuse_port) {
   CreateSocket();
+  if (fd_ == -1)
+    return false;
 
   sockaddr_storage saddr;
   memset(&saddr, 0, sizeof(sockaddr_storage));
@@ -202,16 +296,9 @@ void ListenSocket::Start(uint16_t port) {
       ASSERT(false);
   }
 
-  // setsockopt on posix takes a const void* and on Windows takes a
-  // const char*. Cast to the lesser of two evils.
-  // Don't block forever.
-  // TODO(dominich): Allow custom timeout.
-  ASSERT(setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO,
-                    (const char*) &kDefaultTimeout,
-                    sizeof(kDefaultTimeout)) != -1);
-  ASSERT(setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO,
-                    (const char*) &kDefaultTimeout,
-                    sizeof(kDefaultTimeout)) != -1);
+  // Don't block forever, unless the options say otherwise.
+  ASSERT(SetRecvTimeout(kDefaultTimeoutMs));
+  ASSERT(SetSendTimeout(kDefaultTimeoutMs));
 
   // Make sure address is reusable.
   int on = 1;
@@ -219,26 +306,39 @@ void ListenSocket::Start(uint16_t port) {
                  (const char*) &on, sizeof(on)) == -1) {
     LOG(ERROR, "Failed to set socket to reusable.");
     DestroySocket();
+    return false;
+  }
+
+#if defined(SO_REUSEPORT)
+  // Let the sockets of a group share the port.
+  if (reuse_port && setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT,
+                               (const char*) &on, sizeof(on)) == -1) {
+    LOG(ERROR, "Failed to set socket port to reusable: %s [%d]",
+        strerror(errno), errno);
+    DestroySocket();
+    return false;
   }
+#endif
+
+  if (options_.options() != 0)
+    ApplyOptions(options_);
 
   if (bind(fd_, reinterpret_cast<sockaddr*>(&saddr), saddr_len) == -1) {
     LOG(ERROR, "Failed to bind on port %d: %s [%d]", port,
         strerror(errno), errno);
     DestroySocket();
-  } else {
-    LOG(VERBOSE, "Bound to %s %d", addr_str, port);
+    return false;
   }
+  LOG(VERBOSE, "Bound to %s %d", addr_str, port);
 
   if (type() == SOCKETTYPE_TCP) {
-    if (listen(fd_, 1) == -1) {
+    if (listen(fd_, backlog) == -1) {
       LOG(ERROR, "Failed to listen: %s [%d]", strerror(errno), errno);
       DestroySocket();
-    } else {
-      LOG(VERBOSE, "Listening on %d", port);
+      return false;
     }
+    LOG(VERBOSE, "Listening on %d with backlog %d", port, backlog);
   }
-
-  if (fd_ == -1)
-    LOG(FATAL, "Failed to find address to bind to and listen on.");
+  return true;
 }
 }  // namespace mlab
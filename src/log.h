@@ -17,6 +17,7 @@
 
 #include "mlab/mlab.h"
 
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,6 +31,11 @@ const char* GetSeverityTag(LogSeverity s);
 
 #define ASSERT(predicate) if (!(predicate)) raise(SIGABRT)
 
+// The severity to log a failed socket call with. A non-blocking socket that
+// would have blocked is routine rather than an error.
+#define SOCKET_ERROR_SEVERITY \
+    ((errno == EAGAIN || errno == EWOULDBLOCK) ? mlab::VERBOSE : mlab::ERROR)
+
 #define LOG(severity, format, ...) { \
     if (FILE* fd = mlab::GetSeverityFD(severity)) { \
       fprintf(fd, "[%s] %s|%d: ", mlab::GetSeverityTag(severity), \
@@ -236,9 +236,8 @@ int mlab_send(int socket, const char* bytes, unsigned count) {
   for (std::vector<Socket*>::iterator it = sockets.begin(); it != sockets.end();
        ++it) {
     if ((*it)->raw() == socket) {
-      mlab::Packet p(bytes, count);
       ssize_t num_bytes;
-      (*it)->Send(p, &num_bytes);
+      (*it)->SendFrom(bytes, count, &num_bytes);
       return num_bytes;
     }
   }
@@ -258,10 +257,7 @@ int mlab_recv(int socket, char* bytes, unsigned count) {
        ++it) {
     if ((*it)->raw() == socket) {
       ssize_t num_bytes;
-      mlab::Packet recv = (*it)->Receive(count, &num_bytes);
-      if (num_bytes > 0)
-        strncpy(bytes, recv.buffer(), recv.length());
-
+      (*it)->ReceiveInto(bytes, count, &num_bytes);
       return num_bytes;
     }
   }
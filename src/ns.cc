@@ -14,7 +14,9 @@
 
 #include "mlab/ns.h"
 
-#include <sstream>
+#include <pthread.h>
+
+#include <map>
 #include <string>
 
 #include "json/reader.h"
@@ -27,58 +29,42 @@ namespace ns {
 namespace {
 
 const char kHostname[] = "mlab-ns.appspot.com";
-const char kStatusOK[] = "HTTP/1.1 200 OK";
+const uint16_t kPort = 80;
+
+// Guards the client shared by all queries.
+pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // TODO(dominich): Right now mlab-ns returning !OK is a FATAL. Perhaps there's a
 // better way to pass this info back to the caller.
-std::string ParseResponse(const std::string& response) {
-  std::istringstream stream(response);
-
-  // Check the status.
-  std::string status;
-  std::getline(stream, status);
-
-  status = status.substr(0, status.length() - 1);
-  if (status != kStatusOK)
-    LOG(FATAL, "Received status '%s' from mlab-ns.", status.c_str());
-
-  // Extract HTTP headers
-  std::map<std::string, std::string> headers;
-  std::string header;
-  std::getline(stream, header);
-  while (header != "\r") {
-    const size_t separator = header.find(": ");
-    std::string key = header.substr(0, separator);
-    const size_t value_start =  separator + 2;
-    const size_t value_end = header.length() - 1;
-    std::string value = header.substr(value_start, value_end - value_start);
-    headers[key] = value;
-    std::getline(stream, header);
+std::string ParseResponse(const http::Response& response) {
+  if (response.status_code != 200) {
+    LOG(FATAL, "Received status '%d %s' from mlab-ns.", response.status_code,
+        response.reason.c_str());
   }
 
-  // Ensure headers are as expected.
-  if (headers["Content-Type"] != "application/json") {
+  // Ensure headers are as expected. The media type may carry parameters,
+  // such as a charset.
+  std::map<std::string, std::string>::const_iterator header =
+      response.headers.find("content-type");
+  const std::string content_type =
+      header == response.headers.end() ? std::string() : header->second;
+  if (content_type.substr(0, content_type.find(';')) != "application/json") {
     LOG(FATAL, "Expected Content-Type to be application/json but it is '%s'",
-        headers["Content-Type"].c_str());
+        content_type.c_str());
   }
-  if (!headers["X-Google-AppEngine-AppId"].empty() &&
-      headers["X-Google-AppEngine-AppId"] != "s~mlab-ns") {
-    LOG(FATAL, "Unexpected AppEngine AppId: '%s'",
-        headers["X-Google-AppEngine-AppId"].c_str());
+  header = response.headers.find("x-google-appengine-appid");
+  if (header != response.headers.end() && !header->second.empty() &&
+      header->second != "s~mlab-ns") {
+    LOG(FATAL, "Unexpected AppEngine AppId: '%s'", header->second.c_str());
   }
 
-  size_t json_length;
-  stream >> std::hex >> json_length;
-  std::string json = std::string(std::istreambuf_iterator<char>(stream),
-                                 std::istreambuf_iterator<char>());
-
-  LOG(VERBOSE, "JSON: %s", json.c_str());
+  LOG(VERBOSE, "JSON: %s", response.body.c_str());
 
   Json::Value root;
   Json::Reader reader;
 
-  if (!reader.parse(json, root))
-    LOG(FATAL, "Failed to parse json: %s", json.c_str());
+  if (!reader.parse(response.body, root))
+    LOG(FATAL, "Failed to parse json: %s", response.body.c_str());
 
   // Take the FQDN and do the DNS lookup on the client side.
   return root.get("fqdn", "").asString();
@@ -102,7 +88,16 @@ Host GetHostForToolAndMetroAndFamilyWithPolicy(const std::string& tool,
       (!metro.empty() ? "&metro=" + metro : "") +
       (!policy.empty() ? "&policy=" + policy : "") +
       (!address_family.empty() ? "&address_family=" + address_family : "");
-  return Host(ParseResponse(http::Get(kHostname, href, 2048U)));
+  http::Response response;
+  pthread_mutex_lock(&client_lock);
+  // Kept for the life of the process, so later queries reuse its connection
+  // to mlab-ns.
+  static http::Client client;
+  const bool ok = client.Get(kHostname, kPort, href, &response);
+  pthread_mutex_unlock(&client_lock);
+  if (!ok)
+    LOG(FATAL, "Failed to query mlab-ns for '%s'.", href.c_str());
+  return Host(ParseResponse(response));
 }
 
 }  // namespace
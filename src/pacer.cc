@@ -0,0 +1,132 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/pacer.h"
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "clock.h"
+#include "log.h"
+
+namespace mlab {
+namespace {
+// The smallest default burst: one full-size Ethernet frame.
+const uint64_t kMinBurstBytes = 1514;
+
+// Sleep until |deadline_us| on the monotonic clock.
+void SleepUntilUs(uint64_t deadline_us) {
+#if defined(OS_LINUX)
+  timespec deadline;
+  deadline.tv_sec = deadline_us / 1000000;
+  deadline.tv_nsec = (deadline_us % 1000000) * 1000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                         NULL) == EINTR) { }
+#else
+  const uint64_t now_us = MonotonicNowUs();
+  if (deadline_us > now_us)
+    usleep(deadline_us - now_us);
+#endif
+}
+}  // namespace
+
+Pacer::Pacer(uint64_t bytes_per_second)
+    : bytes_per_second_(bytes_per_second),
+      burst_bytes_(std::max(bytes_per_second / 1000, kMinBurstBytes)),
+      tokens_(burst_bytes_),
+      remainder_(0),
+      last_refill_us_(MonotonicNowUs()),
+      total_bytes_(0),
+      interval_bytes_(0),
+      interval_start_us_(last_refill_us_) {
+  ASSERT(bytes_per_second > 0);
+}
+
+Pacer::Pacer(uint64_t bytes_per_second, uint64_t burst_bytes)
+    : bytes_per_second_(bytes_per_second),
+      burst_bytes_(burst_bytes),
+      tokens_(burst_bytes_),
+      remainder_(0),
+      last_refill_us_(MonotonicNowUs()),
+      total_bytes_(0),
+      interval_bytes_(0),
+      interval_start_us_(last_refill_us_) {
+  ASSERT(bytes_per_second > 0);
+  ASSERT(burst_bytes > 0);
+}
+
+void Pacer::Wait() {
+  const uint64_t delay_us = DelayUs();
+  if (delay_us > 0) {
+    SleepUntilUs(last_refill_us_ + delay_us);
+    Refill(MonotonicNowUs());
+  }
+}
+
+uint64_t Pacer::DelayUs() {
+  Refill(MonotonicNowUs());
+  if (tokens_ >= 0)
+    return 0;
+  // Round up so the debt is repaid when the delay ends.
+  const uint64_t debt = static_cast<uint64_t>(-tokens_) * 1000000 - remainder_;
+  return (debt + bytes_per_second_ - 1) / bytes_per_second_;
+}
+
+uint64_t Pacer::AvailableBytes() {
+  Refill(MonotonicNowUs());
+  return tokens_ > 0 ? tokens_ : 0;
+}
+
+void Pacer::Sent(size_t num_bytes) {
+  tokens_ -= num_bytes;
+  total_bytes_ += num_bytes;
+  interval_bytes_ += num_bytes;
+}
+
+void Pacer::ReadInterval(uint64_t* bytes, uint64_t* elapsed_us) {
+  ASSERT(bytes != NULL);
+  ASSERT(elapsed_us != NULL);
+
+  const uint64_t now_us = MonotonicNowUs();
+  *bytes = interval_bytes_;
+  *elapsed_us = now_us - interval_start_us_;
+  interval_bytes_ = 0;
+  interval_start_us_ = now_us;
+}
+
+void Pacer::Refill(uint64_t now_us) {
+  if (now_us <= last_refill_us_)
+    return;
+
+  // Only whole bytes are added; the part of a byte left over carries to the
+  // next refill. Whole seconds are split off so long idle periods can't
+  // overflow.
+  const uint64_t elapsed_us = now_us - last_refill_us_;
+  const uint64_t fraction =
+      elapsed_us % 1000000 * bytes_per_second_ + remainder_;
+  const uint64_t earned =
+      elapsed_us / 1000000 * bytes_per_second_ + fraction / 1000000;
+  last_refill_us_ = now_us;
+  remainder_ = fraction % 1000000;
+  tokens_ += earned;
+  if (tokens_ >= burst_bytes_) {
+    tokens_ = burst_bytes_;
+    remainder_ = 0;
+  }
+}
+
+}  // namespace mlab
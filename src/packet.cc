@@ -14,19 +14,159 @@
 
 #include "mlab/packet.h"
 
+#if defined(OS_WINDOWS)
+#include <windows.h>
+#endif
+
+#include "log.h"
+
 namespace mlab {
+namespace {
+
+// Atomic so that packets may be shared between threads, for example a single
+// payload sent by several sockets.
+long IncrementRefCount(volatile long* count) {
+#if defined(OS_WINDOWS)
+  return InterlockedIncrement(count);
+#else
+  return __sync_add_and_fetch(count, 1);
+#endif
+}
+
+long DecrementRefCount(volatile long* count) {
+#if defined(OS_WINDOWS)
+  return InterlockedDecrement(count);
+#else
+  return __sync_sub_and_fetch(count, 1);
+#endif
+}
+
+}  // namespace
+
+// The header of a single heap block; the packet bytes follow it directly so a
+// packet costs one allocation regardless of its size.
+struct Packet::Storage {
+  volatile long ref_count;
+  size_t capacity;
+
+  uint8_t* bytes() { return reinterpret_cast<uint8_t*>(this + 1); }
+
+  static Storage* New(size_t capacity) {
+    Storage* storage =
+        static_cast<Storage*>(malloc(sizeof(Storage) + capacity));
+    ASSERT(storage != NULL);
+    storage->ref_count = 1;
+    storage->capacity = capacity;
+    return storage;
+  }
+};
+
+Packet::Packet()
+    : storage_(NULL),
+      begin_(NULL),
+      length_(0) {
+}
 
 Packet::Packet(const std::vector<uint8_t>& data)
-    : data_(data) {
+    : storage_(NULL) {
+  Init(data.empty() ? NULL : reinterpret_cast<const char*>(&data[0]),
+       data.size());
 }
 
 Packet::Packet(const std::string& data)
-    : data_(data.begin(), data.end()) {
+    : storage_(NULL) {
+  Init(data.data(), data.size());
 }
 
 Packet::Packet(const char* buffer, size_t length)
-    : data_(buffer, buffer + length) {
+    : storage_(NULL) {
+  Init(buffer, length);
 }
 
-}  // namespace mlab
+Packet::Packet(const Packet& other)
+    : storage_(other.storage_),
+      begin_(other.begin_),
+      length_(other.length_) {
+  if (storage_ != NULL)
+    IncrementRefCount(&storage_->ref_count);
+}
+
+Packet& Packet::operator=(const Packet& other) {
+  if (other.storage_ != NULL)
+    IncrementRefCount(&other.storage_->ref_count);
+  Release();
+  storage_ = other.storage_;
+  begin_ = other.begin_;
+  length_ = other.length_;
+  return *this;
+}
 
+Packet::~Packet() {
+  Release();
+}
+
+// static
+Packet Packet::Allocate(size_t length) {
+  Packet packet;
+  if (length > 0) {
+    packet.storage_ = Storage::New(length);
+    packet.begin_ = packet.storage_->bytes();
+    packet.length_ = length;
+  }
+  return packet;
+}
+
+// static
+Packet Packet::Unowned(const char* buffer, size_t length) {
+  Packet packet;
+  if (length > 0) {
+    packet.begin_ = reinterpret_cast<const uint8_t*>(buffer);
+    packet.length_ = length;
+  }
+  return packet;
+}
+
+Packet Packet::Slice(size_t offset, size_t length) const {
+  Packet slice(*this);
+  if (offset > length_)
+    offset = length_;
+  if (length > length_ - offset)
+    length = length_ - offset;
+  slice.begin_ = begin_ + offset;
+  slice.length_ = length;
+  return slice;
+}
+
+char* Packet::mutable_buffer() {
+  if (length_ == 0)
+    return NULL;
+
+  if (storage_ == NULL || storage_->ref_count != 1) {
+    Storage* copy = Storage::New(length_);
+    memcpy(copy->bytes(), begin_, length_);
+    Release();
+    storage_ = copy;
+    begin_ = copy->bytes();
+  }
+  return reinterpret_cast<char*>(const_cast<uint8_t*>(begin_));
+}
+
+void Packet::Init(const char* buffer, size_t length) {
+  ASSERT(storage_ == NULL);
+  begin_ = NULL;
+  length_ = length;
+  if (length == 0)
+    return;
+
+  storage_ = Storage::New(length);
+  memcpy(storage_->bytes(), buffer, length);
+  begin_ = storage_->bytes();
+}
+
+void Packet::Release() {
+  if (storage_ != NULL && DecrementRefCount(&storage_->ref_count) == 0)
+    free(storage_);
+  storage_ = NULL;
+}
+
+}  // namespace mlab
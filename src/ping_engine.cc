@@ -0,0 +1,453 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/ping_engine.h"
+
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#elif defined(OS_WINDOWS)
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <process.h>
+#else
+#error Undefined platform
+#endif
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "clock.h"
+#include "log.h"
+#include "mlab/protocol_header.h"
+#include "mlab/raw_socket.h"
+
+namespace mlab {
+namespace {
+const uint8_t kEchoRequest = 8;
+const uint8_t kEchoReply = 0;
+const uint8_t kEcho6Request = 128;
+const uint8_t kEcho6Reply = 129;
+
+// The end of a list, and an empty hash table slot.
+const uint32_t kNone = 0xffffffff;
+
+// The timer wheel's tick.
+const uint64_t kTickUs = 1000;
+
+// Replies received per call, and the most of each kept.
+const size_t kBatchSize = 64;
+const size_t kMaxReplyLength = 256;
+
+const char kPayload[] = "mlab ping";
+
+// The checksum of an echo request with a zero identifier and sequence
+// number, for each probe to patch in its own.
+uint16_t EchoCheckSum() {
+  char packet[sizeof(ICMP4Header) + sizeof(kPayload)];
+  ICMP4Header header(kEchoRequest, 0, 0, 0);
+  memcpy(packet, &header, sizeof(header));
+  memcpy(packet + sizeof(header), kPayload, sizeof(kPayload));
+  return InternetCheckSum(packet, sizeof(packet));
+}
+
+uint16_t ReadUInt16(const char* p) {
+  uint16_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohs(value);
+}
+
+size_t Hash(uint32_t key) {
+  // Fibonacci hashing, so consecutive sequence numbers spread out.
+  const uint32_t hash = key * 2654435761U;
+  return hash ^ (hash >> 16);
+}
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n)
+    power <<= 1;
+  return power;
+}
+}  // namespace
+
+// static
+PingEngine* PingEngine::Create(SocketFamily family, size_t max_outstanding,
+                               uint32_t timeout_ms) {
+  ASSERT(family == SOCKETFAMILY_IPV4 || family == SOCKETFAMILY_IPV6);
+  ASSERT(max_outstanding > 0 && max_outstanding < kNone);
+  ASSERT(timeout_ms > 0);
+
+  RawSocket* socket = RawSocket::Create(SOCKETTYPE_ICMP, family);
+  if (socket == NULL)
+    return NULL;
+  // Replies are drained without blocking, then waited for up to a deadline.
+  if (!socket->SetNonBlocking(true)) {
+    delete socket;
+    return NULL;
+  }
+  return new PingEngine(socket, family, max_outstanding, timeout_ms);
+}
+
+// static
+PingEngine* PingEngine::CreateOrDie(SocketFamily family,
+                                    size_t max_outstanding,
+                                    uint32_t timeout_ms) {
+  PingEngine* engine = Create(family, max_outstanding, timeout_ms);
+  if (engine == NULL)
+    LOG(FATAL, "Failed to create ping engine.");
+  return engine;
+}
+
+PingEngine::~PingEngine() {
+  delete socket_;
+}
+
+int PingEngine::AddDestination(const Host& destination) {
+  ASSERT(destinations_.size() < 0x10000);
+
+  std::string address;
+  for (IPAddresses::const_iterator it = destination.resolved_ips.begin();
+       it != destination.resolved_ips.end(); ++it) {
+    if (GetSocketFamilyForAddress(*it) == family_) {
+      address = *it;
+      break;
+    }
+  }
+  if (address.empty()) {
+    LOG(ERROR, "No %s address to ping for %s.",
+        family_ == SOCKETFAMILY_IPV4 ? "IPv4" : "IPv6",
+        destination.original_hostname.c_str());
+    return -1;
+  }
+
+  // Ping the one address, whatever else the host resolves to.
+  Destination entry((Host(address)));
+  inet_pton(family_ == SOCKETFAMILY_IPV4 ? AF_INET : AF_INET6,
+            address.c_str(), entry.address);
+  entry.id = first_id_ + destinations_.size();
+  destinations_.push_back(entry);
+  return destinations_.size() - 1;
+}
+
+bool PingEngine::Send(size_t destination) {
+  ASSERT(destination < destinations_.size());
+
+  if (free_probe_ == kNone) {
+    LOG(VERBOSE, "%zu probes outstanding; not sending.", outstanding_);
+    return false;
+  }
+
+  // Destinations are usually added all at once, so the filter is widened
+  // once for them rather than once each.
+  if (filtered_destinations_ != destinations_.size())
+    AttachReplyFilter();
+
+  Destination& entry = destinations_[destination];
+  const uint32_t key = static_cast<uint32_t>(entry.id) << 16 | entry.next_seq;
+
+  char packet[sizeof(ICMP4Header) + sizeof(kPayload)];
+  if (family_ == SOCKETFAMILY_IPV4) {
+    static const uint16_t echo_checksum = EchoCheckSum();
+    ICMP4Header header(kEchoRequest, 0,
+                       UpdateCheckSum32(echo_checksum, 0, htonl(key)),
+                       htonl(key));
+    memcpy(packet, &header, sizeof(header));
+    memcpy(packet + sizeof(header), kPayload, sizeof(kPayload));
+  } else {
+    // The kernel fills in the ICMPv6 checksum.
+    ICMP6Header header(kEcho6Request, 0, 0, htonl(key));
+    memcpy(packet, &header, sizeof(header));
+    memcpy(packet + sizeof(header), kPayload, sizeof(kPayload));
+  }
+  iovec iov;
+  iov.iov_base = packet;
+  iov.iov_len = sizeof(packet);
+
+  const uint64_t now_us = MonotonicNowUs();
+  // A probe's timeout has to fit in the wheel from the last tick expired.
+  if ((now_us + timeout_us_) / kTickUs + 1 - wheel_tick_ > wheel_mask_)
+    Expire(now_us);
+
+  ssize_t num_bytes;
+  if (!socket_->SendToV(entry.host, &iov, 1, &num_bytes))
+    return false;
+  ++entry.next_seq;
+  ++entry.stats.sent;
+
+  // The sequence number wrapped onto a probe still waiting; give up on it.
+  const size_t slot = FindSlot(key);
+  if (table_[slot] != kNone) {
+    const uint32_t stale = table_[slot];
+    Erase(slot);
+    Unschedule(stale);
+    Release(stale);
+    ++entry.stats.lost;
+  }
+
+  const uint32_t probe = free_probe_;
+  free_probe_ = probes_[probe].next;
+  ++outstanding_;
+  probes_[probe].key = key;
+  probes_[probe].destination = destination;
+  probes_[probe].sent_us = now_us;
+  Insert(key, probe);
+  Schedule(probe);
+  return true;
+}
+
+bool PingEngine::Poll(uint64_t deadline_us) {
+  return Receive(deadline_us, false);
+}
+
+bool PingEngine::Finish() {
+  return Receive(Socket::kNoDeadline, true);
+}
+
+bool PingEngine::Run(size_t rounds, uint32_t probes_per_second) {
+  ASSERT(probes_per_second > 0);
+
+  const size_t num_probes = rounds * destinations_.size();
+  const uint64_t start_us = MonotonicNowUs();
+  for (size_t i = 0; i < num_probes; ++i) {
+    // Each send's time comes from the start, so rounding doesn't add up.
+    const uint64_t send_us =
+        start_us + static_cast<uint64_t>(i) * 1000000 / probes_per_second;
+    if (!Poll(send_us))
+      return false;
+    while (free_probe_ == kNone) {
+      if (!Poll(MonotonicNowUs() + kTickUs))
+        return false;
+    }
+    if (!Send(i % destinations_.size()))
+      return false;
+  }
+  return Finish();
+}
+
+PingEngine::Destination::Destination(const Host& host)
+    : host(host),
+      id(0),
+      next_seq(0) {
+  memset(address, 0, sizeof(address));
+}
+
+PingEngine::PingEngine(RawSocket* socket, SocketFamily family,
+                       size_t max_outstanding, uint32_t timeout_ms)
+    : socket_(socket),
+      family_(family),
+      timeout_us_(static_cast<uint64_t>(timeout_ms) * 1000),
+      first_id_(getpid() * 31 + MonotonicNowUs()),
+      filtered_destinations_(0),
+      probes_(max_outstanding),
+      free_probe_(0),
+      outstanding_(0),
+      table_(RoundUpToPowerOfTwo(max_outstanding * 2), kNone),
+      table_mask_(table_.size() - 1),
+      wheel_(RoundUpToPowerOfTwo(timeout_us_ / kTickUs + 2), kNone),
+      wheel_mask_(wheel_.size() - 1),
+      wheel_tick_(MonotonicNowUs() / kTickUs),
+      batch_(kBatchSize),
+      buffers_(kBatchSize * kMaxReplyLength) {
+  for (size_t i = 0; i < probes_.size(); ++i)
+    probes_[i].next = i + 1 < probes_.size() ? i + 1 : kNone;
+  for (size_t i = 0; i < batch_.size(); ++i)
+    batch_[i] = Datagram(&buffers_[i * kMaxReplyLength], kMaxReplyLength);
+}
+
+void PingEngine::AttachReplyFilter() {
+  filtered_destinations_ = destinations_.size();
+  const uint16_t last_id = first_id_ + destinations_.size() - 1;
+  const FilterProgram filter = EchoReplyFilter(family_, first_id_, last_id);
+  if (!filter.empty() && !socket_->AttachFilter(filter)) {
+    LOG(WARNING, "Failed to filter echo replies; replies for other processes "
+        "will be read and dropped.");
+  }
+}
+
+size_t PingEngine::FindSlot(uint32_t key) const {
+  size_t slot = Hash(key) & table_mask_;
+  while (table_[slot] != kNone && probes_[table_[slot]].key != key)
+    slot = (slot + 1) & table_mask_;
+  return slot;
+}
+
+void PingEngine::Insert(uint32_t key, uint32_t probe) {
+  table_[FindSlot(key)] = probe;
+}
+
+void PingEngine::Erase(size_t slot) {
+  // Shift back the entries after |slot| that would no longer be found past
+  // the gap, rather than leaving a tombstone.
+  size_t hole = slot;
+  for (size_t i = (slot + 1) & table_mask_; table_[i] != kNone;
+       i = (i + 1) & table_mask_) {
+    const size_t home = Hash(probes_[table_[i]].key) & table_mask_;
+    if (((i - home) & table_mask_) >= ((i - hole) & table_mask_)) {
+      table_[hole] = table_[i];
+      hole = i;
+    }
+  }
+  table_[hole] = kNone;
+}
+
+void PingEngine::Schedule(uint32_t probe) {
+  Probe& entry = probes_[probe];
+  // The first tick wholly after the timeout, so no probe times out early.
+  const uint64_t due = (entry.sent_us + timeout_us_) / kTickUs + 1;
+  entry.slot = due & wheel_mask_;
+  entry.prev = kNone;
+  entry.next = wheel_[entry.slot];
+  if (entry.next != kNone)
+    probes_[entry.next].prev = probe;
+  wheel_[entry.slot] = probe;
+}
+
+void PingEngine::Unschedule(uint32_t probe) {
+  const Probe& entry = probes_[probe];
+  if (entry.prev != kNone)
+    probes_[entry.prev].next = entry.next;
+  else
+    wheel_[entry.slot] = entry.next;
+  if (entry.next != kNone)
+    probes_[entry.next].prev = entry.prev;
+}
+
+void PingEngine::Release(uint32_t probe) {
+  probes_[probe].next = free_probe_;
+  free_probe_ = probe;
+  --outstanding_;
+}
+
+void PingEngine::Expire(uint64_t now_us) {
+  const uint64_t now_tick = now_us / kTickUs;
+  if (now_tick <= wheel_tick_)
+    return;
+
+  // Every probe is due within one turn of the wheel, so after a long gap
+  // one turn times them all out.
+  uint64_t tick = wheel_tick_ + 1;
+  if (now_tick - wheel_tick_ > wheel_.size())
+    tick = now_tick - wheel_.size() + 1;
+  for (; tick <= now_tick; ++tick) {
+    uint32_t& head = wheel_[tick & wheel_mask_];
+    while (head != kNone) {
+      const uint32_t probe = head;
+      Erase(FindSlot(probes_[probe].key));
+      Unschedule(probe);
+      ++destinations_[probes_[probe].destination].stats.lost;
+      Release(probe);
+    }
+  }
+  wheel_tick_ = now_tick;
+}
+
+bool PingEngine::Receive(uint64_t deadline_us, bool until_idle) {
+  // Take whatever is already queued first, even if the deadline has passed.
+  bool drain = true;
+  while (true) {
+    size_t num_datagrams = 0;
+    if (drain) {
+      if (!socket_->ReceiveBatch(&batch_[0], batch_.size(), &num_datagrams)) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          return false;
+        num_datagrams = 0;
+      }
+    } else {
+      // Wake for the next tick while probes may time out.
+      uint64_t wait_us = deadline_us;
+      if (outstanding_ > 0)
+        wait_us = std::min(wait_us, (wheel_tick_ + 1) * kTickUs);
+      const SocketStatus status = socket_->ReceiveBatchUntil(
+          &batch_[0], batch_.size(), wait_us, &num_datagrams);
+      if (status == SOCKETSTATUS_ERROR)
+        return false;
+    }
+
+    const uint64_t now_us = MonotonicNowUs();
+    for (size_t i = 0; i < num_datagrams; ++i) {
+      HandleReply(static_cast<const char*>(batch_[i].buffer),
+                  batch_[i].num_bytes, batch_[i], now_us);
+    }
+    Expire(now_us);
+
+    // A full batch may have left more queued.
+    drain = num_datagrams == batch_.size();
+    if (until_idle && outstanding_ == 0)
+      return true;
+    if (!drain && now_us >= deadline_us)
+      return true;
+  }
+}
+
+void PingEngine::HandleReply(const char* packet, size_t length,
+                             const Datagram& from, uint64_t now_us) {
+  // IPv4 raw sockets receive the IP header; IPv6 ones start at the ICMPv6.
+  const char* icmp = packet;
+  uint8_t reply_type = kEcho6Reply;
+  if (family_ == SOCKETFAMILY_IPV4) {
+    if (length < sizeof(IP4Header))
+      return;
+    const size_t header_length = (packet[0] & 0x0f) * 4;
+    if (length < header_length)
+      return;
+    icmp += header_length;
+    length -= header_length;
+    reply_type = kEchoReply;
+  }
+  if (length < sizeof(ICMP4Header) ||
+      static_cast<uint8_t>(icmp[0]) != reply_type || icmp[1] != 0) {
+    return;
+  }
+
+  const uint16_t id = ReadUInt16(icmp + 4);
+  const uint16_t destination = id - first_id_;
+  if (destination >= destinations_.size())
+    return;
+  Destination& entry = destinations_[destination];
+
+  // Another process's echo with a colliding identifier.
+  const void* source;
+  size_t source_length;
+  if (family_ == SOCKETFAMILY_IPV4) {
+    source = &reinterpret_cast<const sockaddr_in*>(&from.peer)->sin_addr;
+    source_length = sizeof(in_addr);
+  } else {
+    source = &reinterpret_cast<const sockaddr_in6*>(&from.peer)->sin6_addr;
+    source_length = sizeof(in6_addr);
+  }
+  if (memcmp(source, entry.address, source_length) != 0)
+    return;
+
+  const uint32_t key =
+      static_cast<uint32_t>(id) << 16 | ReadUInt16(icmp + 6);
+  const size_t slot = FindSlot(key);
+  if (table_[slot] == kNone) {
+    ++entry.stats.late;
+    return;
+  }
+
+  const uint32_t probe = table_[slot];
+  ++entry.stats.received;
+  entry.stats.rtt.Add(now_us - probes_[probe].sent_us);
+  Erase(slot);
+  Unschedule(probe);
+  Release(probe);
+}
+
+}  // namespace mlab
@@ -13,33 +13,162 @@
 // limitations under the License.
 
 #include "mlab/protocol_header.h"
+
+#if defined(ARCH_X86) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include <string.h>
+
 #include "mlab/mlab.h"
 #include "log.h"
 
 namespace mlab {
 
-// standard checksum function, RFC1071
-uint16_t InternetCheckSum(const char* buffer, int len) {
-  long sum = 0;
-  uint16_t rt = 0;
-  uint16_t *w = (uint16_t *)buffer;
-  int      nleft = len;
-
-  while ( nleft > 1 ) {
-    sum += *w++;
-    nleft -= 2;
+namespace {
+// Sums the buffer as 16-bit words in memory order into a wide accumulator,
+// to be folded down to 16 bits at the end (RFC 1071). Summing wider words
+// gives the same folded result, as 2^16 is 1 modulo 0xffff.
+uint64_t SumWords(const char* buffer, size_t len) {
+  uint64_t sum = 0;
+  // Copied out rather than read through a cast: |buffer| may be unaligned.
+  for (; len >= 16; buffer += 16, len -= 16) {
+    uint32_t words[4];
+    memcpy(words, buffer, sizeof(words));
+    sum += static_cast<uint64_t>(words[0]) + words[1] + words[2] + words[3];
+  }
+  for (; len >= 4; buffer += 4, len -= 4) {
+    uint32_t word;
+    memcpy(&word, buffer, sizeof(word));
+    sum += word;
+  }
+  if (len >= 2) {
+    uint16_t word;
+    memcpy(&word, buffer, sizeof(word));
+    sum += word;
+    buffer += 2;
+    len -= 2;
   }
+  if (len > 0) {
+    // An odd last byte is padded with a zero byte after it.
+    const char last[2] = { *buffer, 0 };
+    uint16_t word;
+    memcpy(&word, last, sizeof(word));
+    sum += word;
+  }
+  return sum;
+}
 
-  if ( nleft > 0 ) {
-    sum += * (uint8_t *)w;
+#if defined(ARCH_X86) && defined(__GNUC__)
+#define HAVE_CHECKSUM_SIMD
+
+// Each 32-bit lane of the vector accumulators takes one 16-bit word per
+// block, so they are emptied into the wide sum before they could overflow.
+const size_t kMaxBlocksPerLane = 0xffff;
+
+__attribute__((target("sse2")))
+uint64_t SumWordsSSE2(const char* buffer, size_t len) {
+  uint64_t sum = 0;
+  const __m128i zero = _mm_setzero_si128();
+  while (len >= 16) {
+    __m128i low = zero;
+    __m128i high = zero;
+    for (size_t blocks = 0; len >= 16 && blocks < kMaxBlocksPerLane;
+         ++blocks, buffer += 16, len -= 16) {
+      const __m128i words =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer));
+      low = _mm_add_epi32(low, _mm_unpacklo_epi16(words, zero));
+      high = _mm_add_epi32(high, _mm_unpackhi_epi16(words, zero));
+    }
+    uint32_t lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4), high);
+    for (size_t i = 0; i < 8; ++i)
+      sum += lanes[i];
   }
+  return sum + SumWords(buffer, len);
+}
 
-  while ( sum >> 16 ) {
+__attribute__((target("avx2")))
+uint64_t SumWordsAVX2(const char* buffer, size_t len) {
+  uint64_t sum = 0;
+  const __m256i zero = _mm256_setzero_si256();
+  while (len >= 32) {
+    __m256i low = zero;
+    __m256i high = zero;
+    for (size_t blocks = 0; len >= 32 && blocks < kMaxBlocksPerLane;
+         ++blocks, buffer += 32, len -= 32) {
+      const __m256i words =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer));
+      low = _mm256_add_epi32(low, _mm256_unpacklo_epi16(words, zero));
+      high = _mm256_add_epi32(high, _mm256_unpackhi_epi16(words, zero));
+    }
+    uint32_t lanes[16];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), low);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + 8), high);
+    for (size_t i = 0; i < 16; ++i)
+      sum += lanes[i];
+  }
+  return sum + SumWords(buffer, len);
+}
+#endif
+
+typedef uint64_t (*SumFunction)(const char* buffer, size_t len);
+
+SumFunction ChooseSumWords() {
+#if defined(HAVE_CHECKSUM_SIMD)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return &SumWordsAVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return &SumWordsSSE2;
+#endif
+  return &SumWords;
+}
+
+// Below this, setting up the vectors costs more than they save.
+const size_t kMinSIMDLength = 64;
+
+uint16_t Fold(uint64_t sum) {
+  while (sum >> 16)
     sum = (sum & 0xffff) + (sum >> 16);
+  return sum;
+}
+}  // namespace
+
+// standard checksum function, RFC1071
+uint16_t InternetCheckSum(const char* buffer, int len) {
+  ASSERT(len >= 0);
+  uint64_t sum;
+  if (static_cast<size_t>(len) < kMinSIMDLength) {
+    sum = SumWords(buffer, len);
+  } else {
+    static const SumFunction sum_words = ChooseSumWords();
+    sum = sum_words(buffer, len);
   }
+  return ~Fold(sum);
+}
+
+// RFC 1624, equation 3: HC' = ~(~HC + ~m + m').
+uint16_t UpdateCheckSum(uint16_t checksum, uint16_t old_value,
+                        uint16_t new_value) {
+  const uint64_t sum = static_cast<uint16_t>(~checksum) +
+                       static_cast<uint16_t>(~old_value) +
+                       static_cast<uint64_t>(new_value);
+  return ~Fold(sum);
+}
 
-  rt = ~sum;
-  return (rt);
+uint16_t UpdateCheckSum32(uint16_t checksum, uint32_t old_value,
+                          uint32_t new_value) {
+  // The two halves, as 16-bit words in memory order.
+  uint16_t old_words[2];
+  uint16_t new_words[2];
+  memcpy(old_words, &old_value, sizeof(old_words));
+  memcpy(new_words, &new_value, sizeof(new_words));
+  const uint64_t sum = static_cast<uint16_t>(~checksum) +
+                       static_cast<uint16_t>(~old_words[0]) +
+                       static_cast<uint16_t>(~old_words[1]) +
+                       static_cast<uint64_t>(new_words[0]) + new_words[1];
+  return ~Fold(sum);
 }
 
 int IP4Header::SetSourceAddress(const std::string& addrstr) {
@@ -31,6 +31,9 @@ typedef SSIZE_T ssize_t;
 #error Undefined platform
 #endif
 #include <errno.h>
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <linux/filter.h>
+#endif
 #if defined(OS_LINUX)
 #include <malloc.h>
 #endif
@@ -144,12 +147,11 @@ int RawSocket::Bind(const Host& host) {
   return -1;
 }
 
-bool RawSocket::Send(const Packet& bytes, ssize_t *num_bytes) const {
+bool RawSocket::SendFrom(const void* buffer, size_t length,
+                         ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
 
-  const size_t packet_len = bytes.length();
-
-  ssize_t num = send(fd_, bytes.buffer(), packet_len, 0);
+  ssize_t num = send(fd_, buffer, length, 0);
   if (num_bytes != NULL)
     *num_bytes = num;
 
@@ -158,9 +160,8 @@ bool RawSocket::Send(const Packet& bytes, ssize_t *num_bytes) const {
     return false;
   }
 
-  if (static_cast<size_t>(num) != packet_len) {
-    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.",
-        packet_len, num);
+  if (static_cast<size_t>(num) != length) {
+    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.", length, num);
   }
 
   return true;
@@ -176,6 +177,42 @@ void RawSocket::SendToOrDie(const Host& host, const Packet& bytes,
 
 bool RawSocket::SendTo(const Host& host, const Packet& bytes,
                        ssize_t *num_bytes) const {
+  iovec iov;
+  iov.iov_base = const_cast<char*>(bytes.buffer());
+  iov.iov_len = bytes.length();
+  return SendToV(host, &iov, 1, num_bytes);
+}
+
+bool RawSocket::SendV(const iovec* iov, size_t iovcnt,
+                      ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+
+  const size_t packet_len = IOVecLength(iov, iovcnt);
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  ssize_t num = sendmsg(fd_, &msg, 0);
+  if (num_bytes != NULL)
+    *num_bytes = num;
+
+  if (num < 0) {
+    LOG(ERROR, "Failed to sendmsg: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+
+  if (static_cast<size_t>(num) != packet_len) {
+    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.",
+        packet_len, num);
+  }
+
+  return true;
+}
+
+bool RawSocket::SendToV(const Host& host, const iovec* iov, size_t iovcnt,
+                        ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
   for (Host::SocketAddressList::const_iterator addr_it = host.sockaddr_.begin();
       addr_it != host.sockaddr_.end(); ++addr_it) {
@@ -205,9 +242,15 @@ bool RawSocket::SendTo(const Host& host, const Packet& bytes,
       }
     }
 
-    const size_t packet_len = bytes.length();
-    ssize_t num = sendto(fd_, bytes.buffer(), packet_len, 0,
-                         reinterpret_cast<const sockaddr*>(&(*addr_it)), addrlen);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = const_cast<sockaddr_storage*>(&(*addr_it));
+    msg.msg_namelen = addrlen;
+    msg.msg_iov = const_cast<iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    const size_t packet_len = IOVecLength(iov, iovcnt);
+    ssize_t num = sendmsg(fd_, &msg, 0);
     *num_bytes = num;
     if (num < 0) {
       LOG(ERROR, "Failed to send to %s: %s [%d]", addr_str,
@@ -226,21 +269,20 @@ bool RawSocket::SendTo(const Host& host, const Packet& bytes,
   return true;
 }
 
-Packet RawSocket::Receive(size_t count, ssize_t *num_bytes) const {
+bool RawSocket::ReceiveInto(void* buffer, size_t count,
+                            ssize_t* num_bytes) const {
   ASSERT(fd_ != -1);
   ASSERT(count > 0);
 
   LOG(VERBOSE, "Receiving %zu bytes.", count);
 
-  char buffer[count];
-
   ssize_t num = recv(fd_, buffer, count, 0);
 
   if (num_bytes != NULL)
     *num_bytes = num;
   if (num < 0) {
     LOG(ERROR, "Failed to recv: %s [%d]", strerror(errno), errno);
-    return Packet("");
+    return false;
   }
 
   if (num == 0) {
@@ -250,7 +292,38 @@ Packet RawSocket::Receive(size_t count, ssize_t *num_bytes) const {
         num);
   }
 
-  return Packet(buffer, num);
+  return true;
+}
+
+bool RawSocket::ReceiveV(const iovec* iov, size_t iovcnt,
+                         ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+
+  const size_t count = IOVecLength(iov, iovcnt);
+  ASSERT(count > 0);
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  ssize_t num = recvmsg(fd_, &msg, 0);
+
+  if (num_bytes != NULL)
+    *num_bytes = num;
+  if (num < 0) {
+    LOG(ERROR, "Failed to recvmsg: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+
+  if (num == 0) {
+    LOG(WARNING, "Failed to recvmsg: No bytes available.");
+  } else if (static_cast<size_t>(num) != count) {
+    LOG(VERBOSE, "Tried to recv %zu bytes; recv %zd bytes instead.", count,
+        num);
+  }
+
+  return true;
 }
 
 Packet RawSocket::ReceiveFromOrDie(size_t count, Host* host) const {
@@ -271,10 +344,10 @@ Packet RawSocket::ReceiveFrom(size_t count,
   ASSERT(count > 0);
 
   char addr_str[INET6_ADDRSTRLEN] = {0};
-  char buffer[count];
+  Packet packet = Packet::Allocate(count);
   sockaddr_storage recvaddr;
   socklen_t recvaddrlen = sizeof(sockaddr_storage);
-  ssize_t num = recvfrom(fd_, buffer, count, 0,
+  ssize_t num = recvfrom(fd_, packet.mutable_buffer(), count, 0,
                      reinterpret_cast<sockaddr*>(&recvaddr),
                      &recvaddrlen);
 
@@ -282,7 +355,7 @@ Packet RawSocket::ReceiveFrom(size_t count,
     *num_bytes = num;
   if (num < 0) {
     LOG(ERROR, "Raw socket fails to recvfrom: %s [%d]", strerror(errno), errno);
-    return Packet("", 0);
+    return Packet();
   }
 
   if (num == 0) {
@@ -312,7 +385,112 @@ Packet RawSocket::ReceiveFrom(size_t count,
     *host = Host(std::string(addr_str));
   }
 
-  return Packet(buffer, num);
+  return packet.Slice(0, num);
+}
+
+bool RawSocket::ReceiveBatch(Datagram* datagrams, size_t count,
+                             size_t* num_datagrams) const {
+  return ReceiveDatagrams(datagrams, count, num_datagrams);
+}
+
+SocketStatus RawSocket::ReceiveBatchUntil(Datagram* datagrams, size_t count,
+                                          uint64_t deadline_us,
+                                          size_t* num_datagrams) const {
+  ASSERT(num_datagrams != NULL);
+
+  *num_datagrams = 0;
+  while (true) {
+    const SocketStatus status = WaitUntil(false, deadline_us);
+    if (status != SOCKETSTATUS_OK)
+      return status;
+    if (ReceiveDatagrams(datagrams, count, num_datagrams))
+      return SOCKETSTATUS_OK;
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      return SOCKETSTATUS_ERROR;
+    *num_datagrams = 0;
+  }
+}
+
+bool RawSocket::EnableTimestamping(bool hardware) const {
+  return SetTimestamping(hardware);
+}
+
+bool RawSocket::GetSendTimestamp(PacketTimestamp* timestamp,
+                                 int timeout_ms) const {
+  return ReadSendTimestamp(timestamp, timeout_ms);
+}
+
+bool RawSocket::AttachFilter(const FilterProgram& program) const {
+  ASSERT(fd_ != -1);
+  ASSERT(!program.empty());
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  std::vector<sock_filter> instructions(program.size());
+  for (size_t i = 0; i < program.size(); ++i) {
+    instructions[i].code = program[i].code;
+    instructions[i].jt = program[i].jump_true;
+    instructions[i].jf = program[i].jump_false;
+    instructions[i].k = program[i].k;
+  }
+  sock_fprog filter;
+  filter.len = instructions.size();
+  filter.filter = &instructions[0];
+  if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &filter,
+                 sizeof(filter)) != 0) {
+    LOG(ERROR, "Failed to attach socket filter: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+  LOG(VERBOSE, "Attached a %zu instruction filter.", program.size());
+  return true;
+#else
+  LOG(ERROR, "Socket filters are not supported on this platform.");
+  return false;
+#endif
+}
+
+bool RawSocket::DetachFilter() const {
+  ASSERT(fd_ != -1);
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  int unused = 0;
+  if (setsockopt(fd_, SOL_SOCKET, SO_DETACH_FILTER, &unused,
+                 sizeof(unused)) != 0) {
+    LOG(ERROR, "Failed to detach socket filter: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool RawSocket::SetICMP6Filter(const ICMP6Filter& filter) const {
+  ASSERT(fd_ != -1);
+
+  if (family_ != AF_INET6) {
+    LOG(ERROR, "ICMPv6 filters are only for IPv6 raw sockets.");
+    return false;
+  }
+#if defined(OS_WINDOWS)
+  LOG(ERROR, "ICMPv6 filters are not supported on this platform.");
+  return false;
+#else
+  icmp6_filter kernel_filter;
+  ICMP6_FILTER_SETBLOCKALL(&kernel_filter);
+  for (int type = 0; type < 256; ++type) {
+    if (filter.passes(type))
+      ICMP6_FILTER_SETPASS(type, &kernel_filter);
+  }
+  if (setsockopt(fd_, IPPROTO_ICMPV6, ICMP6_FILTER, &kernel_filter,
+                 sizeof(kernel_filter)) < 0) {
+    LOG(ERROR, "Failed to set ICMPv6 filter: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+  return true;
+#endif
 }
 
 bool RawSocket::SetIPHDRINCL() {
@@ -340,20 +518,10 @@ RawSocket::RawSocket(SocketType type, SocketFamily family)
     case SOCKETFAMILY_UNSPEC:  break;
     case SOCKETFAMILY_IPV4:  break;
     case SOCKETFAMILY_IPV6:
-      {
-        // we set ICMPv6 filters here.
-        // Accepting only ECHO_REPLY, TIME_EXCEEDED, DST_UNREACH
-        struct icmp6_filter myfilt;
-        ICMP6_FILTER_SETBLOCKALL(&myfilt);
-        ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &myfilt);
-        ICMP6_FILTER_SETPASS(ICMP6_TIME_EXCEEDED, &myfilt);
-        ICMP6_FILTER_SETPASS(ICMP6_DST_UNREACH, &myfilt);
-        if (setsockopt(fd_, IPPROTO_ICMPV6, ICMP6_FILTER,
-                       &myfilt, sizeof(myfilt)) < 0) {
-          LOG(FATAL, "Failed to set ICMPv6 raw socket filters! %s [%d]",
-                             strerror(errno), errno);
-        }
-      }
+      // Accepting only ECHO_REPLY, TIME_EXCEEDED, DST_UNREACH until the
+      // caller sets its own.
+      if (!SetICMP6Filter(ICMP6Filter()))
+        LOG(FATAL, "Failed to set ICMPv6 raw socket filters!");
       break;
   }
 }
@@ -0,0 +1,162 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/sharded_server.h"
+
+#include <string.h>
+
+#include "log.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/listen_socket.h"
+
+namespace mlab {
+
+// static
+ShardedServer* ShardedServer::Create(uint16_t port, SocketFamily family,
+                                     size_t num_workers, int backlog,
+                                     Handler* handler) {
+  ASSERT(num_workers > 0);
+  ASSERT(handler != NULL);
+
+  std::vector<ListenSocket*> listeners;
+  if (!ListenSocket::CreateGroup(port, SOCKETTYPE_TCP, family, backlog,
+                                 num_workers, &listeners)) {
+    return NULL;
+  }
+
+  ShardedServer* server = new ShardedServer(handler);
+  for (size_t i = 0; i < listeners.size(); ++i) {
+    EventLoop* loop = EventLoop::Create();
+    if (loop == NULL) {
+      for (size_t j = i; j < listeners.size(); ++j)
+        delete listeners[j];
+      delete server;
+      return NULL;
+    }
+    server->workers_.push_back(new Worker(server, listeners[i], loop));
+  }
+  return server;
+}
+
+// static
+ShardedServer* ShardedServer::CreateOrDie(uint16_t port, SocketFamily family,
+                                          size_t num_workers, int backlog,
+                                          Handler* handler) {
+  ShardedServer* server = Create(port, family, num_workers, backlog, handler);
+  if (!server)
+    LOG(FATAL, "Failed to create sharded server on port %d", port);
+  return server;
+}
+
+ShardedServer::ShardedServer(Handler* handler)
+    : handler_(handler),
+      stopping_(false),
+      running_(false) {
+  pthread_mutex_init(&lock_, NULL);
+}
+
+ShardedServer::~ShardedServer() {
+  Stop();
+  for (size_t i = 0; i < workers_.size(); ++i)
+    delete workers_[i];
+  pthread_mutex_destroy(&lock_);
+}
+
+bool ShardedServer::Start() {
+  ASSERT(!running_);
+
+  pthread_mutex_lock(&lock_);
+  stopping_ = false;
+  pthread_mutex_unlock(&lock_);
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    int error = pthread_create(&workers_[i]->thread_, NULL, &Worker::Run,
+                               workers_[i]);
+    if (error != 0) {
+      LOG(ERROR, "Failed to start worker %zu: %s [%d]", i, strerror(error),
+          error);
+      StopWorkers(i);
+      for (size_t j = 0; j < i; ++j)
+        pthread_join(workers_[j]->thread_, NULL);
+      return false;
+    }
+  }
+  running_ = true;
+  LOG(VERBOSE, "Started %zu workers.", workers_.size());
+  return true;
+}
+
+void ShardedServer::Stop() {
+  if (!running_)
+    return;
+
+  StopWorkers(workers_.size());
+  for (size_t i = 0; i < workers_.size(); ++i)
+    pthread_join(workers_[i]->thread_, NULL);
+  running_ = false;
+  LOG(VERBOSE, "Stopped %zu workers.", workers_.size());
+}
+
+void ShardedServer::StopWorkers(size_t count) {
+  pthread_mutex_lock(&lock_);
+  stopping_ = true;
+  pthread_mutex_unlock(&lock_);
+  for (size_t i = 0; i < count; ++i)
+    workers_[i]->loop_->Wake();
+}
+
+bool ShardedServer::stopping() {
+  pthread_mutex_lock(&lock_);
+  const bool stopping = stopping_;
+  pthread_mutex_unlock(&lock_);
+  return stopping;
+}
+
+ShardedServer::Worker::Worker(ShardedServer* server, ListenSocket* listener,
+                              EventLoop* loop)
+    : server_(server),
+      listener_(listener),
+      loop_(loop) {
+  loop_->Add(listener_, EVENT_READ, this);
+}
+
+ShardedServer::Worker::~Worker() {
+  loop_->Remove(listener_);
+  delete loop_;
+  delete listener_;
+}
+
+void ShardedServer::Worker::OnReadable(Socket*) {
+  // The listener is non-blocking, so drain its queue.
+  AcceptedSocket* accepted;
+  while ((accepted = listener_->Accept()) != NULL)
+    server_->handler_->OnAccept(loop_, accepted);
+}
+
+void ShardedServer::Worker::OnWritable(Socket*) {
+  LOG(FATAL, "A listener is never registered for writing.");
+}
+
+// static
+void* ShardedServer::Worker::Run(void* worker) {
+  Worker* self = static_cast<Worker*>(worker);
+  // |Stop| wakes the loop after setting the flag, so waiting without a limit
+  // can't miss it.
+  while (!self->server_->stopping()) {
+    if (self->loop_->RunOnce(-1) < 0)
+      break;
+  }
+  return NULL;
+}
+
+}  // namespace mlab
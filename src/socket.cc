@@ -20,17 +20,220 @@
 
 #if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_FREEBSD)
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
 #elif defined(OS_WINDOWS)
 #include <winsock2.h>
 #endif
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_FREEBSD)
+#include <fcntl.h>
+#include <poll.h>
+#endif
+#if defined(OS_LINUX)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#endif
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+#include "clock.h"
 #include "log.h"
 
+#if defined(OS_LINUX)
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_ORIGIN_TIMESTAMPING
+#define SO_EE_ORIGIN_TIMESTAMPING 4
+#endif
+#endif
+
 namespace mlab {
 namespace {
+#if defined(OS_LINUX)
+// sendfile and splice take no MSG_NOSIGNAL, so while one of these is in scope
+// SIGPIPE is blocked on the calling thread, and one raised meanwhile is
+// discarded. The call still fails with EPIPE.
+class ScopedNoSigPipe {
+ public:
+  explicit ScopedNoSigPipe(bool enabled) : enabled_(enabled) {
+    if (!enabled_)
+      return;
+    sigemptyset(&pipe_set_);
+    sigaddset(&pipe_set_, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set_, &old_mask_);
+    // Leave a SIGPIPE that was already pending for its owner.
+    sigset_t pending;
+    sigpending(&pending);
+    was_pending_ = sigismember(&pending, SIGPIPE) == 1;
+  }
+
+  ~ScopedNoSigPipe() {
+    if (!enabled_)
+      return;
+    const int saved_errno = errno;
+    sigset_t pending;
+    sigpending(&pending);
+    if (!was_pending_ && sigismember(&pending, SIGPIPE) == 1) {
+      const timespec no_wait = { 0, 0 };
+      while (sigtimedwait(&pipe_set_, NULL, &no_wait) == -1 &&
+             errno == EINTR) { }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask_, NULL);
+    errno = saved_errno;
+  }
+
+ private:
+  bool enabled_;
+  bool was_pending_;
+  sigset_t pipe_set_;
+  sigset_t old_mask_;
+};
+#endif
+
+#if defined(SO_MAX_PACING_RATE)
+// Sets a pacing rate too fast for 32 bits. Kernels before 4.20 read only the
+// first 32 bits, so the rate is read back to check that the kernel took all
+// 64.
+bool SetPacingRate64(int socket_fd, uint64_t bytes_per_second) {
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &bytes_per_second,
+                 sizeof(bytes_per_second)) != 0) {
+    return false;
+  }
+  uint64_t rate = 0;
+  socklen_t rate_len = sizeof(rate);
+  return getsockopt(socket_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate,
+                    &rate_len) == 0 &&
+         rate_len == sizeof(rate) && rate == bytes_per_second;
+}
+#endif
+
+// The largest chunk moved per syscall by the bulk send methods.
+const size_t kBulkChunkSize = 1 << 20;
+
+// The number of datagrams handed to the kernel per syscall. Batches larger
+// than this are split so the message headers can live on the stack.
+const size_t kMaxDatagramsPerCall = 64;
+
+void InitDatagramHeader(Datagram* datagram, bool use_peer, iovec* iov,
+                        msghdr* msg) {
+  iov->iov_base = datagram->buffer;
+  iov->iov_len = datagram->length;
+  memset(msg, 0, sizeof(*msg));
+  msg->msg_iov = iov;
+  msg->msg_iovlen = 1;
+  if (use_peer) {
+    msg->msg_name = &datagram->peer;
+    msg->msg_namelen = datagram->peer_len;
+  }
+}
+
+#if defined(OS_LINUX)
+// Room for the control messages a datagram may carry.
+union DatagramControl {
+  char buffer[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(scm_timestamping))];
+  cmsghdr align;
+};
+
+// Attaches a UDP_SEGMENT control message if |datagram| asks for the kernel to
+// segment it.
+void SetSegmentControl(const Datagram& datagram, DatagramControl* control,
+                       msghdr* msg) {
+  if (datagram.segment_size == 0)
+    return;
+
+  msg->msg_control = control->buffer;
+  msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+  cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
+  cmsg->cmsg_level = SOL_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  memcpy(CMSG_DATA(cmsg), &datagram.segment_size, sizeof(uint16_t));
+}
+
+// Returns the segment size of a receive coalesced by UDP_GRO, or zero.
+uint16_t GetSegmentControl(msghdr* msg) {
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int segment_size;
+      memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+      return segment_size;
+    }
+  }
+  return 0;
+}
+
+uint64_t TimespecToNs(const timespec& ts) {
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Fills in |timestamp| from an SCM_TIMESTAMPING control message. Returns false
+// if there is none.
+bool GetTimestampControl(msghdr* msg, PacketTimestamp* timestamp) {
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_TIMESTAMPING) {
+      // ts[0] is the software timestamp and ts[2] the raw hardware one.
+      scm_timestamping stamps;
+      memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+      timestamp->software_ns = TimespecToNs(stamps.ts[0]);
+      timestamp->hardware_ns = TimespecToNs(stamps.ts[2]);
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+// Sets an integer option and reads it back. Returns whether the kernel
+// accepted |value| and kept it.
+bool SetIntOption(int fd, int level, int name, const char* name_str,
+                  int value) {
+  if (setsockopt(fd, level, name, (const char*) &value, sizeof(value)) < 0) {
+    LOG(WARNING, "Failed to set %s to %d: %s [%d]", name_str, value,
+        strerror(errno), errno);
+    return false;
+  }
+
+  int actual = 0;
+  socklen_t actual_len = sizeof(actual);
+  if (getsockopt(fd, level, name, (char*) &actual, &actual_len) < 0) {
+    LOG(WARNING, "Failed to read back %s: %s [%d]", name_str,
+        strerror(errno), errno);
+    return false;
+  }
+  // Flags read back as any non-zero value.
+  if (actual != value && !(value == 1 && actual != 0)) {
+    LOG(WARNING, "Set %s to %d but the kernel has %d.", name_str, value,
+        actual);
+    return false;
+  }
+  return true;
+}
+
 int SocketProtocolFor(SocketType type, SocketFamily family) {
   switch (type) {
     case SOCKETTYPE_TCP: return 0;
@@ -52,8 +255,28 @@ int SocketProtocolFor(SocketType type, SocketFamily family) {
 }
 }  // namespace
 
+const uint64_t Socket::kNoDeadline = static_cast<uint64_t>(-1);
+
 Socket::~Socket() {
   DestroySocket();
+  delete pacer_;
+}
+
+bool Socket::Send(const Packet& bytes, ssize_t* num_bytes) const {
+  return SendFrom(bytes.buffer(), bytes.length(), num_bytes);
+}
+
+Packet Socket::Receive(size_t count, ssize_t* num_bytes) const {
+  ASSERT(count > 0);
+
+  Packet packet = Packet::Allocate(count);
+  ssize_t num = -1;
+  bool received = ReceiveInto(packet.mutable_buffer(), count, &num);
+  if (num_bytes != NULL)
+    *num_bytes = num;
+  if (!received || num <= 0)
+    return Packet();
+  return packet.Slice(0, num);
 }
 
 ssize_t Socket::SendOrDie(const Packet& bytes) const {
@@ -76,6 +299,198 @@ Packet Socket::ReceiveOrDie(size_t count) const {
   return packet;
 }
 
+bool Socket::SendFile(int file_fd, off_t offset, size_t length,
+                      ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+  ASSERT(file_fd != -1);
+
+  if (type() != SOCKETTYPE_TCP) {
+    LOG(ERROR, "SendFile is only supported on TCP sockets.");
+    return false;
+  }
+
+  LOG(VERBOSE, "Sending %zu bytes from fd %d at offset %lld.", length,
+      file_fd, static_cast<long long>(offset));
+
+#if defined(OS_LINUX)
+  ScopedNoSigPipe no_sigpipe((send_flags_ & MSG_NOSIGNAL) != 0);
+  size_t sent = 0;
+  bool ok = true;
+  while (sent < length) {
+    const size_t chunk = std::min(length - sent, kBulkChunkSize);
+    ssize_t num;
+    while ((num = sendfile(fd_, file_fd, &offset, chunk)) == -1 &&
+           errno == EINTR) { }
+    if (num < 0) {
+      LOG(SOCKET_ERROR_SEVERITY, "Failed to sendfile: %s [%d]",
+          strerror(errno), errno);
+      ok = false;
+      break;
+    }
+    if (num == 0)
+      break;
+    sent += num;
+  }
+
+  if (num_bytes != NULL)
+    *num_bytes = ok || sent > 0 ? sent : -1;
+  if (ok && sent != length) {
+    LOG(VERBOSE, "Tried to send %zu bytes; sent %zu bytes.", length, sent);
+  }
+  return ok;
+#else
+  LOG(ERROR, "SendFile is not supported on this platform.");
+  return false;
+#endif
+}
+
+bool Socket::Splice(int from_fd, size_t length, ssize_t* num_bytes) const {
+  ASSERT(fd_ != -1);
+  ASSERT(from_fd != -1);
+
+  if (type() != SOCKETTYPE_TCP) {
+    LOG(ERROR, "Splice is only supported on TCP sockets.");
+    return false;
+  }
+
+  LOG(VERBOSE, "Splicing %zu bytes from fd %d.", length, from_fd);
+
+#if defined(OS_LINUX)
+  ScopedNoSigPipe no_sigpipe((send_flags_ & MSG_NOSIGNAL) != 0);
+  size_t sent = 0;
+  bool ok = true;
+  // splice needs a pipe at one end, so go through one unless |from_fd| is one.
+  struct stat from_stat;
+  const bool from_pipe = fstat(from_fd, &from_stat) == 0 &&
+                         S_ISFIFO(from_stat.st_mode);
+  int pipe_fds[2] = { from_fd, -1 };
+  if (!from_pipe && pipe(pipe_fds) == -1) {
+    LOG(ERROR, "Failed to create pipe: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+
+  while (sent < length) {
+    const size_t chunk = std::min(length - sent, kBulkChunkSize);
+    ssize_t in_pipe = chunk;
+    if (!from_pipe) {
+      while ((in_pipe = splice(from_fd, NULL, pipe_fds[1], NULL, chunk,
+                               SPLICE_F_MOVE | SPLICE_F_MORE)) == -1 &&
+             errno == EINTR) { }
+      if (in_pipe <= 0) {
+        ok = in_pipe == 0;
+        break;
+      }
+    }
+
+    // Drain what is in the pipe into the socket. Bytes already moved into
+    // our own pipe can't be handed back, so a full non-blocking socket waits
+    // for room, up to the send timeout, rather than dropping them.
+    ssize_t drained = 0;
+    while (drained < in_pipe) {
+      ssize_t num;
+      while ((num = splice(pipe_fds[0], NULL, fd_, NULL, in_pipe - drained,
+                           SPLICE_F_MOVE | SPLICE_F_MORE)) == -1 &&
+             errno == EINTR) { }
+      if (num == -1 && !from_pipe &&
+          (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        const uint64_t deadline_us = send_timeout_ms_ > 0 ?
+            DeadlineAfterMs(send_timeout_ms_) : kNoDeadline;
+        const SocketStatus status = WaitUntil(true, deadline_us);
+        if (status == SOCKETSTATUS_OK)
+          continue;
+        if (status == SOCKETSTATUS_TIMEOUT)
+          errno = ETIMEDOUT;
+        ok = false;
+        break;
+      }
+      if (num <= 0) {
+        ok = num == 0;
+        break;
+      }
+      drained += num;
+      // Reading straight from a pipe, take whatever a single splice moves.
+      if (from_pipe)
+        break;
+    }
+    sent += drained;
+    if (!ok || drained == 0)
+      break;
+  }
+
+  if (!ok)
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to splice: %s [%d]",
+        strerror(errno), errno);
+  if (!from_pipe) {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+  }
+
+  if (num_bytes != NULL)
+    *num_bytes = ok || sent > 0 ? sent : -1;
+  if (ok && sent != length) {
+    LOG(VERBOSE, "Tried to splice %zu bytes; sent %zu bytes.", length, sent);
+  }
+  return ok;
+#else
+  LOG(ERROR, "Splice is not supported on this platform.");
+  return false;
+#endif
+}
+
+bool Socket::SetNonBlocking(bool non_blocking) const {
+  ASSERT(fd_ != -1);
+
+#if defined(OS_WINDOWS)
+  u_long mode = non_blocking ? 1 : 0;
+  if (ioctlsocket(fd_, FIONBIO, &mode) != 0) {
+    LOG(ERROR, "Failed to set non-blocking mode: %d", WSAGetLastError());
+    return false;
+  }
+#else
+  int flags = fcntl(fd_, F_GETFL, 0);
+  if (flags != -1) {
+    flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    flags = fcntl(fd_, F_SETFL, flags);
+  }
+  if (flags == -1) {
+    LOG(ERROR, "Failed to set non-blocking mode: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+#endif
+  LOG(VERBOSE, "Set fd %d %s.", fd_,
+      non_blocking ? "non-blocking" : "blocking");
+  return true;
+}
+
+bool Socket::SetNoSigPipe() const {
+  ASSERT(fd_ != -1);
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  send_flags_ |= MSG_NOSIGNAL;
+#elif defined(OS_MACOSX) || defined(OS_FREEBSD)
+  int on = 1;
+  if (setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on)) != 0) {
+    LOG(ERROR, "Failed to set SO_NOSIGPIPE: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+#endif
+  // Windows has no SIGPIPE.
+  return true;
+}
+
+bool Socket::IsNonBlocking() const {
+  ASSERT(fd_ != -1);
+
+#if defined(OS_WINDOWS)
+  // Winsock has no way to query the mode.
+  return false;
+#else
+  int flags = fcntl(fd_, F_GETFL, 0);
+  return flags != -1 && (flags & O_NONBLOCK) != 0;
+#endif
+}
+
 bool Socket::SetSendBufferSize(size_t size) const {
   return SetBufferSize(size, BUFFERTYPE_SEND);
 }
@@ -92,16 +507,308 @@ size_t Socket::GetRecvBufferSize() const {
   return GetBufferSize(BUFFERTYPE_RECV);
 }
 
+bool Socket::SetSendTimeout(uint32_t timeout_ms) const {
+  if (!SetTimeoutOption(SO_SNDTIMEO, timeout_ms))
+    return false;
+  send_timeout_ms_ = timeout_ms;
+  return true;
+}
+
+bool Socket::SetRecvTimeout(uint32_t timeout_ms) const {
+  if (!SetTimeoutOption(SO_RCVTIMEO, timeout_ms))
+    return false;
+  recv_timeout_ms_ = timeout_ms;
+  return true;
+}
+
+// static
+uint64_t Socket::DeadlineAfterMs(uint32_t timeout_ms) {
+  return MonotonicNowUs() + static_cast<uint64_t>(timeout_ms) * 1000;
+}
+
+SocketStatus Socket::ReceiveUntil(void* buffer, size_t count,
+                                  uint64_t deadline_us,
+                                  ssize_t* num_bytes) const {
+  ASSERT(num_bytes != NULL);
+
+  *num_bytes = 0;
+  while (true) {
+    const SocketStatus status = WaitUntil(false, deadline_us);
+    if (status != SOCKETSTATUS_OK)
+      return status;
+    if (ReceiveInto(buffer, count, num_bytes))
+      return SOCKETSTATUS_OK;
+    // Readiness can be spurious, such as a datagram with a bad checksum.
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      return SOCKETSTATUS_ERROR;
+    *num_bytes = 0;
+  }
+}
+
+SocketStatus Socket::SendUntil(const void* buffer, size_t length,
+                               uint64_t deadline_us,
+                               ssize_t* num_bytes) const {
+  ASSERT(num_bytes != NULL);
+
+  const char* bytes = static_cast<const char*>(buffer);
+  const bool blocking = !IsNonBlocking();
+  size_t sent = 0;
+  SocketStatus status = SOCKETSTATUS_OK;
+  while (sent < length) {
+    status = WaitUntil(true, deadline_us);
+    if (status != SOCKETSTATUS_OK)
+      break;
+
+    uint64_t remaining_ms = 0;
+    if (deadline_us != kNoDeadline) {
+      const uint64_t now_us = MonotonicNowUs();
+      // A paced send would wait its turn past the deadline.
+      if (pacing_mode_ == PACING_USER_SPACE &&
+          now_us + pacer_->DelayUs() >= deadline_us) {
+        status = SOCKETSTATUS_TIMEOUT;
+        break;
+      }
+      remaining_ms = now_us < deadline_us
+                         ? (deadline_us - now_us + 999) / 1000 : 1;
+    }
+
+    // A blocking send waits for room for all of it, so bound it by the
+    // deadline and put the socket's own timeout back afterwards.
+    const bool bounded = blocking && remaining_ms > 0;
+    if (bounded &&
+        !SetTimeoutOption(SO_SNDTIMEO, std::min<uint64_t>(remaining_ms,
+                                                          UINT_MAX))) {
+      status = SOCKETSTATUS_ERROR;
+      break;
+    }
+    ssize_t num;
+    const bool ok = SendFrom(bytes + sent, length - sent, &num);
+    const int send_errno = errno;
+    if (bounded)
+      SetTimeoutOption(SO_SNDTIMEO, send_timeout_ms_);
+    if (!ok) {
+      errno = send_errno;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        continue;
+      status = SOCKETSTATUS_ERROR;
+      break;
+    }
+    sent += num;
+  }
+
+  *num_bytes = status == SOCKETSTATUS_ERROR && sent == 0 ? -1 : sent;
+  if (status == SOCKETSTATUS_TIMEOUT) {
+    LOG(VERBOSE, "Deadline passed having sent %zu of %zu bytes.", sent,
+        length);
+  }
+  return status;
+}
+
 Socket::Socket(SocketType type, SocketFamily family)
     : fd_(-1),
       family_(family),
       protocol_(SocketProtocolFor(type, family)),
-      type_(type) {
+      honored_options_(0),
+      send_timeout_ms_(0),
+      recv_timeout_ms_(0),
+      send_flags_(0),
+      type_(type),
+      zerocopy_enabled_(false),
+      zerocopy_next_id_(0),
+      pacer_(NULL),
+      pacing_mode_(PACING_OFF) {
   ASSERT(family_ != AF_UNSPEC);
   ASSERT(type_ != 0);
   ASSERT(protocol_ != -1);
 }
 
+SocketStatus Socket::WaitUntil(bool write, uint64_t deadline_us) const {
+  ASSERT(fd_ != -1);
+
+  pollfd entry = { fd_, static_cast<short>(write ? POLLOUT : POLLIN), 0 };
+  while (true) {
+    int wait = -1;
+    if (deadline_us != kNoDeadline) {
+      const uint64_t now_us = MonotonicNowUs();
+      if (now_us >= deadline_us)
+        return SOCKETSTATUS_TIMEOUT;
+      // Round up so the wait doesn't end just short of the deadline.
+      wait = std::min<uint64_t>((deadline_us - now_us + 999) / 1000, INT_MAX);
+    }
+#if defined(OS_WINDOWS)
+    const int ready = WSAPoll(&entry, 1, wait);
+#else
+    const int ready = poll(&entry, 1, wait);
+#endif
+    // Errors and hang-ups count as ready; the send or receive reports them.
+    if (ready > 0)
+      return SOCKETSTATUS_OK;
+    if (ready == -1 && errno != EINTR) {
+      LOG(ERROR, "Failed to poll: %s [%d]", strerror(errno), errno);
+      return SOCKETSTATUS_ERROR;
+    }
+  }
+}
+
+PacingMode Socket::SetPacing(uint64_t bits_per_second) const {
+  ASSERT(fd_ != -1);
+
+  delete pacer_;
+  pacer_ = NULL;
+  pacing_mode_ = PACING_OFF;
+
+  const uint64_t bytes_per_second = bits_per_second / 8;
+#if defined(SO_MAX_PACING_RATE)
+  // Every kernel takes a 32-bit rate, where ~0U means unlimited. Faster rates
+  // need the 64-bit form, and are clamped where the kernel lacks it.
+  bool kernel = false;
+  if (bytes_per_second >= 0xffffffffULL) {
+    kernel = SetPacingRate64(fd_, bytes_per_second);
+    if (!kernel) {
+      LOG(WARNING, "Kernel pacing rate clamped from %llu to %u bytes/s.",
+          static_cast<unsigned long long>(bytes_per_second), 0xfffffffeU);
+    }
+  }
+  if (!kernel) {
+    uint32_t rate = bytes_per_second == 0 ? ~0U :
+        std::min<uint64_t>(bytes_per_second, 0xfffffffeU);
+    kernel = setsockopt(fd_, SOL_SOCKET, SO_MAX_PACING_RATE, &rate,
+                        sizeof(rate)) == 0;
+    if (!kernel) {
+      LOG(WARNING, "Failed to set SO_MAX_PACING_RATE: %s [%d]",
+          strerror(errno), errno);
+    }
+  }
+#else
+  const bool kernel = false;
+#endif
+
+  if (bytes_per_second == 0) {
+    LOG(VERBOSE, "Pacing off.");
+    return pacing_mode_;
+  }
+
+  // TCP paces its own segments to the rate. Other sockets are only paced by
+  // the fq qdisc, which can't be seen from here, so pace them in user space
+  // too; with fq the two agree.
+  pacer_ = new Pacer(bytes_per_second);
+  pacing_mode_ = kernel && type() == SOCKETTYPE_TCP ? PACING_KERNEL
+                                                    : PACING_USER_SPACE;
+  LOG(VERBOSE, "Pacing at %llu bit/s in %s.",
+      static_cast<unsigned long long>(bits_per_second),
+      pacing_mode_ == PACING_KERNEL ? "the kernel" : "user space");
+  return pacing_mode_;
+}
+
+bool Socket::PaceSend(ssize_t* num_bytes) const {
+  if (pacing_mode_ != PACING_USER_SPACE || pacer_->DelayUs() == 0)
+    return true;
+
+  if (IsNonBlocking()) {
+    if (num_bytes != NULL)
+      *num_bytes = -1;
+    errno = EAGAIN;
+    return false;
+  }
+  pacer_->Wait();
+  return true;
+}
+
+void Socket::PacedSent(ssize_t num_bytes) const {
+  if (pacer_ != NULL && num_bytes > 0)
+    pacer_->Sent(num_bytes);
+}
+
+bool Socket::ReadPacing(uint64_t* bytes, uint64_t* elapsed_us) const {
+  if (pacer_ == NULL)
+    return false;
+  pacer_->ReadInterval(bytes, elapsed_us);
+  return true;
+}
+
+void Socket::ApplyOptions(const SocketOptions& options) {
+  ASSERT(fd_ != -1);
+
+  int honored = 0;
+  const bool tcp = type() == SOCKETTYPE_TCP;
+  if (options.has(SOCKETOPTION_NODELAY) && tcp &&
+      SetIntOption(fd_, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY",
+                   options.nodelay() ? 1 : 0)) {
+    honored |= SOCKETOPTION_NODELAY;
+  }
+#if defined(TCP_CORK)
+  if (options.has(SOCKETOPTION_CORK) && tcp &&
+      SetIntOption(fd_, IPPROTO_TCP, TCP_CORK, "TCP_CORK",
+                   options.cork() ? 1 : 0)) {
+    honored |= SOCKETOPTION_CORK;
+  }
+#elif defined(TCP_NOPUSH)
+  if (options.has(SOCKETOPTION_CORK) && tcp &&
+      SetIntOption(fd_, IPPROTO_TCP, TCP_NOPUSH, "TCP_NOPUSH",
+                   options.cork() ? 1 : 0)) {
+    honored |= SOCKETOPTION_CORK;
+  }
+#endif
+#if defined(TCP_NOTSENT_LOWAT)
+  if (options.has(SOCKETOPTION_NOTSENT_LOWAT) && tcp &&
+      SetIntOption(fd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, "TCP_NOTSENT_LOWAT",
+                   options.notsent_lowat())) {
+    honored |= SOCKETOPTION_NOTSENT_LOWAT;
+  }
+#endif
+#if defined(TCP_CONGESTION)
+  if (options.has(SOCKETOPTION_CONGESTION) && tcp) {
+    const std::string& algorithm = options.congestion();
+    char actual[32] = { 0 };
+    socklen_t actual_len = sizeof(actual) - 1;
+    if (setsockopt(fd_, IPPROTO_TCP, TCP_CONGESTION, algorithm.c_str(),
+                   algorithm.length()) < 0) {
+      LOG(WARNING, "Failed to set TCP_CONGESTION to %s: %s [%d]",
+          algorithm.c_str(), strerror(errno), errno);
+    } else if (getsockopt(fd_, IPPROTO_TCP, TCP_CONGESTION, actual,
+                          &actual_len) == 0 && algorithm == actual) {
+      honored |= SOCKETOPTION_CONGESTION;
+    }
+  }
+#endif
+#if defined(SO_BUSY_POLL)
+  if (options.has(SOCKETOPTION_BUSY_POLL) &&
+      SetIntOption(fd_, SOL_SOCKET, SO_BUSY_POLL, "SO_BUSY_POLL",
+                   options.busy_poll_us())) {
+    honored |= SOCKETOPTION_BUSY_POLL;
+  }
+#endif
+#if defined(SO_PRIORITY)
+  if (options.has(SOCKETOPTION_PRIORITY) &&
+      SetIntOption(fd_, SOL_SOCKET, SO_PRIORITY, "SO_PRIORITY",
+                   options.priority())) {
+    honored |= SOCKETOPTION_PRIORITY;
+  }
+#endif
+  if (options.has(SOCKETOPTION_SEND_BUFFER) &&
+      SetSendBufferSize(options.send_buffer_size())) {
+    honored |= SOCKETOPTION_SEND_BUFFER;
+  }
+  if (options.has(SOCKETOPTION_RECV_BUFFER) &&
+      SetRecvBufferSize(options.recv_buffer_size())) {
+    honored |= SOCKETOPTION_RECV_BUFFER;
+  }
+  if (options.has(SOCKETOPTION_SEND_TIMEOUT) &&
+      SetSendTimeout(options.send_timeout_ms())) {
+    honored |= SOCKETOPTION_SEND_TIMEOUT;
+  }
+  if (options.has(SOCKETOPTION_RECV_TIMEOUT) &&
+      SetRecvTimeout(options.recv_timeout_ms())) {
+    honored |= SOCKETOPTION_RECV_TIMEOUT;
+  }
+
+  honored_options_ = honored;
+  if (honored != options.options()) {
+    LOG(WARNING, "Socket %d honored options 0x%x of 0x%x.", fd_, honored,
+        options.options());
+  }
+}
+
 void Socket::CreateSocket() {
   ASSERT(fd_ == -1);
   // LOG(VERBOSE, "Creating %s socket.", type_ == SOCK_STREAM ? "TCP" : "UDP");
@@ -127,6 +834,480 @@ void Socket::CreateSocket() {
   }
 }
 
+// static
+size_t Socket::IOVecLength(const iovec* iov, size_t iovcnt) {
+  size_t length = 0;
+  for (size_t i = 0; i < iovcnt; ++i)
+    length += iov[i].iov_len;
+  return length;
+}
+
+bool Socket::SendDatagrams(Datagram* datagrams, size_t count, bool use_peer,
+                           size_t* num_datagrams) const {
+  ASSERT(fd_ != -1);
+  ASSERT(num_datagrams != NULL);
+
+  *num_datagrams = 0;
+  if (type() != SOCKETTYPE_UDP) {
+    LOG(ERROR, "Batched send is only supported on UDP sockets.");
+    return false;
+  }
+
+  size_t sent = 0;
+  while (sent < count) {
+    if (!PaceSend(NULL))
+      break;
+    size_t batch = std::min(count - sent, kMaxDatagramsPerCall);
+    if (pacing_mode_ == PACING_USER_SPACE) {
+      // Only as many datagrams as the bucket holds. The first always goes,
+      // and may overdraw it, as a single send would.
+      const uint64_t available = pacer_->AvailableBytes();
+      uint64_t bytes = datagrams[sent].length;
+      size_t allowed = 1;
+      while (allowed < batch &&
+             bytes + datagrams[sent + allowed].length <= available) {
+        bytes += datagrams[sent + allowed].length;
+        ++allowed;
+      }
+      batch = allowed;
+    }
+    iovec iov[kMaxDatagramsPerCall];
+#if defined(OS_LINUX)
+    mmsghdr msgs[kMaxDatagramsPerCall];
+    DatagramControl control[kMaxDatagramsPerCall];
+    for (size_t i = 0; i < batch; ++i) {
+      ASSERT(!use_peer || datagrams[sent + i].peer_len != 0);
+      InitDatagramHeader(&datagrams[sent + i], use_peer, &iov[i],
+                         &msgs[i].msg_hdr);
+      SetSegmentControl(datagrams[sent + i], &control[i], &msgs[i].msg_hdr);
+      msgs[i].msg_len = 0;
+    }
+
+    int num;
+    while ((num = sendmmsg(fd_, msgs, batch, send_flags_)) == -1 &&
+           errno == EINTR) { }
+    if (num < 0) {
+      LOG(SOCKET_ERROR_SEVERITY, "Failed to sendmmsg: %s [%d]",
+          strerror(errno), errno);
+      break;
+    }
+    for (int i = 0; i < num; ++i)
+      datagrams[sent + i].num_bytes = msgs[i].msg_len;
+#else
+    size_t num = 0;
+    for (; num < batch; ++num) {
+      Datagram* datagram = &datagrams[sent + num];
+      msghdr msg;
+      InitDatagramHeader(datagram, use_peer, &iov[num], &msg);
+      while ((datagram->num_bytes = sendmsg(fd_, &msg, send_flags_)) == -1 &&
+             errno == EINTR) { }
+      if (datagram->num_bytes < 0) {
+        LOG(ERROR, "Failed to sendmsg: %s [%d]", strerror(errno), errno);
+        break;
+      }
+    }
+#endif
+    for (size_t i = 0; i < static_cast<size_t>(num); ++i)
+      PacedSent(datagrams[sent + i].num_bytes);
+    sent += num;
+    if (static_cast<size_t>(num) < batch)
+      break;
+  }
+
+  LOG(VERBOSE, "Sent %zu of %zu datagrams.", sent, count);
+  *num_datagrams = sent;
+  return sent > 0 || count == 0;
+}
+
+bool Socket::ReceiveDatagrams(Datagram* datagrams, size_t count,
+                              size_t* num_datagrams) const {
+  ASSERT(fd_ != -1);
+  ASSERT(num_datagrams != NULL);
+
+  *num_datagrams = 0;
+  if (type() == SOCKETTYPE_TCP) {
+    LOG(ERROR, "Batched receive is not supported on TCP sockets.");
+    return false;
+  }
+
+  const size_t batch = std::min(count, kMaxDatagramsPerCall);
+  iovec iov[kMaxDatagramsPerCall];
+#if defined(OS_LINUX)
+  mmsghdr msgs[kMaxDatagramsPerCall];
+  DatagramControl control[kMaxDatagramsPerCall];
+  for (size_t i = 0; i < batch; ++i) {
+    datagrams[i].peer_len = sizeof(sockaddr_storage);
+    InitDatagramHeader(&datagrams[i], true, &iov[i], &msgs[i].msg_hdr);
+    msgs[i].msg_hdr.msg_control = control[i].buffer;
+    msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buffer);
+    msgs[i].msg_len = 0;
+  }
+
+  int num;
+  while ((num = recvmmsg(fd_, msgs, batch, MSG_WAITFORONE, NULL)) == -1 &&
+         errno == EINTR) { }
+  if (num < 0) {
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to recvmmsg: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+  for (int i = 0; i < num; ++i) {
+    datagrams[i].num_bytes = msgs[i].msg_len;
+    datagrams[i].peer_len = msgs[i].msg_hdr.msg_namelen;
+    datagrams[i].segment_size = GetSegmentControl(&msgs[i].msg_hdr);
+    datagrams[i].timestamp = PacketTimestamp();
+    GetTimestampControl(&msgs[i].msg_hdr, &datagrams[i].timestamp);
+  }
+#else
+  size_t num = 0;
+  for (; num < batch; ++num) {
+    Datagram* datagram = &datagrams[num];
+    datagram->peer_len = sizeof(sockaddr_storage);
+    msghdr msg;
+    InitDatagramHeader(datagram, true, &iov[num], &msg);
+    // Only wait for the first datagram, then take whatever is queued.
+    const int flags = num == 0 ? 0 : MSG_DONTWAIT;
+    while ((datagram->num_bytes = recvmsg(fd_, &msg, flags)) == -1 &&
+           errno == EINTR) { }
+    if (datagram->num_bytes < 0) {
+      if (num == 0) {
+        LOG(ERROR, "Failed to recvmsg: %s [%d]", strerror(errno), errno);
+        return false;
+      }
+      break;
+    }
+    datagram->peer_len = msg.msg_namelen;
+    datagram->segment_size = 0;
+    datagram->timestamp = PacketTimestamp();
+  }
+#endif
+
+  LOG(VERBOSE, "Received %d datagrams.", static_cast<int>(num));
+  *num_datagrams = num;
+  return true;
+}
+
+bool Socket::SetSegmentationOffload(uint16_t segment_size) const {
+  ASSERT(fd_ != -1);
+
+  if (type() != SOCKETTYPE_UDP) {
+    LOG(ERROR, "Segmentation offload is only supported on UDP sockets.");
+    return false;
+  }
+
+#if defined(OS_LINUX)
+  int size = segment_size;
+  if (setsockopt(fd_, SOL_UDP, UDP_SEGMENT, &size, sizeof(size)) < 0) {
+    LOG(ERROR, "Failed to set UDP_SEGMENT: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+
+  int gro = segment_size != 0 ? 1 : 0;
+  if (setsockopt(fd_, SOL_UDP, UDP_GRO, &gro, sizeof(gro)) < 0) {
+    LOG(ERROR, "Failed to set UDP_GRO: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+
+  LOG(VERBOSE, "UDP segmentation offload set to %u", segment_size);
+  return true;
+#else
+  LOG(ERROR, "UDP segmentation offload is not supported on this platform.");
+  return false;
+#endif
+}
+
+bool Socket::SetZeroCopy() const {
+  ASSERT(fd_ != -1);
+
+  if (type() != SOCKETTYPE_TCP) {
+    LOG(ERROR, "Zero-copy send is only supported on TCP sockets.");
+    return false;
+  }
+
+#if defined(OS_LINUX)
+  int on = 1;
+  if (setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+    LOG(ERROR, "Failed to set SO_ZEROCOPY: %s [%d]", strerror(errno), errno);
+    return false;
+  }
+  zerocopy_enabled_ = true;
+  return true;
+#else
+  LOG(ERROR, "Zero-copy send is not supported on this platform.");
+  return false;
+#endif
+}
+
+bool Socket::SendZeroCopyBuffer(const void* buffer, size_t length,
+                                const Packet& hold, ssize_t* num_bytes,
+                                uint32_t* send_id) const {
+  ASSERT(fd_ != -1);
+  ASSERT(length > 0);
+
+  if (!zerocopy_enabled_) {
+    LOG(ERROR, "Zero-copy send has not been enabled.");
+    return false;
+  }
+
+#if defined(OS_LINUX)
+  const int flags = MSG_ZEROCOPY | send_flags_;
+  ssize_t num;
+  while ((num = send(fd_, buffer, length, flags)) == -1 && errno == EINTR) { }
+  if (num_bytes != NULL)
+    *num_bytes = num;
+
+  if (num < 0) {
+    // ENOBUFS means too many sends are outstanding; reap and try again.
+    LOG(SOCKET_ERROR_SEVERITY, "Failed to send zero-copy: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+
+  if (static_cast<size_t>(num) != length) {
+    LOG(VERBOSE, "Tried to send %zu bytes; sent %zd bytes.", length, num);
+  }
+
+  // The kernel numbers each successful MSG_ZEROCOPY send in sequence.
+  ZeroCopySend pending = { zerocopy_next_id_, false, hold };
+  zerocopy_pending_.push_back(pending);
+  if (send_id != NULL)
+    *send_id = zerocopy_next_id_;
+  ++zerocopy_next_id_;
+  return true;
+#else
+  LOG(ERROR, "Zero-copy send is not supported on this platform.");
+  return false;
+#endif
+}
+
+size_t Socket::ReapZeroCopy(bool block) const {
+  ASSERT(fd_ != -1);
+
+#if defined(OS_LINUX)
+  bool reaped = false;
+  bool polled = false;
+  while (!zerocopy_pending_.empty()) {
+    union {
+      char buffer[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+      cmsghdr align;
+    } control;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    if (recvmsg(fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG(ERROR, "Failed to read error queue: %s [%d]",
+            strerror(errno), errno);
+        break;
+      }
+      if (!block || reaped)
+        break;
+
+      if (polled) {
+        // Woken without a notification, so a socket error is pending instead.
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &error_len);
+        if (error != 0) {
+          LOG(ERROR, "Socket error while waiting for zero-copy: %s [%d]",
+              strerror(error), error);
+          break;
+        }
+      }
+
+      // The error queue becoming readable is signalled as POLLERR.
+      pollfd fds = { fd_, 0, 0 };
+      while (poll(&fds, 1, -1) == -1 && errno == EINTR) { }
+      if (fds.revents & POLLNVAL)
+        break;
+      polled = true;
+      continue;
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+      if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0)
+        continue;
+
+      // ee_info to ee_data is the inclusive range of completed sends.
+      CompleteZeroCopy(err.ee_info, err.ee_data);
+      reaped = true;
+    }
+  }
+#else
+  (void) block;
+#endif
+
+  return zerocopy_pending_.size();
+}
+
+bool Socket::ZeroCopySendComplete(uint32_t send_id) const {
+  if (zerocopy_pending_.empty())
+    return static_cast<int32_t>(send_id - zerocopy_next_id_) < 0;
+
+  const uint32_t index = send_id - zerocopy_pending_.front().id;
+  if (static_cast<int32_t>(index) < 0)
+    return true;
+  if (index >= zerocopy_pending_.size())
+    return false;
+  return zerocopy_pending_[index].done;
+}
+
+bool Socket::SetTimestamping(bool hardware) const {
+  ASSERT(fd_ != -1);
+
+  if (type() == SOCKETTYPE_TCP) {
+    LOG(ERROR, "Timestamping is only supported on datagram sockets.");
+    return false;
+  }
+
+#if defined(OS_LINUX)
+  // OPT_ID numbers the sends, and OPT_TSONLY keeps the kernel from looping
+  // each sent packet back with its timestamp.
+  int flags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+              SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+              SOF_TIMESTAMPING_OPT_TSONLY;
+  if (hardware) {
+    flags |= SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE |
+             SOF_TIMESTAMPING_TX_HARDWARE;
+  }
+  if (setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                 sizeof(flags)) < 0) {
+    LOG(ERROR, "Failed to set SO_TIMESTAMPING: %s [%d]",
+        strerror(errno), errno);
+    return false;
+  }
+  LOG(VERBOSE, "Timestamping enabled%s.", hardware ? " with hardware" : "");
+  return true;
+#else
+  (void) hardware;
+  LOG(ERROR, "Timestamping is not supported on this platform.");
+  return false;
+#endif
+}
+
+bool Socket::ReadSendTimestamp(PacketTimestamp* timestamp,
+                               int timeout_ms) const {
+  ASSERT(fd_ != -1);
+  ASSERT(timestamp != NULL);
+
+#if defined(OS_LINUX)
+  const uint64_t deadline =
+      MonotonicNowMs() + (timeout_ms > 0 ? timeout_ms : 0);
+  bool polled = false;
+  while (true) {
+    union {
+      char buffer[CMSG_SPACE(sizeof(scm_timestamping)) +
+                  CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+      cmsghdr align;
+    } control;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    if (recvmsg(fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG(ERROR, "Failed to read error queue: %s [%d]",
+            strerror(errno), errno);
+        return false;
+      }
+
+      if (polled) {
+        // Woken without a timestamp, so a socket error is pending instead.
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &error_len);
+        if (error != 0) {
+          LOG(ERROR, "Socket error while waiting for timestamp: %s [%d]",
+              strerror(error), error);
+          return false;
+        }
+      }
+
+      int wait = -1;
+      if (timeout_ms >= 0) {
+        const uint64_t now = MonotonicNowMs();
+        if (now >= deadline)
+          break;
+        wait = deadline - now;
+      }
+
+      // The error queue becoming readable is signalled as POLLERR.
+      pollfd entry = { fd_, 0, 0 };
+      int ready;
+      while ((ready = poll(&entry, 1, wait)) == -1 && errno == EINTR) { }
+      if (ready <= 0 || (entry.revents & POLLNVAL))
+        break;
+      polled = true;
+      continue;
+    }
+
+    PacketTimestamp found;
+    bool has_id = false;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+      if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+        found.id = err.ee_data;
+        has_id = true;
+      } else if (err.ee_origin == SO_EE_ORIGIN_ZEROCOPY && err.ee_errno == 0) {
+        // Both share the error queue; don't lose a zero-copy completion.
+        CompleteZeroCopy(err.ee_info, err.ee_data);
+      }
+    }
+    if (has_id && GetTimestampControl(&msg, &found)) {
+      *timestamp = found;
+      return true;
+    }
+  }
+
+  LOG(VERBOSE, "No send timestamp within %d ms.", timeout_ms);
+  return false;
+#else
+  (void) timeout_ms;
+  LOG(ERROR, "Timestamping is not supported on this platform.");
+  return false;
+#endif
+}
+
+void Socket::CompleteZeroCopy(uint32_t first_id, uint32_t last_id) const {
+  LOG(VERBOSE, "Zero-copy sends %u to %u complete.", first_id, last_id);
+  for (uint32_t id = first_id; ; ++id) {
+    if (zerocopy_pending_.empty())
+      break;
+
+    const uint32_t index = id - zerocopy_pending_.front().id;
+    if (index < zerocopy_pending_.size()) {
+      zerocopy_pending_[index].done = true;
+      zerocopy_pending_[index].packet = Packet();
+    }
+    if (id == last_id)
+      break;
+  }
+
+  // Completions normally arrive in order; release everything at the front.
+  while (!zerocopy_pending_.empty() && zerocopy_pending_.front().done)
+    zerocopy_pending_.pop_front();
+}
+
 void Socket::DestroySocket() {
   if (fd_ != -1) {
 #if defined(OS_ANDROID) || defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_FREEBSD)
@@ -205,4 +1386,26 @@ size_t Socket::GetBufferSize(BufferType type) const {
   LOG(FATAL, "unknown buffer type.");
   return -1;
 }
+
+bool Socket::SetTimeoutOption(int name, uint32_t timeout_ms) const {
+  ASSERT(fd_ != -1);
+
+#if defined(OS_WINDOWS)
+  DWORD timeout = timeout_ms;
+#else
+  timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+#endif
+  // setsockopt on posix takes a const void* and on Windows takes a
+  // const char*. Cast to the lesser of two evils.
+  if (setsockopt(fd_, SOL_SOCKET, name, (const char*) &timeout,
+                 sizeof(timeout)) == -1) {
+    LOG(ERROR, "Failed to set %s timeout to %u ms: %s [%d]",
+        name == SO_SNDTIMEO ? "send" : "receive", timeout_ms,
+        strerror(errno), errno);
+    return false;
+  }
+  return true;
+}
 }  // namespace mlab
@@ -0,0 +1,190 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/socket_filter.h"
+
+// Only where |RawSocket::AttachFilter| can attach the programs with
+// SO_ATTACH_FILTER; BSD raw sockets take no BPF programs.
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <linux/filter.h>
+#define HAVE_CLASSIC_BPF
+#endif
+#include <string.h>
+
+#include "log.h"
+
+namespace mlab {
+namespace {
+const uint8_t kEchoReply = 0;
+const uint8_t kDestinationUnreachable = 3;
+const uint8_t kTimeExceeded = 11;
+const uint8_t kEcho6Reply = 129;
+const uint8_t kDestination6Unreachable = 1;
+const uint8_t kTime6Exceeded = 3;
+const uint8_t kUDP = 17;
+
+// An ICMP header, and where the next header and UDP source port are in the
+// IPv6 header and datagram quoted after it.
+const uint32_t kICMPHeaderLength = 8;
+const uint32_t kIP6NextHeader = 6;
+const uint32_t kIP6HeaderLength = 40;
+
+#if defined(HAVE_CLASSIC_BPF)
+// Jump targets, resolved to offsets by |Finish|. Others are literal offsets.
+const uint8_t kAccept = 0xfe;
+const uint8_t kDrop = 0xff;
+
+// Builds a program that ends in accepting or dropping the packet.
+class ProgramBuilder {
+ public:
+  void Statement(uint16_t code, uint32_t k) {
+    Add(code, 0, 0, k);
+  }
+  void Jump(uint16_t code, uint32_t k, uint8_t jump_true, uint8_t jump_false) {
+    Add(code, jump_true, jump_false, k);
+  }
+
+  // Accepts if the accumulator is in the range, and drops otherwise.
+  void AcceptInRange(uint16_t first, uint16_t last) {
+    if (first <= last)
+      Jump(BPF_JMP | BPF_JGE | BPF_K, first, 0, kDrop);
+    else
+      Jump(BPF_JMP | BPF_JGE | BPF_K, first, kAccept, 0);
+    Jump(BPF_JMP | BPF_JGT | BPF_K, last, kDrop, kAccept);
+  }
+
+  FilterProgram Finish() {
+    const size_t accept = program_.size();
+    Statement(BPF_RET | BPF_K, 0xffffffff);
+    const size_t drop = program_.size();
+    Statement(BPF_RET | BPF_K, 0);
+    for (size_t i = 0; i < accept; ++i) {
+      if (BPF_CLASS(program_[i].code) != BPF_JMP)
+        continue;
+      program_[i].jump_true = Resolve(program_[i].jump_true, i, accept, drop);
+      program_[i].jump_false =
+          Resolve(program_[i].jump_false, i, accept, drop);
+    }
+    return program_;
+  }
+
+ private:
+  void Add(uint16_t code, uint8_t jump_true, uint8_t jump_false, uint32_t k) {
+    FilterInstruction instruction;
+    instruction.code = code;
+    instruction.jump_true = jump_true;
+    instruction.jump_false = jump_false;
+    instruction.k = k;
+    program_.push_back(instruction);
+  }
+
+  static uint8_t Resolve(uint8_t target, size_t from, size_t accept,
+                         size_t drop) {
+    if (target == kAccept)
+      return accept - from - 1;
+    if (target == kDrop)
+      return drop - from - 1;
+    return target;
+  }
+
+  FilterProgram program_;
+};
+#endif
+}  // namespace
+
+FilterProgram EchoReplyFilter(SocketFamily family, uint16_t first_id,
+                              uint16_t last_id) {
+  ASSERT(family == SOCKETFAMILY_IPV4 || family == SOCKETFAMILY_IPV6);
+#if defined(HAVE_CLASSIC_BPF)
+  ProgramBuilder builder;
+  if (family == SOCKETFAMILY_IPV4) {
+    // IPv4 raw sockets see the IP header; find the ICMP header after it.
+    builder.Statement(BPF_LDX | BPF_B | BPF_MSH, 0);
+    builder.Statement(BPF_LD | BPF_B | BPF_IND, 0);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kEchoReply, 0, kDrop);
+    builder.Statement(BPF_LD | BPF_H | BPF_IND, 4);
+  } else {
+    // IPv6 raw sockets start at the ICMPv6 header.
+    builder.Statement(BPF_LD | BPF_B | BPF_ABS, 0);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kEcho6Reply, 0, kDrop);
+    builder.Statement(BPF_LD | BPF_H | BPF_ABS, 4);
+  }
+  builder.AcceptInRange(first_id, last_id);
+  return builder.Finish();
+#else
+  return FilterProgram();
+#endif
+}
+
+FilterProgram UDPErrorFilter(SocketFamily family, uint16_t first_port,
+                             uint16_t last_port) {
+  ASSERT(family == SOCKETFAMILY_IPV4 || family == SOCKETFAMILY_IPV6);
+#if defined(HAVE_CLASSIC_BPF)
+  ProgramBuilder builder;
+  if (family == SOCKETFAMILY_IPV4) {
+    builder.Statement(BPF_LDX | BPF_B | BPF_MSH, 0);
+    builder.Statement(BPF_LD | BPF_B | BPF_IND, 0);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kTimeExceeded, 1, 0);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kDestinationUnreachable, 0, kDrop);
+    // The quoted IP header's protocol, then its length, to find the ports.
+    builder.Statement(BPF_LD | BPF_B | BPF_IND, kICMPHeaderLength + 9);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kUDP, 0, kDrop);
+    builder.Statement(BPF_LD | BPF_B | BPF_IND, kICMPHeaderLength);
+    builder.Statement(BPF_ALU | BPF_AND | BPF_K, 0x0f);
+    builder.Statement(BPF_ALU | BPF_LSH | BPF_K, 2);
+    builder.Statement(BPF_ALU | BPF_ADD | BPF_X, 0);
+    builder.Statement(BPF_MISC | BPF_TAX, 0);
+    builder.Statement(BPF_LD | BPF_H | BPF_IND, kICMPHeaderLength);
+  } else {
+    builder.Statement(BPF_LD | BPF_B | BPF_ABS, 0);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kTime6Exceeded, 1, 0);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kDestination6Unreachable, 0,
+                 kDrop);
+    builder.Statement(BPF_LD | BPF_B | BPF_ABS,
+                      kICMPHeaderLength + kIP6NextHeader);
+    builder.Jump(BPF_JMP | BPF_JEQ | BPF_K, kUDP, 0, kDrop);
+    builder.Statement(BPF_LD | BPF_H | BPF_ABS,
+                      kICMPHeaderLength + kIP6HeaderLength);
+  }
+  builder.AcceptInRange(first_port, last_port);
+  return builder.Finish();
+#else
+  return FilterProgram();
+#endif
+}
+
+ICMP6Filter::ICMP6Filter() {
+  BlockAll();
+  Pass(kEcho6Reply);
+  Pass(kTime6Exceeded);
+  Pass(kDestination6Unreachable);
+}
+
+void ICMP6Filter::PassAll() {
+  memset(pass_, 0xff, sizeof(pass_));
+}
+
+void ICMP6Filter::BlockAll() {
+  memset(pass_, 0, sizeof(pass_));
+}
+
+void ICMP6Filter::Pass(uint8_t type) {
+  pass_[type >> 5] |= 1U << (type & 31);
+}
+
+void ICMP6Filter::Block(uint8_t type) {
+  pass_[type >> 5] &= ~(1U << (type & 31));
+}
+
+}  // namespace mlab
@@ -0,0 +1,299 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/tcp_info_sampler.h"
+
+#if defined(OS_LINUX)
+// The kernel's tcp_info is newer than the C library's, with the rate fields.
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "clock.h"
+#include "log.h"
+#include "mlab/socket.h"
+
+namespace mlab {
+
+// static
+TcpInfoSampler* TcpInfoSampler::Create(uint32_t interval_ms,
+                                       size_t capacity) {
+  ASSERT(interval_ms > 0);
+  ASSERT(capacity > 0);
+
+#if defined(OS_LINUX)
+  return new TcpInfoSampler(interval_ms, capacity);
+#else
+  LOG(ERROR, "TCP_INFO sampling is not supported on this platform.");
+  return NULL;
+#endif
+}
+
+// static
+TcpInfoSampler* TcpInfoSampler::CreateOrDie(uint32_t interval_ms,
+                                            size_t capacity) {
+  TcpInfoSampler* sampler = Create(interval_ms, capacity);
+  if (!sampler)
+    LOG(FATAL, "Failed to create TCP_INFO sampler.");
+  return sampler;
+}
+
+TcpInfoSampler::TcpInfoSampler(uint32_t interval_ms, size_t capacity)
+    : interval_ms_(interval_ms),
+      num_flows_(0),
+      ring_(capacity),
+      head_(0),
+      size_(0),
+      overwritten_(0),
+      loop_(NULL),
+      timer_id_(0),
+      thread_running_(false),
+      stopping_(false) {
+  pthread_mutex_init(&lock_, NULL);
+
+  // Wait against the monotonic clock so wall clock steps don't stall the
+  // thread.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+#if defined(OS_LINUX)
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+  pthread_cond_init(&wake_, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+TcpInfoSampler::~TcpInfoSampler() {
+  Stop();
+  pthread_cond_destroy(&wake_);
+  pthread_mutex_destroy(&lock_);
+}
+
+uint32_t TcpInfoSampler::Add(const Socket* socket) {
+  ASSERT(socket != NULL);
+  ASSERT(socket->type() == SOCKETTYPE_TCP);
+
+  pthread_mutex_lock(&lock_);
+  uint32_t flow;
+  if (!free_flows_.empty()) {
+    flow = free_flows_.back();
+    free_flows_.pop_back();
+    flows_[flow] = socket;
+  } else {
+    flow = flows_.size();
+    flows_.push_back(socket);
+  }
+  ++num_flows_;
+  pthread_mutex_unlock(&lock_);
+
+  LOG(VERBOSE, "Sampling socket %d as flow %u.", socket->raw(), flow);
+  return flow;
+}
+
+void TcpInfoSampler::Remove(uint32_t flow) {
+  pthread_mutex_lock(&lock_);
+  ASSERT(flow < flows_.size() && flows_[flow] != NULL);
+  flows_[flow] = NULL;
+  free_flows_.push_back(flow);
+  --num_flows_;
+  pthread_mutex_unlock(&lock_);
+}
+
+size_t TcpInfoSampler::SampleNow() {
+  const uint64_t now_us = MonotonicNowUs();
+  size_t taken = 0;
+
+  pthread_mutex_lock(&lock_);
+  for (size_t i = 0; i < flows_.size(); ++i) {
+    if (flows_[i] != NULL && Sample(i, flows_[i], now_us))
+      ++taken;
+  }
+  pthread_mutex_unlock(&lock_);
+  return taken;
+}
+
+bool TcpInfoSampler::Sample(uint32_t flow, const Socket* socket,
+                            uint64_t now_us) {
+#if defined(OS_LINUX)
+  // Older kernels fill in less; the rest stays zero.
+  tcp_info info;
+  memset(&info, 0, sizeof(info));
+  socklen_t info_len = sizeof(info);
+  if (getsockopt(socket->raw(), IPPROTO_TCP, TCP_INFO, &info,
+                 &info_len) < 0) {
+    LOG(VERBOSE, "Failed to get TCP_INFO for flow %u: %s [%d]", flow,
+        strerror(errno), errno);
+    return false;
+  }
+
+  TcpInfoSample* sample = &ring_[head_];
+  sample->time_us = now_us;
+  sample->flow = flow;
+  sample->state = info.tcpi_state;
+  sample->ca_state = info.tcpi_ca_state;
+  sample->snd_cwnd = info.tcpi_snd_cwnd;
+  sample->snd_ssthresh = info.tcpi_snd_ssthresh;
+  sample->snd_mss = info.tcpi_snd_mss;
+  sample->rtt_us = info.tcpi_rtt;
+  sample->rttvar_us = info.tcpi_rttvar;
+  sample->unacked = info.tcpi_unacked;
+  sample->lost = info.tcpi_lost;
+  sample->total_retrans = info.tcpi_total_retrans;
+  sample->delivery_rate = info.tcpi_delivery_rate;
+  sample->pacing_rate = info.tcpi_pacing_rate;
+  sample->bytes_acked = info.tcpi_bytes_acked;
+  sample->bytes_received = info.tcpi_bytes_received;
+
+  head_ = (head_ + 1) % ring_.size();
+  if (size_ == ring_.size())
+    ++overwritten_;
+  else
+    ++size_;
+  return true;
+#else
+  (void) flow;
+  (void) socket;
+  (void) now_us;
+  return false;
+#endif
+}
+
+bool TcpInfoSampler::Start(EventLoop* loop) {
+  ASSERT(loop != NULL);
+
+  if (loop_ != NULL || thread_running_) {
+    LOG(ERROR, "TCP_INFO sampler is already running.");
+    return false;
+  }
+  loop_ = loop;
+  timer_id_ = loop_->AddTimer(interval_ms_, this);
+  return true;
+}
+
+bool TcpInfoSampler::StartThread() {
+  if (loop_ != NULL || thread_running_) {
+    LOG(ERROR, "TCP_INFO sampler is already running.");
+    return false;
+  }
+
+  stopping_ = false;
+  int error = pthread_create(&thread_, NULL, &TcpInfoSampler::RunThread, this);
+  if (error != 0) {
+    LOG(ERROR, "Failed to start sampler thread: %s [%d]", strerror(error),
+        error);
+    return false;
+  }
+  thread_running_ = true;
+  return true;
+}
+
+void TcpInfoSampler::Stop() {
+  if (loop_ != NULL) {
+    loop_->CancelTimer(timer_id_);
+    loop_ = NULL;
+  }
+
+  if (thread_running_) {
+    pthread_mutex_lock(&lock_);
+    stopping_ = true;
+    pthread_cond_signal(&wake_);
+    pthread_mutex_unlock(&lock_);
+    pthread_join(thread_, NULL);
+    thread_running_ = false;
+  }
+}
+
+void TcpInfoSampler::OnTimer(uint32_t) {
+  // Rearm first so the time spent sampling doesn't stretch the interval.
+  timer_id_ = loop_->AddTimer(interval_ms_, this);
+  SampleNow();
+}
+
+// static
+void* TcpInfoSampler::RunThread(void* sampler) {
+  TcpInfoSampler* self = static_cast<TcpInfoSampler*>(sampler);
+
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  pthread_mutex_lock(&self->lock_);
+  while (!self->stopping_) {
+    // Deadlines advance by whole intervals, so samples don't drift, unless
+    // sampling has fallen more than an interval behind.
+    deadline.tv_nsec += (self->interval_ms_ % 1000) * 1000000;
+    deadline.tv_sec += self->interval_ms_ / 1000 +
+                       deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (deadline.tv_sec < now.tv_sec ||
+        (deadline.tv_sec == now.tv_sec && deadline.tv_nsec < now.tv_nsec)) {
+      deadline = now;
+    }
+    while (!self->stopping_ &&
+           pthread_cond_timedwait(&self->wake_, &self->lock_,
+                                  &deadline) != ETIMEDOUT) { }
+    if (self->stopping_)
+      break;
+
+    pthread_mutex_unlock(&self->lock_);
+    self->SampleNow();
+    pthread_mutex_lock(&self->lock_);
+  }
+  pthread_mutex_unlock(&self->lock_);
+  return NULL;
+}
+
+size_t TcpInfoSampler::Read(TcpInfoSample* samples, size_t count) {
+  ASSERT(samples != NULL);
+
+  pthread_mutex_lock(&lock_);
+  const size_t num = std::min(count, size_);
+  size_t tail = (head_ + ring_.size() - size_) % ring_.size();
+  for (size_t i = 0; i < num; ++i) {
+    samples[i] = ring_[tail];
+    tail = (tail + 1) % ring_.size();
+  }
+  size_ -= num;
+  pthread_mutex_unlock(&lock_);
+  return num;
+}
+
+size_t TcpInfoSampler::size() const {
+  pthread_mutex_lock(&lock_);
+  const size_t num = size_;
+  pthread_mutex_unlock(&lock_);
+  return num;
+}
+
+uint64_t TcpInfoSampler::overwritten() const {
+  pthread_mutex_lock(&lock_);
+  const uint64_t num = overwritten_;
+  pthread_mutex_unlock(&lock_);
+  return num;
+}
+
+size_t TcpInfoSampler::num_flows() const {
+  pthread_mutex_lock(&lock_);
+  const size_t num = num_flows_;
+  pthread_mutex_unlock(&lock_);
+  return num;
+}
+
+}  // namespace mlab
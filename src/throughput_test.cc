@@ -0,0 +1,230 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/throughput_test.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "clock.h"
+#include "log.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/listen_socket.h"
+
+namespace mlab {
+namespace {
+// The most moved per send or receive.
+const size_t kTransferSize = 128 * 1024;
+
+double Mbps(uint64_t bytes, uint64_t ms) {
+  return ms == 0 ? 0.0 : bytes * 8.0 / (ms * 1000.0);
+}
+
+void DeleteStreams(std::vector<Socket*>* streams) {
+  for (size_t i = 0; i < streams->size(); ++i)
+    delete (*streams)[i];
+  streams->clear();
+}
+}  // namespace
+
+// static
+ThroughputTest* ThroughputTest::CreateClient(const Host& hostname,
+                                             uint16_t port,
+                                             SocketFamily family,
+                                             size_t num_streams,
+                                             ThroughputDirection direction) {
+  ASSERT(num_streams > 0);
+
+  std::vector<Socket*> streams;
+  for (size_t i = 0; i < num_streams; ++i) {
+    ClientSocket* socket = ClientSocket::Create(hostname, port,
+                                                SOCKETTYPE_TCP, family);
+    if (socket == NULL) {
+      LOG(ERROR, "Failed to open stream %zu of %zu.", i, num_streams);
+      DeleteStreams(&streams);
+      return NULL;
+    }
+    streams.push_back(socket);
+  }
+  return new ThroughputTest(direction, streams);
+}
+
+// static
+ThroughputTest* ThroughputTest::CreateServer(const ListenSocket& listener,
+                                             size_t num_streams,
+                                             ThroughputDirection direction) {
+  ASSERT(num_streams > 0);
+
+  std::vector<Socket*> streams;
+  for (size_t i = 0; i < num_streams; ++i) {
+    AcceptedSocket* socket = listener.Accept();
+    if (socket == NULL) {
+      LOG(ERROR, "Failed to accept stream %zu of %zu.", i, num_streams);
+      DeleteStreams(&streams);
+      return NULL;
+    }
+    streams.push_back(socket);
+  }
+  return new ThroughputTest(direction, streams);
+}
+
+ThroughputTest::ThroughputTest(ThroughputDirection direction,
+                               const std::vector<Socket*>& streams)
+    : direction_(direction),
+      streams_(streams),
+      fds_(new pollfd[streams.size()]),
+      buffer_(kTransferSize, 'x'),
+      elapsed_ms_(0),
+      interval_ms_(0),
+      interval_bytes_(streams.size(), 0),
+      total_bytes_(streams.size(), 0) {
+  for (size_t i = 0; i < streams_.size(); ++i) {
+    fds_[i].fd = streams_[i]->raw();
+    fds_[i].events = direction_ == THROUGHPUT_SEND ? POLLOUT : POLLIN;
+    fds_[i].revents = 0;
+  }
+}
+
+ThroughputTest::~ThroughputTest() {
+  DeleteStreams(&streams_);
+  delete[] fds_;
+}
+
+bool ThroughputTest::Run(uint32_t duration_ms, uint32_t interval_ms,
+                         Observer* observer) {
+  ASSERT(interval_ms > 0);
+
+  // A peer that stops first closes its streams under our sends; they drop
+  // out with EPIPE rather than SIGPIPE taking the process down.
+  for (size_t i = 0; i < streams_.size(); ++i) {
+    if (fds_[i].fd != -1 && (!streams_[i]->SetNonBlocking(true) ||
+                             !streams_[i]->SetNoSigPipe()))
+      return false;
+  }
+
+  const uint64_t start = MonotonicNowMs();
+  const uint64_t end = start + duration_ms;
+  uint64_t interval_start = start;
+  elapsed_ms_ = 0;
+  std::fill(interval_bytes_.begin(), interval_bytes_.end(), 0);
+  std::fill(total_bytes_.begin(), total_bytes_.end(), 0);
+
+  bool ok = true;
+  size_t num_active = 0;
+  for (size_t i = 0; i < streams_.size(); ++i)
+    num_active += active(i) ? 1 : 0;
+
+  while (num_active > 0) {
+    uint64_t now = MonotonicNowMs();
+    if (now >= end)
+      break;
+
+    const uint64_t wake = std::min(end, interval_start + interval_ms);
+    int ready = poll(fds_, streams_.size(), wake > now ? wake - now : 0);
+    if (ready == -1 && errno != EINTR) {
+      LOG(ERROR, "Failed to poll streams: %s [%d]", strerror(errno), errno);
+      ok = false;
+      break;
+    }
+
+    for (size_t i = 0; i < streams_.size() && ready > 0; ++i) {
+      if (fds_[i].fd == -1 || fds_[i].revents == 0)
+        continue;
+      --ready;
+      Transfer(i);
+      if (fds_[i].fd == -1)
+        --num_active;
+    }
+
+    now = MonotonicNowMs();
+    if (now >= interval_start + interval_ms) {
+      elapsed_ms_ = now - start;
+      interval_ms_ = now - interval_start;
+      if (observer != NULL)
+        observer->OnInterval(*this);
+      std::fill(interval_bytes_.begin(), interval_bytes_.end(), 0);
+      interval_start = now;
+    }
+  }
+
+  // Report the final partial interval.
+  const uint64_t now = MonotonicNowMs();
+  elapsed_ms_ = now - start;
+  interval_ms_ = now - interval_start;
+  if (observer != NULL && interval_ms_ > 0)
+    observer->OnInterval(*this);
+
+  for (size_t i = 0; i < streams_.size(); ++i) {
+    if (active(i))
+      streams_[i]->SetNonBlocking(false);
+  }
+  return ok;
+}
+
+void ThroughputTest::Transfer(size_t stream) {
+  Socket* socket = streams_[stream];
+  ssize_t num_bytes = 0;
+  bool ok;
+  if (direction_ == THROUGHPUT_SEND) {
+    ok = socket->SendFrom(&buffer_[0], buffer_.size(), &num_bytes);
+  } else {
+    ok = socket->ReceiveInto(&buffer_[0], buffer_.size(), &num_bytes);
+  }
+
+  if (!ok && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  if (!ok || (direction_ == THROUGHPUT_RECEIVE && num_bytes == 0)) {
+    LOG(VERBOSE, "Stream %zu closed.", stream);
+    fds_[stream].fd = -1;
+    return;
+  }
+  interval_bytes_[stream] += num_bytes;
+  total_bytes_[stream] += num_bytes;
+}
+
+bool ThroughputTest::active(size_t stream) const {
+  return fds_[stream].fd != -1;
+}
+
+uint64_t ThroughputTest::interval_bytes() const {
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < interval_bytes_.size(); ++i)
+    bytes += interval_bytes_[i];
+  return bytes;
+}
+
+uint64_t ThroughputTest::total_bytes() const {
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < total_bytes_.size(); ++i)
+    bytes += total_bytes_[i];
+  return bytes;
+}
+
+double ThroughputTest::IntervalMbps(size_t stream) const {
+  return Mbps(interval_bytes_[stream], interval_ms_);
+}
+
+double ThroughputTest::IntervalMbps() const {
+  return Mbps(interval_bytes(), interval_ms_);
+}
+
+double ThroughputTest::TotalMbps() const {
+  return Mbps(total_bytes(), elapsed_ms_);
+}
+
+}  // namespace mlab
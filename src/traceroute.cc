@@ -0,0 +1,291 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/traceroute.h"
+
+#if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_ANDROID) || defined(OS_FREEBSD)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#elif defined(OS_WINDOWS)
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <process.h>
+#else
+#error Undefined platform
+#endif
+#include <string.h>
+
+#include "clock.h"
+#include "log.h"
+#include "mlab/protocol_header.h"
+#include "mlab/raw_socket.h"
+
+namespace mlab {
+namespace {
+const uint8_t kTimeExceeded = 11;
+const uint8_t kDestinationUnreachable = 3;
+
+// The payload of every probe, so a Paris trace's probes are identical to a
+// load balancer.
+const char kProbePayload[] = "mlab traceroute";
+
+// Where the automatically chosen source ports start, and how many there are.
+const uint16_t kFirstSourcePort = 40000;
+const uint16_t kSourcePorts = 20000;
+
+uint16_t ReadUInt16(const char* p) {
+  uint16_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohs(value);
+}
+
+// A reply to one of the probes of the trace.
+struct Reply {
+  size_t probe;
+  uint8_t icmp_type;
+  uint8_t icmp_code;
+  in_addr responder;
+};
+
+// Match the ICMP error in |packet|, as received on a raw socket with its IP
+// header, to a probe by the headers it quotes. Returns false if it isn't a
+// reply to this trace.
+bool MatchReply(const char* packet, size_t length, const in_addr& target,
+                uint16_t source_port, const TracerouteOptions& options,
+                size_t num_probes, Reply* reply) {
+  if (length < sizeof(IP4Header))
+    return false;
+  const size_t outer_length = (packet[0] & 0x0f) * 4;
+  // The quoted IP header, and at least the first 8 bytes of the datagram.
+  if (length < outer_length + sizeof(ICMP4Header) + sizeof(IP4Header) +
+               sizeof(UDPHeader)) {
+    return false;
+  }
+
+  const char* icmp = packet + outer_length;
+  reply->icmp_type = icmp[0];
+  reply->icmp_code = icmp[1];
+  if (reply->icmp_type != kTimeExceeded &&
+      reply->icmp_type != kDestinationUnreachable) {
+    return false;
+  }
+
+  const char* inner = icmp + sizeof(ICMP4Header);
+  const size_t inner_length = (inner[0] & 0x0f) * 4;
+  if (length < outer_length + sizeof(ICMP4Header) + inner_length +
+               sizeof(UDPHeader)) {
+    return false;
+  }
+  in_addr inner_destination;
+  memcpy(&inner_destination, inner + 16, sizeof(inner_destination));
+  const char* udp = inner + inner_length;
+  if (inner[9] != IPPROTO_UDP ||
+      inner_destination.s_addr != target.s_addr ||
+      ReadUInt16(udp) != source_port) {
+    return false;
+  }
+
+  // Classic probes are told apart by destination port, which survives NAT
+  // rewriting the IP ID; Paris probes share a port, so use the ID.
+  if (options.paris)
+    reply->probe = ReadUInt16(inner + 4) - 1;
+  else
+    reply->probe = ReadUInt16(udp + 2) - options.dest_port;
+  if (reply->probe >= num_probes)
+    return false;
+
+  memcpy(&reply->responder, packet + 12, sizeof(reply->responder));
+  return true;
+}
+}  // namespace
+
+// static
+TracerouteEngine* TracerouteEngine::Create() {
+  RawSocket* probe_socket =
+      RawSocket::Create(SOCKETTYPE_RAW, SOCKETFAMILY_IPV4);
+  if (probe_socket == NULL)
+    return NULL;
+  RawSocket* icmp_socket =
+      RawSocket::Create(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV4);
+  if (icmp_socket == NULL || !probe_socket->SetIPHDRINCL()) {
+    delete icmp_socket;
+    delete probe_socket;
+    return NULL;
+  }
+  return new TracerouteEngine(probe_socket, icmp_socket);
+}
+
+// static
+TracerouteEngine* TracerouteEngine::CreateOrDie() {
+  TracerouteEngine* engine = Create();
+  if (engine == NULL)
+    LOG(FATAL, "Failed to create traceroute engine.");
+  return engine;
+}
+
+TracerouteEngine::~TracerouteEngine() {
+  delete icmp_socket_;
+  delete probe_socket_;
+}
+
+bool TracerouteEngine::Trace(const Host& destination,
+                             const TracerouteOptions& options,
+                             TracerouteResult* result) {
+  ASSERT(result != NULL);
+  ASSERT(options.first_ttl > 0);
+  ASSERT(options.first_ttl <= options.max_ttl);
+  ASSERT(options.probes_per_hop > 0);
+
+  std::string address;
+  for (IPAddresses::const_iterator it = destination.resolved_ips.begin();
+       it != destination.resolved_ips.end(); ++it) {
+    if (GetSocketFamilyForAddress(*it) == SOCKETFAMILY_IPV4) {
+      address = *it;
+      break;
+    }
+  }
+  if (address.empty()) {
+    LOG(ERROR, "No IPv4 address to trace for %s.",
+        destination.original_hostname.c_str());
+    return false;
+  }
+  const Host target_host(address);
+  in_addr target;
+  inet_pton(AF_INET, address.c_str(), &target);
+
+  const uint16_t source_port = options.source_port != 0
+      ? options.source_port
+      : kFirstSourcePort + (getpid() * 31 + next_session_++) % kSourcePorts;
+  const size_t num_probes =
+      (options.max_ttl - options.first_ttl + 1) * options.probes_per_hop;
+
+  // Have the kernel drop the ICMP that isn't for this trace.
+  const FilterProgram filter =
+      UDPErrorFilter(SOCKETFAMILY_IPV4, source_port, source_port);
+  if (!filter.empty() && !icmp_socket_->AttachFilter(filter)) {
+    LOG(WARNING, "Failed to filter ICMP errors; those for other traces will "
+        "be read and dropped.");
+  }
+
+  result->probes.resize(num_probes);
+  result->reached = false;
+  result->destination_ttl = 0;
+  std::vector<uint64_t> sent_us(num_probes);
+
+  // Send every probe before waiting for any reply.
+  const size_t packet_length =
+      sizeof(IP4Header) + sizeof(UDPHeader) + sizeof(kProbePayload);
+  for (size_t i = 0; i < num_probes; ++i) {
+    TracerouteProbe& probe = result->probes[i];
+    probe.ttl = options.first_ttl + i / options.probes_per_hop;
+    probe.attempt = i % options.probes_per_hop;
+    probe.answered = false;
+    probe.responder.clear();
+    probe.icmp_type = 0;
+    probe.icmp_code = 0;
+    probe.rtt_us = 0;
+
+    IP4Header ip(packet_length, probe.ttl, IPPROTO_UDP, address.c_str());
+#if defined(OS_MACOSX) || defined(OS_FREEBSD)
+    // The BSDs take the length of an included header in host byte order.
+    ip.total_len = packet_length;
+#endif
+    // Never zero, which would have the kernel choose the ID.
+    ip.id = htons(i + 1);
+    UDPHeader udp(source_port,
+                  options.paris ? options.dest_port : options.dest_port + i,
+                  sizeof(UDPHeader) + sizeof(kProbePayload), 0);
+    iovec iov[3];
+    iov[0].iov_base = &ip;
+    iov[0].iov_len = sizeof(ip);
+    iov[1].iov_base = &udp;
+    iov[1].iov_len = sizeof(udp);
+    iov[2].iov_base = const_cast<char*>(kProbePayload);
+    iov[2].iov_len = sizeof(kProbePayload);
+
+    sent_us[i] = MonotonicNowUs();
+    ssize_t num_bytes;
+    if (!probe_socket_->SendToV(target_host, iov, 3, &num_bytes))
+      return false;
+  }
+  LOG(VERBOSE, "Sent %zu probes to %s from port %u.", num_probes,
+      address.c_str(), source_port);
+
+  // Collect replies until every probe up to the destination is answered.
+  const uint64_t deadline_us = Socket::DeadlineAfterMs(options.timeout_ms);
+  size_t last_probe = num_probes;
+  size_t unanswered = num_probes;
+  char packet[1500];
+  while (unanswered > 0) {
+    ssize_t num_bytes;
+    const SocketStatus status = icmp_socket_->ReceiveUntil(
+        packet, sizeof(packet), deadline_us, &num_bytes);
+    if (status == SOCKETSTATUS_TIMEOUT)
+      break;
+    if (status == SOCKETSTATUS_ERROR)
+      return false;
+    const uint64_t now_us = MonotonicNowUs();
+
+    Reply reply;
+    if (!MatchReply(packet, num_bytes, target, source_port, options,
+                    num_probes, &reply)) {
+      continue;
+    }
+    TracerouteProbe& probe = result->probes[reply.probe];
+    if (probe.answered)
+      continue;
+
+    char responder[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &reply.responder, responder, sizeof(responder));
+    probe.answered = true;
+    probe.responder = responder;
+    probe.icmp_type = reply.icmp_type;
+    probe.icmp_code = reply.icmp_code;
+    probe.rtt_us = now_us - sent_us[reply.probe];
+    if (reply.probe < last_probe)
+      --unanswered;
+
+    // The destination answers every probe that reaches it; the trace ends
+    // at the first TTL that did.
+    if (reply.icmp_type == kDestinationUnreachable &&
+        reply.responder.s_addr == target.s_addr &&
+        (!result->reached || probe.ttl < result->destination_ttl)) {
+      result->reached = true;
+      result->destination_ttl = probe.ttl;
+      const size_t end =
+          (probe.ttl - options.first_ttl + 1) * options.probes_per_hop;
+      for (size_t i = end; i < last_probe; ++i) {
+        if (!result->probes[i].answered)
+          --unanswered;
+      }
+      last_probe = end;
+    }
+  }
+
+  result->probes.resize(last_probe);
+  LOG(VERBOSE, "Trace to %s %s after %zu hops.", address.c_str(),
+      result->reached ? "arrived" : "stopped",
+      last_probe / options.probes_per_hop);
+  return true;
+}
+
+TracerouteEngine::TracerouteEngine(RawSocket* probe_socket,
+                                   RawSocket* icmp_socket)
+    : probe_socket_(probe_socket),
+      icmp_socket_(icmp_socket),
+      next_session_(0) { }
+
+}  // namespace mlab
@@ -0,0 +1,660 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/uring_loop.h"
+
+#if defined(OS_LINUX)
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <string.h>
+
+#include <vector>
+
+#include "log.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/listen_socket.h"
+
+namespace mlab {
+#if defined(OS_LINUX)
+namespace {
+enum OperationType {
+  OPERATION_ACCEPT,
+  OPERATION_CONNECT,
+  OPERATION_SEND,
+  OPERATION_RECEIVE
+};
+
+// The kernel identifies the provided buffer ring by group.
+const uint16_t kBufferGroup = 0;
+
+// Completions of cancel requests carry no operation.
+const uint64_t kCancelUserData = 0;
+
+int SetupRing(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int EnterRing(int ring_fd, unsigned to_submit, unsigned min_complete,
+              unsigned flags, const void* arg, size_t arg_size) {
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+                 arg, arg_size);
+}
+
+int RegisterRing(int ring_fd, unsigned opcode, void* arg, unsigned num_args) {
+  return syscall(__NR_io_uring_register, ring_fd, opcode, arg, num_args);
+}
+
+// Whether the kernel implements all of the opcodes the loop submits.
+bool ProbeOperations(int ring_fd) {
+  const unsigned kNumOps = 256;
+  std::vector<char> storage(sizeof(io_uring_probe) +
+                            kNumOps * sizeof(io_uring_probe_op));
+  io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(&storage[0]);
+  if (RegisterRing(ring_fd, IORING_REGISTER_PROBE, probe, kNumOps) == -1)
+    return false;
+
+  const uint8_t required[] = { IORING_OP_ACCEPT, IORING_OP_CONNECT,
+                               IORING_OP_SEND, IORING_OP_RECV,
+                               IORING_OP_ASYNC_CANCEL };
+  for (size_t i = 0; i < sizeof(required); ++i) {
+    if (required[i] > probe->last_op ||
+        !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+struct UringLoop::Operation {
+  int type;
+  int fd;
+  Socket* socket;
+  Handler* handler;
+  void* buffer;
+  size_t length;
+  bool multishot;
+  bool cancelled;
+
+  // The peer of a connect, which must outlive the request.
+  sockaddr_storage addr;
+  socklen_t addr_len;
+};
+
+// The shared submission and completion queues.
+struct UringLoop::Ring {
+  int fd;
+
+  void* sq_ptr;
+  size_t sq_size;
+  void* cq_ptr;
+  size_t cq_size;
+  io_uring_sqe* sqes;
+  size_t sqes_size;
+
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_array;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  // Entries up to here have been filled in but maybe not yet published.
+  unsigned sqe_tail;
+
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  io_uring_cqe* cqes;
+};
+
+// Buffers the kernel picks from for multishot receives. Each is handed back
+// to the kernel once its callback returns.
+struct UringLoop::BufferPool {
+  io_uring_buf_ring* ring;
+  size_t ring_size;
+  char* base;
+  size_t count;
+  size_t size;
+  uint16_t tail;
+};
+
+// static
+UringLoop* UringLoop::Create(unsigned entries) {
+  ASSERT(entries > 0);
+
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = SetupRing(entries, &params);
+  if (ring_fd == -1) {
+    LOG(ERROR, "Failed to set up io_uring: %s [%d]", strerror(errno), errno);
+    return NULL;
+  }
+  if (!(params.features & IORING_FEAT_EXT_ARG) || !ProbeOperations(ring_fd)) {
+    LOG(ERROR, "io_uring lacks the operations UringLoop needs.");
+    close(ring_fd);
+    return NULL;
+  }
+
+  Ring* ring = new Ring;
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = ring_fd;
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    if (ring->cq_size > ring->sq_size)
+      ring->sq_size = ring->cq_size;
+    ring->cq_size = ring->sq_size;
+  }
+
+  ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  ring->cq_ptr = single_mmap ? ring->sq_ptr :
+      mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED ||
+      sqes == MAP_FAILED) {
+    LOG(ERROR, "Failed to map io_uring: %s [%d]", strerror(errno), errno);
+    if (ring->sq_ptr != MAP_FAILED)
+      munmap(ring->sq_ptr, ring->sq_size);
+    if (!single_mmap && ring->cq_ptr != MAP_FAILED)
+      munmap(ring->cq_ptr, ring->cq_size);
+    if (sqes != MAP_FAILED)
+      munmap(sqes, ring->sqes_size);
+    close(ring_fd);
+    delete ring;
+    return NULL;
+  }
+
+  char* sq = static_cast<char*>(ring->sq_ptr);
+  ring->sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  ring->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  ring->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  ring->sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  ring->sq_entries = params.sq_entries;
+  ring->sqe_tail = *ring->sq_tail;
+  ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+  char* cq = static_cast<char*>(ring->cq_ptr);
+  ring->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  ring->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  ring->cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  LOG(VERBOSE, "Created io_uring %d with %u entries.", ring_fd,
+      params.sq_entries);
+  return new UringLoop(ring);
+}
+
+// static
+bool UringLoop::IsSupported() {
+  UringLoop* loop = Create(1);
+  const bool supported = loop != NULL;
+  delete loop;
+  return supported;
+}
+
+UringLoop::UringLoop(Ring* ring)
+    : ring_(ring),
+      buffers_(NULL) { }
+
+UringLoop::~UringLoop() {
+  // Closing the ring cancels whatever is still in flight.
+  close(ring_->fd);
+  for (std::set<Operation*>::iterator it = operations_.begin();
+       it != operations_.end(); ++it) {
+    if ((*it)->type == OPERATION_CONNECT)
+      delete (*it)->socket;
+    delete *it;
+  }
+
+  munmap(ring_->sqes, ring_->sqes_size);
+  if (ring_->cq_ptr != ring_->sq_ptr)
+    munmap(ring_->cq_ptr, ring_->cq_size);
+  munmap(ring_->sq_ptr, ring_->sq_size);
+  delete ring_;
+
+  if (buffers_ != NULL) {
+    munmap(buffers_->ring, buffers_->ring_size);
+    munmap(buffers_->base, buffers_->count * buffers_->size);
+    delete buffers_;
+  }
+}
+
+bool UringLoop::ProvideReceiveBuffers(size_t count, size_t size) {
+  ASSERT(buffers_ == NULL);
+  ASSERT(size > 0);
+
+  if (count == 0 || count > 32768 || (count & (count - 1)) != 0) {
+    LOG(ERROR, "Receive buffer count %zu is not a power of two up to 32768.",
+        count);
+    return false;
+  }
+
+  BufferPool* pool = new BufferPool;
+  pool->ring_size = count * sizeof(io_uring_buf);
+  pool->count = count;
+  pool->size = size;
+  pool->ring = static_cast<io_uring_buf_ring*>(
+      mmap(NULL, pool->ring_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  pool->base = static_cast<char*>(
+      mmap(NULL, count * size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  bool ok = pool->ring != MAP_FAILED && pool->base != MAP_FAILED;
+
+  if (ok) {
+    io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uintptr_t>(pool->ring);
+    registration.ring_entries = count;
+    registration.bgid = kBufferGroup;
+    ok = RegisterRing(ring_->fd, IORING_REGISTER_PBUF_RING, &registration,
+                      1) == 0;
+  }
+  if (!ok) {
+    LOG(ERROR, "Failed to provide receive buffers: %s [%d]",
+        strerror(errno), errno);
+    if (pool->ring != MAP_FAILED)
+      munmap(pool->ring, pool->ring_size);
+    if (pool->base != MAP_FAILED)
+      munmap(pool->base, count * size);
+    delete pool;
+    return false;
+  }
+
+  buffers_ = pool;
+  buffers_->tail = 0;
+  for (size_t i = 0; i < count; ++i)
+    RecycleBuffer(i);
+  LOG(VERBOSE, "Provided %zu receive buffers of %zu bytes.", count, size);
+  return true;
+}
+
+bool UringLoop::Accept(ListenSocket* listener, bool multishot,
+                       Handler* handler) {
+  Operation* operation = NewOperation(OPERATION_ACCEPT, listener, handler);
+  operation->multishot = multishot;
+  return Queue(operation);
+}
+
+bool UringLoop::Connect(const Host& host, uint16_t port, SocketType type,
+                        SocketFamily family, Handler* handler) {
+  Host::SocketAddressList::const_iterator addr_it = host.sockaddr_.begin();
+  while (addr_it != host.sockaddr_.end() && addr_it->ss_family != family)
+    ++addr_it;
+  if (addr_it == host.sockaddr_.end()) {
+    LOG(ERROR, "No address for %s with family %d.",
+        host.original_hostname.c_str(), family);
+    return false;
+  }
+
+  ClientSocket* socket = new ClientSocket(type, family);
+  if (socket->raw() == -1) {
+    delete socket;
+    return false;
+  }
+
+  Operation* operation = NewOperation(OPERATION_CONNECT, socket, handler);
+  operation->addr = *addr_it;
+  if (family == SOCKETFAMILY_IPV4) {
+    reinterpret_cast<sockaddr_in*>(&operation->addr)->sin_port = htons(port);
+    operation->addr_len = sizeof(sockaddr_in);
+  } else {
+    reinterpret_cast<sockaddr_in6*>(&operation->addr)->sin6_port = htons(port);
+    operation->addr_len = sizeof(sockaddr_in6);
+  }
+  if (!Queue(operation)) {
+    delete socket;
+    return false;
+  }
+  return true;
+}
+
+bool UringLoop::Send(Socket* socket, const void* buffer, size_t length,
+                     Handler* handler) {
+  Operation* operation = NewOperation(OPERATION_SEND, socket, handler);
+  operation->buffer = const_cast<void*>(buffer);
+  operation->length = length;
+  return Queue(operation);
+}
+
+bool UringLoop::Receive(Socket* socket, void* buffer, size_t length,
+                        Handler* handler) {
+  Operation* operation = NewOperation(OPERATION_RECEIVE, socket, handler);
+  operation->buffer = buffer;
+  operation->length = length;
+  return Queue(operation);
+}
+
+bool UringLoop::ReceiveMultishot(Socket* socket, Handler* handler) {
+  if (buffers_ == NULL) {
+    LOG(ERROR, "Provide receive buffers before a multishot receive.");
+    return false;
+  }
+  Operation* operation = NewOperation(OPERATION_RECEIVE, socket, handler);
+  operation->multishot = true;
+  return Queue(operation);
+}
+
+bool UringLoop::Cancel(Socket* socket) {
+  ASSERT(socket != NULL);
+
+  // Each operation is cancelled by its user data, as cancelling everything
+  // on a file descriptor needs Linux 5.19. Marking them also keeps multishot
+  // operations from being resubmitted when they end.
+  for (std::set<Operation*>::iterator it = operations_.begin();
+       it != operations_.end(); ++it) {
+    if ((*it)->socket != socket)
+      continue;
+    (*it)->cancelled = true;
+
+    io_uring_sqe* sqe = NextSqe();
+    if (sqe == NULL && Submit(0, 0) >= 0)
+      sqe = NextSqe();
+    if (sqe == NULL) {
+      LOG(ERROR, "Failed to queue io_uring cancel on fd %d.", (*it)->fd);
+      return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uintptr_t>(*it);
+    sqe->user_data = kCancelUserData;
+  }
+  return true;
+}
+
+int UringLoop::RunOnce(int timeout_ms) {
+  if (operations_.empty()) {
+    // Nothing to wait for, but hand over anything queued, such as cancels.
+    return Submit(0, 0) < 0 ? -1 : 0;
+  }
+
+  // Don't block if completions are already waiting.
+  const unsigned ready =
+      __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE) - *ring_->cq_head;
+  if (Submit(ready == 0 ? 1 : 0, timeout_ms) < 0)
+    return -1;
+
+  // Copy the completions out before dispatching so callbacks can queue more.
+  std::vector<io_uring_cqe> completions;
+  unsigned head = *ring_->cq_head;
+  const unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head)
+    completions.push_back(ring_->cqes[head & ring_->cq_mask]);
+  __atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
+
+  int dispatched = 0;
+  for (size_t i = 0; i < completions.size(); ++i) {
+    if (completions[i].user_data == kCancelUserData)
+      continue;
+    Complete(reinterpret_cast<Operation*>(completions[i].user_data),
+             completions[i].res, completions[i].flags);
+    ++dispatched;
+  }
+  return dispatched;
+}
+
+void UringLoop::Run() {
+  while (!operations_.empty()) {
+    if (RunOnce(-1) < 0)
+      break;
+  }
+}
+
+UringLoop::Operation* UringLoop::NewOperation(int type, Socket* socket,
+                                              Handler* handler) {
+  ASSERT(socket != NULL);
+  ASSERT(handler != NULL);
+
+  Operation* operation = new Operation;
+  memset(operation, 0, sizeof(*operation));
+  operation->type = type;
+  operation->fd = socket->raw();
+  operation->socket = socket;
+  operation->handler = handler;
+  operations_.insert(operation);
+  return operation;
+}
+
+io_uring_sqe* UringLoop::NextSqe() {
+  const unsigned head = __atomic_load_n(ring_->sq_head, __ATOMIC_ACQUIRE);
+  if (ring_->sqe_tail - head >= ring_->sq_entries)
+    return NULL;
+
+  const unsigned index = ring_->sqe_tail & ring_->sq_mask;
+  ring_->sq_array[index] = index;
+  ++ring_->sqe_tail;
+  io_uring_sqe* sqe = &ring_->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+bool UringLoop::Queue(Operation* operation) {
+  // Make room by handing what's queued to the kernel.
+  io_uring_sqe* sqe = NextSqe();
+  if (sqe == NULL && Submit(0, 0) >= 0)
+    sqe = NextSqe();
+  if (sqe == NULL) {
+    LOG(ERROR, "Failed to queue io_uring operation on fd %d.", operation->fd);
+    operations_.erase(operation);
+    delete operation;
+    return false;
+  }
+
+  sqe->fd = operation->fd;
+  sqe->user_data = reinterpret_cast<uintptr_t>(operation);
+  switch (operation->type) {
+    case OPERATION_ACCEPT:
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->accept_flags = SOCK_CLOEXEC;
+      if (operation->multishot)
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+      break;
+
+    case OPERATION_CONNECT:
+      sqe->opcode = IORING_OP_CONNECT;
+      sqe->addr = reinterpret_cast<uintptr_t>(&operation->addr);
+      sqe->off = operation->addr_len;
+      break;
+
+    case OPERATION_SEND:
+      sqe->opcode = IORING_OP_SEND;
+      sqe->addr = reinterpret_cast<uintptr_t>(operation->buffer);
+      sqe->len = operation->length;
+      sqe->msg_flags = MSG_NOSIGNAL;
+      break;
+
+    case OPERATION_RECEIVE:
+      sqe->opcode = IORING_OP_RECV;
+      if (operation->multishot) {
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->ioprio |= IORING_RECV_MULTISHOT;
+      } else {
+        sqe->addr = reinterpret_cast<uintptr_t>(operation->buffer);
+        sqe->len = operation->length;
+      }
+      break;
+
+    default:
+      LOG(FATAL, "Unknown io_uring operation %d.", operation->type);
+  }
+  return true;
+}
+
+int UringLoop::Submit(unsigned wait_for, int timeout_ms) {
+  __atomic_store_n(ring_->sq_tail, ring_->sqe_tail, __ATOMIC_RELEASE);
+  const unsigned to_submit =
+      ring_->sqe_tail - __atomic_load_n(ring_->sq_head, __ATOMIC_ACQUIRE);
+  if (to_submit == 0 && wait_for == 0)
+    return 0;
+  unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+  io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  __kernel_timespec timeout;
+  if (wait_for > 0 && timeout_ms >= 0) {
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+    arg.ts = reinterpret_cast<uintptr_t>(&timeout);
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  int num;
+  while ((num = EnterRing(ring_->fd, to_submit, wait_for, flags,
+                          (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+                          (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0))
+         == -1 && errno == EINTR) { }
+  // Timing out, or a full completion queue, isn't an error; the caller reaps
+  // whatever has completed.
+  if (num == -1 && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+    LOG(ERROR, "Failed to enter io_uring: %s [%d]", strerror(errno), errno);
+    return -1;
+  }
+  return num == -1 ? 0 : num;
+}
+
+void UringLoop::Complete(Operation* operation, int result, uint32_t flags) {
+  const bool more = flags & IORING_CQE_F_MORE;
+  Handler* handler = operation->handler;
+
+  // A multishot receive that ran out of buffers is resubmitted below, once
+  // this batch of callbacks has handed them back; it hasn't failed, so the
+  // handler isn't told.
+  const bool out_of_buffers = operation->type == OPERATION_RECEIVE &&
+      operation->multishot && !more && result == -ENOBUFS;
+  if (out_of_buffers && !operation->cancelled) {
+    LOG(VERBOSE, "Out of receive buffers on fd %d; resubmitting.",
+        operation->fd);
+    Queue(operation);
+    return;
+  }
+  // Ended before the cancel reached it.
+  if (out_of_buffers)
+    result = -ECANCELED;
+
+  switch (operation->type) {
+    case OPERATION_ACCEPT: {
+      ListenSocket* listener = static_cast<ListenSocket*>(operation->socket);
+      AcceptedSocket* accepted = NULL;
+      if (result >= 0) {
+        accepted = new AcceptedSocket(result, listener->type(),
+                                      listener->family());
+      }
+      handler->OnAccept(listener, accepted, result);
+      break;
+    }
+
+    case OPERATION_CONNECT: {
+      ClientSocket* connected = static_cast<ClientSocket*>(operation->socket);
+      if (result < 0) {
+        delete connected;
+        connected = NULL;
+      }
+      handler->OnConnect(connected, result);
+      break;
+    }
+
+    case OPERATION_SEND:
+      handler->OnSend(operation->socket, result);
+      break;
+
+    case OPERATION_RECEIVE:
+      if (!operation->multishot) {
+        handler->OnReceive(operation->socket, operation->buffer, result);
+      } else if (flags & IORING_CQE_F_BUFFER) {
+        const uint16_t buffer_id = flags >> IORING_CQE_BUFFER_SHIFT;
+        handler->OnReceive(operation->socket,
+                           buffers_->base + buffer_id * buffers_->size,
+                           result);
+        RecycleBuffer(buffer_id);
+      } else {
+        handler->OnReceive(operation->socket, NULL, result);
+      }
+      break;
+  }
+
+  if (more)
+    return;
+
+  // The kernel also ends a multishot operation when the completion queue
+  // fills; resubmit it unless it failed for good.
+  const bool rearm = operation->multishot && !operation->cancelled &&
+      result > 0;
+  if (rearm) {
+    // On failure Queue releases the operation.
+    Queue(operation);
+    return;
+  }
+  operations_.erase(operation);
+  delete operation;
+}
+
+void UringLoop::RecycleBuffer(uint16_t buffer_id) {
+  io_uring_buf* bufs = reinterpret_cast<io_uring_buf*>(buffers_->ring);
+  io_uring_buf* buf = &bufs[buffers_->tail & (buffers_->count - 1)];
+  buf->addr = reinterpret_cast<uintptr_t>(buffers_->base +
+                                          buffer_id * buffers_->size);
+  buf->len = buffers_->size;
+  buf->bid = buffer_id;
+  ++buffers_->tail;
+  __atomic_store_n(&buffers_->ring->tail, buffers_->tail, __ATOMIC_RELEASE);
+}
+#else
+// static
+UringLoop* UringLoop::Create(unsigned) {
+  LOG(ERROR, "io_uring is not supported on this platform.");
+  return NULL;
+}
+
+// static
+bool UringLoop::IsSupported() {
+  return false;
+}
+
+// No loop can be created, so these are unreachable.
+UringLoop::~UringLoop() { }
+bool UringLoop::ProvideReceiveBuffers(size_t, size_t) { return false; }
+bool UringLoop::Accept(ListenSocket*, bool, Handler*) { return false; }
+bool UringLoop::Connect(const Host&, uint16_t, SocketType, SocketFamily,
+                        Handler*) {
+  return false;
+}
+bool UringLoop::Send(Socket*, const void*, size_t, Handler*) { return false; }
+bool UringLoop::Receive(Socket*, void*, size_t, Handler*) { return false; }
+bool UringLoop::ReceiveMultishot(Socket*, Handler*) { return false; }
+bool UringLoop::Cancel(Socket*) { return false; }
+int UringLoop::RunOnce(int) { return -1; }
+void UringLoop::Run() { }
+#endif
+
+// static
+UringLoop* UringLoop::CreateOrDie(unsigned entries) {
+  UringLoop* loop = Create(entries);
+  if (!loop)
+    LOG(FATAL, "Failed to create io_uring loop.");
+  return loop;
+}
+
+}  // namespace mlab
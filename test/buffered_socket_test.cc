@@ -0,0 +1,125 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/buffered_socket.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/host.h"
+#include "mlab/listen_socket.h"
+
+namespace mlab {
+namespace {
+const uint16_t kBufferedPort = 5014;
+}  // namespace
+
+class BufferedSocketTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    listener_ = ListenSocket::CreateOrDie(kBufferedPort, SOCKETTYPE_TCP,
+                                          SOCKETFAMILY_IPV4);
+    client_ = ClientSocket::CreateOrDie(Host("127.0.0.1"), kBufferedPort,
+                                        SOCKETTYPE_TCP, SOCKETFAMILY_IPV4);
+    server_ = listener_->AcceptOrDie();
+  }
+
+  virtual void TearDown() {
+    delete server_;
+    delete client_;
+    delete listener_;
+  }
+
+  ListenSocket* listener_;
+  ClientSocket* client_;
+  AcceptedSocket* server_;
+};
+
+TEST_F(BufferedSocketTest, LengthPrefixedProtocol) {
+  BufferedSocketWriter writer(client_);
+  EXPECT_TRUE(writer.WriteLine("HELLO"));
+  EXPECT_TRUE(writer.Write("LENGTH 5\n", 9));
+  EXPECT_TRUE(writer.Write(Packet(std::string("abcde"))));
+  EXPECT_EQ(21U, writer.buffered());
+  EXPECT_TRUE(writer.Flush());
+  EXPECT_EQ(0U, writer.buffered());
+
+  BufferedSocketReader reader(server_);
+  std::string line;
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("HELLO", line);
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("LENGTH 5", line);
+
+  const char* peeked;
+  ASSERT_TRUE(reader.Peek(2, &peeked));
+  EXPECT_EQ("ab", std::string(peeked, 2));
+
+  char payload[5];
+  ASSERT_TRUE(reader.ReadExactly(payload, sizeof(payload)));
+  EXPECT_EQ("abcde", std::string(payload, sizeof(payload)));
+  EXPECT_EQ(0U, reader.buffered());
+}
+
+TEST_F(BufferedSocketTest, SmallBuffers) {
+  // Writes larger than the writer's buffer go straight out, after what is
+  // queued.
+  BufferedSocketWriter writer(client_, 8);
+  char big[100];
+  for (size_t i = 0; i < sizeof(big); ++i)
+    big[i] = 'a' + i % 26;
+  EXPECT_TRUE(writer.Write("x", 1));
+  EXPECT_TRUE(writer.Write(big, sizeof(big)));
+  EXPECT_EQ(0U, writer.buffered());
+  EXPECT_TRUE(writer.WriteLine("0123456789"));
+  EXPECT_TRUE(writer.WriteLine("ok"));
+  EXPECT_TRUE(writer.Flush());
+
+  BufferedSocketReader reader(server_, 8);
+  char first;
+  ASSERT_TRUE(reader.ReadExactly(&first, 1));
+  EXPECT_EQ('x', first);
+  char received[sizeof(big)];
+  ASSERT_TRUE(reader.ReadExactly(received, sizeof(received)));
+  EXPECT_EQ(0, memcmp(big, received, sizeof(big)));
+
+  // A line that doesn't fit in the reader's buffer fails; skip past it.
+  std::string line;
+  EXPECT_FALSE(reader.ReadLine(&line));
+  ASSERT_TRUE(reader.Skip(12));
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("ok", line);
+}
+
+TEST_F(BufferedSocketTest, EndOfStream) {
+  {
+    BufferedSocketWriter writer(client_);
+    EXPECT_TRUE(writer.Write("partial", 7));
+    // The destructor flushes.
+  }
+  delete client_;
+  client_ = NULL;
+
+  BufferedSocketReader reader(server_);
+  std::string line;
+  EXPECT_FALSE(reader.ReadLine(&line));
+  EXPECT_TRUE(reader.eof());
+  EXPECT_EQ(7U, reader.buffered());
+}
+
+}  // namespace mlab
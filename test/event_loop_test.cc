@@ -0,0 +1,189 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/event_loop.h"
+
+#include <errno.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/host.h"
+#include "mlab/listen_socket.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+namespace {
+const uint16_t kEchoPort = 5005;
+const size_t kNumClients = 4;
+
+// Accepts connections and echoes whatever they send until they hang up.
+class EchoServer : public EventLoop::SocketHandler {
+ public:
+  EchoServer(EventLoop* loop, ListenSocket* listen_socket)
+      : loop_(loop), listen_socket_(listen_socket), accepted_(0),
+        closed_(0) { }
+
+  virtual ~EchoServer() {
+    for (std::map<Socket*, std::string>::iterator it = pending_.begin();
+         it != pending_.end(); ++it) {
+      loop_->Remove(it->first);
+      delete it->first;
+    }
+  }
+
+  virtual void OnReadable(Socket* socket) {
+    if (socket == listen_socket_) {
+      AcceptedSocket* accepted;
+      while ((accepted = listen_socket_->Accept()) != NULL) {
+        EXPECT_TRUE(accepted->IsNonBlocking());
+        pending_[accepted] = std::string();
+        ++accepted_;
+        EXPECT_TRUE(loop_->Add(accepted, EVENT_READ, this));
+      }
+      EXPECT_EQ(EAGAIN, errno);
+      return;
+    }
+
+    char buffer[64];
+    ssize_t num_bytes;
+    if (!socket->ReceiveInto(buffer, sizeof(buffer), &num_bytes)) {
+      EXPECT_EQ(EAGAIN, errno);
+      return;
+    }
+    if (num_bytes == 0) {
+      Close(socket);
+      return;
+    }
+    pending_[socket].append(buffer, num_bytes);
+    loop_->Modify(socket, EVENT_READ | EVENT_WRITE);
+  }
+
+  virtual void OnWritable(Socket* socket) {
+    std::string& pending = pending_[socket];
+    ssize_t num_bytes;
+    if (!socket->SendFrom(pending.data(), pending.size(), &num_bytes))
+      return;
+    pending.erase(0, num_bytes);
+    if (pending.empty())
+      loop_->Modify(socket, EVENT_READ);
+  }
+
+  size_t accepted() const { return accepted_; }
+  size_t closed() const { return closed_; }
+
+ private:
+  void Close(Socket* socket) {
+    EXPECT_TRUE(loop_->Remove(socket));
+    pending_.erase(socket);
+    delete socket;
+    ++closed_;
+  }
+
+  EventLoop* loop_;
+  ListenSocket* listen_socket_;
+  std::map<Socket*, std::string> pending_;
+  size_t accepted_;
+  size_t closed_;
+};
+
+class RecordingTimer : public EventLoop::TimerHandler {
+ public:
+  virtual void OnTimer(uint32_t timer_id) { fired.push_back(timer_id); }
+
+  std::vector<uint32_t> fired;
+};
+}  // namespace
+
+TEST(EventLoopTest, Echo) {
+  scoped_ptr<EventLoop> loop(EventLoop::CreateOrDie());
+  scoped_ptr<ListenSocket> listen_socket(
+      ListenSocket::CreateOrDie(kEchoPort, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  ASSERT_TRUE(listen_socket->SetNonBlocking(true));
+  EXPECT_TRUE(listen_socket->IsNonBlocking());
+
+  EchoServer server(loop.get(), listen_socket.get());
+  ASSERT_TRUE(loop->Add(listen_socket.get(), EVENT_READ, &server));
+  EXPECT_FALSE(loop->Add(listen_socket.get(), EVENT_READ, &server));
+
+  std::vector<ClientSocket*> clients;
+  for (size_t i = 0; i < kNumClients; ++i) {
+    clients.push_back(ClientSocket::CreateOrDie(
+        Host("127.0.0.1"), kEchoPort, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+    // Accept each client as it connects.
+    while (server.accepted() < i + 1)
+      ASSERT_GE(loop->RunOnce(1000), 0);
+    std::string message(i + 1, 'a' + i);
+    ssize_t num_bytes;
+    EXPECT_TRUE(clients[i]->SendFrom(message.data(), message.size(),
+                                     &num_bytes));
+  }
+
+  for (size_t i = 0; i < kNumClients; ++i) {
+    // The loop runs in this thread, so pump it until the echo arrives.
+    std::string echo;
+    ASSERT_TRUE(clients[i]->SetNonBlocking(true));
+    while (echo.size() < i + 1) {
+      ASSERT_GE(loop->RunOnce(1000), 0);
+      char buffer[64];
+      ssize_t num_bytes;
+      if (clients[i]->ReceiveInto(buffer, sizeof(buffer), &num_bytes))
+        echo.append(buffer, num_bytes);
+    }
+    EXPECT_EQ(std::string(i + 1, 'a' + i), echo);
+    delete clients[i];
+  }
+
+  while (server.closed() < kNumClients)
+    ASSERT_GE(loop->RunOnce(1000), 0);
+  EXPECT_TRUE(loop->Remove(listen_socket.get()));
+}
+
+TEST(EventLoopTest, Timers) {
+  scoped_ptr<EventLoop> loop(EventLoop::CreateOrDie());
+  RecordingTimer timer;
+
+  uint32_t later = loop->AddTimer(20, &timer);
+  uint32_t sooner = loop->AddTimer(10, &timer);
+  uint32_t cancelled = loop->AddTimer(5, &timer);
+  EXPECT_TRUE(loop->CancelTimer(cancelled));
+  EXPECT_FALSE(loop->CancelTimer(cancelled));
+
+  loop->Run();
+  ASSERT_EQ(2U, timer.fired.size());
+  EXPECT_EQ(sooner, timer.fired[0]);
+  EXPECT_EQ(later, timer.fired[1]);
+  EXPECT_FALSE(loop->CancelTimer(later));
+}
+
+TEST(EventLoopTest, RunOnceTimesOut) {
+  scoped_ptr<EventLoop> loop(EventLoop::CreateOrDie());
+  EXPECT_EQ(0, loop->RunOnce(0));
+  EXPECT_EQ(0, loop->RunOnce(10));
+}
+
+TEST(EventLoopTest, WakeEndsWait) {
+  scoped_ptr<EventLoop> loop(EventLoop::CreateOrDie());
+  // A wake-up before the wait is kept for it, and several collapse into one.
+  loop->Wake();
+  loop->Wake();
+  EXPECT_EQ(0, loop->RunOnce(-1));
+  EXPECT_EQ(0, loop->RunOnce(0));
+}
+
+}  // namespace mlab
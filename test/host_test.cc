@@ -92,4 +92,8 @@ TEST(HostDeathTest, FailureToResolve) {
   EXPECT_DEATH(mlab::Host host(host_addr), "Failed to resolve");
 }
 
+TEST(HostTest, CreateFailureToResolve) {
+  EXPECT_TRUE(mlab::Host::Create("hiybbprqag") == NULL);
+}
+
 }  // namespace mlab
@@ -12,16 +12,220 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/buffered_socket.h"
 #include "mlab/http.h"
+#include "mlab/http_parser.h"
+#include "mlab/listen_socket.h"
+#include "scoped_ptr.h"
 
 namespace mlab {
 namespace {
 const char kStatusOK[] = "HTTP/1.1 200 OK";
+const uint16_t kServerPort = 5018;
+
+// Serves |connections| connections one after another. Each request gets its
+// path back as the body, alternating between a Content-Length and a chunked
+// response. "/big" gets a body larger than the client's buffer and "/close"
+// closes the connection after the response.
+class EchoServer {
+ public:
+  explicit EchoServer(int connections)
+      : listen_socket_(ListenSocket::CreateOrDie(kServerPort)),
+        connections_(connections),
+        accepted_(0),
+        requests_(0) {
+    pthread_create(&thread_, NULL, &Run, this);
+  }
+
+  void Join() { pthread_join(thread_, NULL); }
+
+  int accepted() const { return accepted_; }
+  int requests() const { return requests_; }
+
+ private:
+  static void* Run(void* that) {
+    EchoServer* self = static_cast<EchoServer*>(that);
+    for (int i = 0; i < self->connections_; ++i) {
+      scoped_ptr<AcceptedSocket> socket(self->listen_socket_->AcceptOrDie());
+      ++self->accepted_;
+      self->Serve(socket.get());
+    }
+    return NULL;
+  }
+
+  void Serve(const AcceptedSocket* socket) {
+    BufferedSocketReader reader(socket);
+    BufferedSocketWriter writer(socket);
+    std::string request;
+    while (reader.ReadLine(&request)) {
+      std::string header;
+      while (reader.ReadLine(&header) && !header.empty()) { }
+
+      std::string path = request.substr(4, request.find(' ', 4) - 4);
+      const bool close = path == "/close";
+      if (path == "/big")
+        path = std::string(20000, 'x');
+      writer.WriteLine(kStatusOK);
+      if (close)
+        writer.WriteLine("Connection: close");
+      if (requests_++ % 2 == 0) {
+        char length[32];
+        snprintf(length, sizeof(length), "Content-Length: %zu",
+                 path.length());
+        writer.WriteLine(length);
+        writer.WriteLine("");
+        writer.Write(path.data(), path.length());
+      } else {
+        char size[16];
+        snprintf(size, sizeof(size), "%zx", path.length());
+        writer.WriteLine("Transfer-Encoding: chunked");
+        writer.WriteLine("");
+        writer.WriteLine(size);
+        writer.WriteLine(path);
+        writer.WriteLine("0");
+        writer.WriteLine("");
+      }
+      writer.Flush();
+      if (close)
+        break;
+    }
+  }
+
+  scoped_ptr<ListenSocket> listen_socket_;
+  const int connections_;
+  int accepted_;
+  int requests_;
+  pthread_t thread_;
+};
 }  // namespace
 
+// Collects the body pieces handed over by the parser.
+class BodyPieces : public http::ResponseParser::BodyHandler {
+ public:
+  virtual void OnBody(const char* data, size_t length) {
+    pieces.push_back(std::string(data, length));
+  }
+
+  std::vector<std::string> pieces;
+};
+
+TEST(HTTPResponseParserTest, ChunkedByteAtATime) {
+  const std::string wire =
+      "HTTP/1.1 200 OK\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "Content-Type: application/json\r\n"
+      "\r\n"
+      "5;name=value\r\nhello\r\n"
+      "1A\r\n abcdefghijklmnopqrstuvwxy\r\n"
+      "0\r\n"
+      "Trailer: ignored\r\n"
+      "\r\n";
+  http::ResponseParser parser;
+  http::Response response;
+  parser.Reset(&response);
+  for (size_t i = 0; i < wire.length(); ++i) {
+    EXPECT_FALSE(parser.done());
+    size_t consumed;
+    ASSERT_TRUE(parser.Parse(&wire[i], 1, &consumed));
+    EXPECT_EQ(1U, consumed);
+  }
+  EXPECT_TRUE(parser.done());
+  EXPECT_TRUE(parser.keep_alive());
+  EXPECT_EQ(200, response.status_code);
+  EXPECT_EQ("application/json", response.headers["content-type"]);
+  EXPECT_EQ(0U, response.headers.count("trailer"));
+  EXPECT_EQ("hello abcdefghijklmnopqrstuvwxy", response.body);
+}
+
+TEST(HTTPResponseParserTest, ContentLengthLeavesNextResponse) {
+  const std::string first =
+      "HTTP/1.1 404 Not Found\r\nContent-Length: 4\r\n\r\ngone";
+  const std::string second =
+      "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\n"
+      "Content-Length: 0\r\n\r\n";
+  const std::string wire = first + second;
+
+  BodyPieces body;
+  http::ResponseParser parser(&body);
+  http::Response response;
+  parser.Reset(&response);
+  size_t consumed;
+  ASSERT_TRUE(parser.Parse(wire.data(), wire.length(), &consumed));
+  EXPECT_TRUE(parser.done());
+  EXPECT_EQ(first.length(), consumed);
+  EXPECT_EQ(404, response.status_code);
+  EXPECT_EQ("Not Found", response.reason);
+  // The body goes to the handler, not the response.
+  ASSERT_EQ(1U, body.pieces.size());
+  EXPECT_EQ("gone", body.pieces[0]);
+  EXPECT_TRUE(response.body.empty());
+
+  parser.Reset(&response);
+  ASSERT_TRUE(parser.Parse(wire.data() + consumed, wire.length() - consumed,
+                           &consumed));
+  EXPECT_TRUE(parser.done());
+  EXPECT_EQ(second.length(), consumed);
+  EXPECT_TRUE(parser.keep_alive());
+}
+
+TEST(HTTPResponseParserTest, BodyToClose) {
+  const std::string wire =
+      "HTTP/1.1 100 Continue\r\n\r\n"
+      "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nuntil the end";
+  http::ResponseParser parser;
+  http::Response response;
+  parser.Reset(&response);
+  size_t consumed;
+  ASSERT_TRUE(parser.Parse(wire.data(), wire.length(), &consumed));
+  EXPECT_EQ(wire.length(), consumed);
+  EXPECT_FALSE(parser.done());
+  EXPECT_TRUE(parser.Finish());
+  EXPECT_TRUE(parser.done());
+  EXPECT_FALSE(parser.keep_alive());
+  EXPECT_EQ(200, response.status_code);
+  EXPECT_EQ("until the end", response.body);
+
+  // A Content-Length body cut short is an error.
+  const std::string short_body =
+      "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort";
+  parser.Reset(&response);
+  ASSERT_TRUE(parser.Parse(short_body.data(), short_body.length(),
+                           &consumed));
+  EXPECT_FALSE(parser.Finish());
+}
+
+TEST(HTTPResponseParserTest, Malformed) {
+  const char* const bad[] = {
+    "HTTP/2 200 OK\r\n",
+    "HTTP/1.1 2000 OK\r\n",
+    "HTTP/1.1 200 OK\r\nNo separator\r\n",
+    "HTTP/1.1 200 OK\r\nContent-Length: 12x\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "2\r\nabc\r\n",
+    // Bodies too large to keep.
+    "HTTP/1.1 200 OK\r\nContent-Length: 99999999999999\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "ffffffffffff\r\n",
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    http::ResponseParser parser;
+    http::Response response;
+    parser.Reset(&response);
+    size_t consumed;
+    EXPECT_FALSE(parser.Parse(bad[i], strlen(bad[i]), &consumed)) << bad[i];
+  }
+}
+
 TEST(HTTPTest, SimpleGET) {
   std::string response = mlab::http::Get("www.measurementlab.net", "", 2048U);
   // Check the status.
@@ -29,4 +233,54 @@ TEST(HTTPTest, SimpleGET) {
   EXPECT_EQ(kStatusOK, status);
 }
 
+TEST(HTTPClientTest, KeepAlive) {
+  EchoServer server(3);
+  {
+    http::Client client;
+    http::Response response;
+    ASSERT_TRUE(client.Get("127.0.0.1", kServerPort, "a", &response));
+    EXPECT_EQ(200, response.status_code);
+    EXPECT_EQ("OK", response.reason);
+    EXPECT_EQ("/a", response.body);
+    EXPECT_EQ(1U, client.idle_connections());
+
+    ASSERT_TRUE(client.Get("127.0.0.1", kServerPort, "big", &response));
+    EXPECT_EQ("chunked", response.headers["transfer-encoding"]);
+    EXPECT_EQ(std::string(20000, 'x'), response.body);
+    EXPECT_EQ(1U, client.idle_connections());
+
+    // The server closes the connection after "close", so "e" is sent again
+    // on a new one.
+    std::vector<std::string> hrefs;
+    hrefs.push_back("c");
+    hrefs.push_back("d");
+    hrefs.push_back("close");
+    hrefs.push_back("e");
+    std::vector<http::Response> responses;
+    ASSERT_TRUE(client.GetPipelined("127.0.0.1", kServerPort, hrefs,
+                                    &responses));
+    ASSERT_EQ(4U, responses.size());
+    for (size_t i = 0; i < hrefs.size(); ++i)
+      EXPECT_EQ("/" + hrefs[i], responses[i].body);
+    EXPECT_EQ("close", responses[2].headers["connection"]);
+    EXPECT_EQ(1U, client.idle_connections());
+  }
+
+  // The one-shot Get connects to the port it is given.
+  const std::string response = http::Get("127.0.0.1", kServerPort, "f", 1024);
+  EXPECT_EQ(kStatusOK, response.substr(0, response.find("\r\n")));
+
+  server.Join();
+  EXPECT_EQ(3, server.accepted());
+  EXPECT_EQ(7, server.requests());
+}
+
+TEST(HTTPClientTest, ConnectFailures) {
+  http::Client client;
+  http::Response response;
+  EXPECT_FALSE(client.Get("hiybbprqag", 80, "", &response));
+  // Nothing listens on the server's port once it's gone.
+  EXPECT_FALSE(client.Get("127.0.0.1", kServerPort, "", &response));
+}
+
 }  // namespace mlab
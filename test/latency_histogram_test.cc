@@ -0,0 +1,65 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/latency_histogram.h"
+
+#include "gtest/gtest.h"
+
+namespace mlab {
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0U, histogram.count());
+  EXPECT_EQ(0U, histogram.PercentileUs(50));
+
+  // 1 ms to 1 s, one sample per millisecond.
+  for (uint64_t ms = 1; ms <= 1000; ++ms)
+    histogram.Add(ms * 1000);
+  EXPECT_EQ(1000U, histogram.count());
+  EXPECT_EQ(1000U, histogram.min_us());
+  EXPECT_EQ(1000000U, histogram.max_us());
+  EXPECT_EQ(500500U, histogram.MeanUs());
+
+  // Within the bucket width, 1/16.
+  EXPECT_NEAR(500000.0, histogram.PercentileUs(50), 500000.0 / 16);
+  EXPECT_NEAR(990000.0, histogram.PercentileUs(99), 990000.0 / 16);
+  EXPECT_EQ(1000U, histogram.PercentileUs(0));
+  EXPECT_EQ(1000000U, histogram.PercentileUs(100));
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+  LatencyHistogram histogram;
+  for (uint64_t us = 0; us < 32; ++us)
+    histogram.Add(us);
+  for (uint64_t us = 0; us < 32; ++us)
+    EXPECT_EQ(us, histogram.PercentileUs((us + 1) * 100.0 / 32));
+}
+
+TEST(LatencyHistogramTest, MergeAndClear) {
+  LatencyHistogram a, b;
+  a.Add(100);
+  b.Add(200);
+  b.Add(static_cast<uint64_t>(1) << 40);  // Past the last bucket.
+  a.Merge(b);
+  EXPECT_EQ(3U, a.count());
+  EXPECT_EQ(100U, a.min_us());
+  EXPECT_EQ(static_cast<uint64_t>(1) << 40, a.PercentileUs(100));
+
+  a.Clear();
+  EXPECT_EQ(0U, a.count());
+  EXPECT_EQ(0U, a.min_us());
+  EXPECT_EQ(0U, a.max_us());
+}
+
+}  // namespace mlab
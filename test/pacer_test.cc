@@ -0,0 +1,88 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/pacer.h"
+
+#include "clock.h"
+#include "gtest/gtest.h"
+
+namespace mlab {
+
+TEST(PacerTest, HoldsRate) {
+  // 100 kB at 1 MB/s, less the initial burst, takes about 100 ms.
+  Pacer pacer(1000 * 1000);
+  const uint64_t start_us = MonotonicNowUs();
+  for (int i = 0; i < 100; ++i) {
+    pacer.Wait();
+    pacer.Sent(1000);
+  }
+  const uint64_t elapsed_us = MonotonicNowUs() - start_us;
+  EXPECT_GE(elapsed_us, 80U * 1000);
+  EXPECT_LE(elapsed_us, 200U * 1000);
+
+  EXPECT_EQ(100000U, pacer.total_bytes());
+  uint64_t bytes, interval_us;
+  pacer.ReadInterval(&bytes, &interval_us);
+  EXPECT_EQ(100000U, bytes);
+  EXPECT_GE(interval_us, elapsed_us);
+
+  pacer.ReadInterval(&bytes, &interval_us);
+  EXPECT_EQ(0U, bytes);
+  EXPECT_EQ(100000U, pacer.total_bytes());
+}
+
+TEST(PacerTest, RepaysOverdraw) {
+  Pacer pacer(1000 * 1000, 1000);
+  EXPECT_EQ(0U, pacer.DelayUs());
+
+  // A 11 kB send overdraws the 1 kB bucket by 10 kB: 10 ms at 1 MB/s.
+  pacer.Sent(11000);
+  const uint64_t delay_us = pacer.DelayUs();
+  EXPECT_GT(delay_us, 5U * 1000);
+  EXPECT_LE(delay_us, 10U * 1000);
+
+  pacer.Wait();
+  EXPECT_EQ(0U, pacer.DelayUs());
+}
+
+TEST(PacerTest, UnevenRate) {
+  // 6.25 bytes per microsecond. Polling much more often than a byte's worth
+  // of time passes must not earn more than the rate. The bucket holds a
+  // second's worth and is emptied first, so being descheduled never caps what
+  // is earned in the test's 100 ms.
+  const uint64_t rate = 6250 * 1000;
+  const uint64_t created_us = MonotonicNowUs();
+  Pacer pacer(rate, rate);
+  pacer.Sent(rate);
+  const uint64_t start_us = MonotonicNowUs();
+  uint64_t polled_us = start_us;
+  while (polled_us - start_us < 100 * 1000) {
+    if (pacer.DelayUs() == 0)
+      pacer.Sent(10);
+    polled_us = MonotonicNowUs();
+  }
+  // Spend what is left, so the bucket ends within one send of empty. A pacer
+  // that earns on every poll would never run dry, so give up eventually.
+  for (int i = 0; i < 1000000 && pacer.DelayUs() == 0; ++i)
+    pacer.Sent(10);
+  const uint64_t end_us = MonotonicNowUs();
+
+  // The emptied burst plus what was earned, give or take a send.
+  const uint64_t most = rate + rate * (end_us - created_us) / 1000000;
+  const uint64_t least = rate + rate * (polled_us - start_us) / 1000000;
+  EXPECT_LE(pacer.total_bytes(), most + 10);
+  EXPECT_GE(pacer.total_bytes(), least - 11);
+}
+
+}  // namespace mlab
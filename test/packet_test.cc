@@ -81,4 +81,92 @@ TEST(PacketTest, ToPOD) {
   EXPECT_EQ(message, p.as<uint32_t>());
 }
 
+TEST(PacketTest, Empty) {
+  Packet p;
+  EXPECT_EQ(0U, p.length());
+  EXPECT_EQ(NULL, p.buffer());
+  EXPECT_TRUE(p.str().empty());
+  EXPECT_EQ(0U, p.as<uint32_t>());
+}
+
+TEST(PacketTest, CopySharesBuffer) {
+  Packet p(buffer, strlen(buffer));
+  Packet copy(p);
+  EXPECT_EQ(p.buffer(), copy.buffer());
+  EXPECT_EQ(p.length(), copy.length());
+
+  Packet assigned;
+  assigned = copy;
+  EXPECT_EQ(p.buffer(), assigned.buffer());
+  assigned = assigned;
+  EXPECT_STREQ(buffer, assigned.str().c_str());
+}
+
+TEST(PacketTest, Slice) {
+  Packet p(buffer, strlen(buffer));
+  Packet world = p.Slice(6, 5);
+  EXPECT_EQ(p.buffer() + 6, world.buffer());
+  EXPECT_EQ("world", world.str());
+
+  Packet orl = world.Slice(1, 3);
+  EXPECT_EQ("orl", orl.str());
+  EXPECT_EQ('o', orl.as<char>());
+}
+
+TEST(PacketTest, SliceIsClamped) {
+  Packet p(buffer, strlen(buffer));
+  EXPECT_EQ("world", p.Slice(6, 100).str());
+  EXPECT_EQ(0U, p.Slice(100, 5).length());
+  EXPECT_EQ(0U, p.Slice(3, 0).length());
+}
+
+TEST(PacketTest, SliceOutlivesParent) {
+  Packet* p = new Packet(buffer, strlen(buffer));
+  Packet hello = p->Slice(0, 5);
+  delete p;
+  EXPECT_EQ("hello", hello.str());
+}
+
+TEST(PacketTest, UnalignedAs) {
+  const uint8_t bytes[] = { 0, 0xd2, 0x04, 0, 0 };
+  Packet p(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+  EXPECT_EQ(1234U, p.Slice(1, 4).as<uint32_t>());
+}
+
+TEST(PacketTest, Allocate) {
+  Packet p = Packet::Allocate(5);
+  EXPECT_EQ(5U, p.length());
+  memcpy(p.mutable_buffer(), "hello", 5);
+  EXPECT_EQ("hello", p.str());
+  EXPECT_EQ(0U, Packet::Allocate(0).length());
+}
+
+TEST(PacketTest, MutableBufferCopiesSharedStorage) {
+  Packet p(buffer, strlen(buffer));
+  Packet slice = p.Slice(0, 5);
+  slice.mutable_buffer()[0] = 'j';
+  EXPECT_EQ("jello", slice.str());
+  EXPECT_STREQ(buffer, p.str().c_str());
+  EXPECT_NE(p.buffer(), slice.buffer());
+
+  // No other references remain so this should write in place.
+  const char* before = slice.buffer();
+  slice.mutable_buffer()[0] = 'h';
+  EXPECT_EQ(before, slice.buffer());
+}
+
+TEST(PacketTest, Unowned) {
+  char bytes[] = "hello world";
+  Packet p = Packet::Unowned(bytes, 5);
+  EXPECT_EQ(bytes, p.buffer());
+  Packet copy = p;
+  EXPECT_EQ(bytes + 1, copy.Slice(1, 3).buffer());
+
+  // Writing copies rather than touching the borrowed bytes.
+  copy.mutable_buffer()[0] = 'j';
+  EXPECT_EQ("jello", copy.str());
+  EXPECT_STREQ("hello world", bytes);
+  EXPECT_EQ(0U, Packet::Unowned(bytes, 0).length());
+}
+
 }  // namespace mlab
@@ -0,0 +1,109 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/protocol_header.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace mlab {
+namespace {
+
+// RFC 1071 a byte pair at a time, in network byte order.
+uint16_t ReferenceCheckSum(const char* buffer, size_t len) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < len; i += 2) {
+    sum += bytes[i] << 8;
+    if (i + 1 < len)
+      sum += bytes[i + 1];
+  }
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return htons(~sum & 0xffff);
+}
+
+}  // namespace
+
+TEST(ProtocolHeaderTest, CheckSumExample) {
+  // The example from RFC 1071, section 3.
+  const uint8_t bytes[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+  EXPECT_EQ(0x220d, ntohs(InternetCheckSum(
+      reinterpret_cast<const char*>(bytes), sizeof(bytes))));
+  EXPECT_EQ(0xffff, InternetCheckSum(NULL, 0));
+}
+
+TEST(ProtocolHeaderTest, CheckSumMatchesReference) {
+  srand(1071);
+  std::vector<char> buffer(1100);
+  for (size_t i = 0; i < buffer.size(); ++i)
+    buffer[i] = rand();
+
+  // Every length up past the vector paths' block sizes, at every alignment.
+  for (size_t offset = 0; offset < 4; ++offset) {
+    for (size_t len = 0; len + offset <= buffer.size(); ++len) {
+      ASSERT_EQ(ReferenceCheckSum(&buffer[offset], len),
+                InternetCheckSum(&buffer[offset], len))
+          << "offset " << offset << ", length " << len;
+    }
+  }
+
+  // Long enough to empty the vector accumulators midway.
+  std::vector<char> ones(3 * 1000 * 1000 + 1, '\xff');
+  EXPECT_EQ(ReferenceCheckSum(&ones[0], ones.size()),
+            InternetCheckSum(&ones[0], ones.size()));
+}
+
+TEST(ProtocolHeaderTest, CheckSumVerifies) {
+  char packet[sizeof(ICMP4Header) + 11] = "";
+  ICMP4Header header(8, 0, 0, htonl(0x12345678));
+  memcpy(packet, &header, sizeof(header));
+  memcpy(packet + sizeof(header), "hello world", 11);
+  header.icmp_checksum = InternetCheckSum(packet, sizeof(packet));
+  memcpy(packet, &header, sizeof(header));
+  EXPECT_EQ(0, InternetCheckSum(packet, sizeof(packet)));
+}
+
+TEST(ProtocolHeaderTest, IncrementalUpdate) {
+  srand(1624);
+  char packet[64];
+  for (size_t i = 0; i < sizeof(packet); ++i)
+    packet[i] = rand();
+
+  uint16_t checksum = InternetCheckSum(packet, sizeof(packet));
+  for (int i = 0; i < 1000; ++i) {
+    // A 16-bit field, such as the word holding the TTL.
+    uint16_t old16, new16 = rand();
+    memcpy(&old16, packet + 8, sizeof(old16));
+    memcpy(packet + 8, &new16, sizeof(new16));
+    checksum = UpdateCheckSum(checksum, old16, new16);
+    ASSERT_EQ(InternetCheckSum(packet, sizeof(packet)), checksum);
+
+    // A 32-bit field, such as an echo's identifier and sequence number.
+    uint32_t old32, new32 = rand();
+    memcpy(&old32, packet + 4, sizeof(old32));
+    memcpy(packet + 4, &new32, sizeof(new32));
+    checksum = UpdateCheckSum32(checksum, old32, new32);
+    ASSERT_EQ(InternetCheckSum(packet, sizeof(packet)), checksum);
+  }
+
+  // No change leaves the checksum alone.
+  EXPECT_EQ(checksum, UpdateCheckSum(checksum, 0x1234, 0x1234));
+}
+
+}  // namespace mlab
@@ -0,0 +1,76 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/sharded_server.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/host.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+namespace {
+const uint16_t kShardedPort = 5007;
+const size_t kNumWorkers = 4;
+const size_t kNumClients = 32;
+
+// Greets each connection and hangs up.
+class GreetingHandler : public ShardedServer::Handler {
+ public:
+  GreetingHandler() : accepted_(0) { }
+
+  virtual void OnAccept(EventLoop*, AcceptedSocket* socket) {
+    __sync_add_and_fetch(&accepted_, 1);
+    ssize_t num_bytes;
+    EXPECT_TRUE(socket->SendFrom("hi", 2, &num_bytes));
+    delete socket;
+  }
+
+  long accepted() const { return accepted_; }
+
+ private:
+  volatile long accepted_;
+};
+}  // namespace
+
+TEST(ShardedServerTest, AcceptsAndGreets) {
+  GreetingHandler handler;
+  scoped_ptr<ShardedServer> server(ShardedServer::CreateOrDie(
+      kShardedPort, SOCKETFAMILY_IPV4, kNumWorkers, 64, &handler));
+  EXPECT_EQ(kNumWorkers, server->num_workers());
+  ASSERT_TRUE(server->Start());
+
+  std::vector<ClientSocket*> clients;
+  for (size_t i = 0; i < kNumClients; ++i) {
+    clients.push_back(ClientSocket::CreateOrDie(
+        Host("127.0.0.1"), kShardedPort, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  }
+  for (size_t i = 0; i < kNumClients; ++i) {
+    char greeting[2];
+    ssize_t num_bytes;
+    EXPECT_TRUE(clients[i]->ReceiveInto(greeting, sizeof(greeting),
+                                        &num_bytes));
+    EXPECT_EQ("hi", std::string(greeting, num_bytes));
+    delete clients[i];
+  }
+
+  server->Stop();
+  EXPECT_EQ(static_cast<long>(kNumClients), handler.accepted());
+}
+
+}  // namespace mlab
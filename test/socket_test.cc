@@ -14,18 +14,26 @@
 
 #if defined(OS_LINUX) || defined(OS_MACOSX) || defined(OS_FREEBSD)
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #elif defined(OS_WINDOWS)
 #else
 #error Undefined platform.
 #endif
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #if defined(OS_WINDOWS)
 #include <winsock2.h>
 #endif
 
+#include <vector>
+
+#include "clock.h"
 #include "gtest/gtest.h"
 #include "log.h"
 #include "mlab/accepted_socket.h"
@@ -47,20 +55,25 @@ class SocketTestBase : public ::testing::Test {
   static const int port;
 
   SocketTestBase() {
-    // Start up server thread.
-    pthread_t server_thread_id;
     sem_init(&server_ready_, 0, 0);
-    pthread_create(&server_thread_id, 0, &ServerThread, this);
-    pthread_detach(server_thread_id);
   }
 
   virtual ~SocketTestBase() { }
 
   virtual void SetUp() {
+    // Start up server thread. Not from the constructor, as the thread calls
+    // |Server|, which isn't there until the subclass is constructed.
+    pthread_create(&server_thread_id_, 0, &ServerThread, this);
+
     // Wait for server to be listening.
     sem_wait(&server_ready_);
   }
 
+  virtual void TearDown() {
+    // The next test listens on the same port.
+    pthread_join(server_thread_id_, NULL);
+  }
+
   virtual void Server() = 0;
 
   sem_t server_ready_;
@@ -71,6 +84,8 @@ class SocketTestBase : public ::testing::Test {
     self->Server();
     return NULL;
   }
+
+  pthread_t server_thread_id_;
 };
 
 // static
@@ -152,6 +167,56 @@ class SocketTest : public SocketTestBase {
     LOG(INFO, "<< Received %s", buffer.buffer());
     EXPECT_STREQ(message_str, buffer.str().c_str());
   }
+
+  void SendFromAndReceiveInto() {
+    const mlab::Host& host = localhost;
+    mlab::scoped_ptr<mlab::ClientSocket> client_socket(
+        mlab::ClientSocket::CreateOrDie(host, port, T::type, T::family));
+
+    ssize_t num_bytes = -1;
+    EXPECT_TRUE(client_socket->SendFrom(message_str, strlen(message_str),
+                                        &num_bytes));
+    EXPECT_EQ(strlen(message_str), static_cast<size_t>(num_bytes));
+
+    char buffer[sizeof(message_str)] = { 0 };
+    num_bytes = -1;
+    EXPECT_TRUE(client_socket->ReceiveInto(buffer, strlen(message_str),
+                                           &num_bytes));
+    EXPECT_EQ(strlen(message_str), static_cast<size_t>(num_bytes));
+    EXPECT_STREQ(message_str, buffer);
+  }
+
+  void SendVAndReceiveV() {
+    const mlab::Host& host = localhost;
+    mlab::scoped_ptr<mlab::ClientSocket> client_socket(
+        mlab::ClientSocket::CreateOrDie(host, port, T::type, T::family));
+
+    // Gather "he" and "llo" into a single send.
+    iovec send_iov[2];
+    send_iov[0].iov_base = const_cast<char*>(message_str);
+    send_iov[0].iov_len = 2;
+    send_iov[1].iov_base = const_cast<char*>(message_str + 2);
+    send_iov[1].iov_len = strlen(message_str) - 2;
+
+    ssize_t num_bytes = -1;
+    EXPECT_TRUE(client_socket->SendV(send_iov, 2, &num_bytes));
+    EXPECT_EQ(strlen(message_str), static_cast<size_t>(num_bytes));
+
+    // Scatter the echo into "hel" and "lo".
+    char head[4] = { 0 };
+    char tail[3] = { 0 };
+    iovec recv_iov[2];
+    recv_iov[0].iov_base = head;
+    recv_iov[0].iov_len = 3;
+    recv_iov[1].iov_base = tail;
+    recv_iov[1].iov_len = 2;
+
+    num_bytes = -1;
+    EXPECT_TRUE(client_socket->ReceiveV(recv_iov, 2, &num_bytes));
+    EXPECT_EQ(strlen(message_str), static_cast<size_t>(num_bytes));
+    EXPECT_STREQ("hel", head);
+    EXPECT_STREQ("lo", tail);
+  }
 };
 
 typedef TypeFamilyPair<SOCKETTYPE_TCP, SOCKETFAMILY_IPV4> TCPIPv4;
@@ -175,6 +240,26 @@ const mlab::Host SocketTest<TCPIPv6>::localhost("::1");
 template<>
 const mlab::Host SocketTest<UDPIPv6>::localhost("::1");
 
+// Receives |length| bytes on |socket| from a thread of its own.
+struct Drain {
+  ClientSocket* socket;
+  size_t length;
+  std::string received;
+};
+
+void* DrainThread(void* that) {
+  Drain* drain = static_cast<Drain*>(that);
+  char buffer[16384];
+  while (drain->received.size() < drain->length) {
+    ssize_t num_bytes;
+    if (!drain->socket->ReceiveInto(buffer, sizeof(buffer), &num_bytes) ||
+        num_bytes <= 0)
+      break;
+    drain->received.append(buffer, num_bytes);
+  }
+  return NULL;
+}
+
 }  // namespace
 
 typedef ::testing::Types<TCPIPv4, UDPIPv4, TCPIPv6, UDPIPv6> TestParameters;
@@ -184,6 +269,624 @@ TYPED_TEST(SocketTest, SendAndReceive) {
   this->SendAndReceive();
 }
 
+TYPED_TEST(SocketTest, SendFromAndReceiveInto) {
+  this->SendFromAndReceiveInto();
+}
+
+TYPED_TEST(SocketTest, SendVAndReceiveV) {
+  this->SendVAndReceiveV();
+}
+
+TEST(SocketTest, UDPBatch) {
+  const uint16_t batch_port = 5001;
+  const size_t kNumDatagrams = 3;
+  const char* messages[kNumDatagrams] = { "one", "two", "three" };
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(batch_port, SOCKETTYPE_UDP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), batch_port,
+                                      SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+
+  Datagram outgoing[kNumDatagrams];
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    outgoing[i] = Datagram(const_cast<char*>(messages[i]),
+                           strlen(messages[i]));
+  }
+  size_t num_datagrams = 0;
+  EXPECT_TRUE(client->SendBatch(outgoing, kNumDatagrams, &num_datagrams));
+  EXPECT_EQ(kNumDatagrams, num_datagrams);
+  for (size_t i = 0; i < kNumDatagrams; ++i)
+    EXPECT_EQ(strlen(messages[i]), static_cast<size_t>(outgoing[i].num_bytes));
+
+  char buffers[kNumDatagrams][16];
+  Datagram incoming[kNumDatagrams];
+  size_t received = 0;
+  while (received < kNumDatagrams) {
+    for (size_t i = received; i < kNumDatagrams; ++i)
+      incoming[i] = Datagram(buffers[i], sizeof(buffers[i]));
+    ASSERT_TRUE(server->ReceiveBatch(&incoming[received],
+                                     kNumDatagrams - received,
+                                     &num_datagrams));
+    ASSERT_GT(num_datagrams, 0U);
+    received += num_datagrams;
+  }
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    EXPECT_EQ(messages[i], std::string(buffers[i], incoming[i].num_bytes));
+    EXPECT_EQ(sizeof(sockaddr_in), incoming[i].peer_len);
+    EXPECT_EQ(AF_INET, incoming[i].peer.ss_family);
+  }
+
+  // Echo each datagram back to the peer it came from.
+  for (size_t i = 0; i < kNumDatagrams; ++i)
+    incoming[i].length = incoming[i].num_bytes;
+  EXPECT_TRUE(server->SendBatch(incoming, kNumDatagrams, &num_datagrams));
+  EXPECT_EQ(kNumDatagrams, num_datagrams);
+
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    char echo[16];
+    ssize_t num_bytes;
+    EXPECT_TRUE(client->ReceiveInto(echo, sizeof(echo), &num_bytes));
+    EXPECT_EQ(messages[i], std::string(echo, num_bytes));
+  }
+}
+
+TEST(SocketTest, UDPSegmentationOffload) {
+  const uint16_t offload_port = 5002;
+  const uint16_t segment_size = 100;
+  const size_t num_segments = 3;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(offload_port, SOCKETTYPE_UDP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), offload_port,
+                                      SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+
+  if (!client->EnableSegmentationOffload(segment_size) ||
+      !server->EnableSegmentationOffload(segment_size)) {
+    LOG(WARNING, "UDP segmentation offload unsupported; skipping.");
+    return;
+  }
+
+  // One send of three segments' worth of bytes.
+  char payload[segment_size * num_segments];
+  for (size_t i = 0; i < sizeof(payload); ++i)
+    payload[i] = 'a' + i / segment_size;
+  ssize_t num_bytes;
+  EXPECT_TRUE(client->SendFrom(payload, sizeof(payload), &num_bytes));
+  EXPECT_EQ(sizeof(payload), static_cast<size_t>(num_bytes));
+
+  // The kernel may deliver the segments coalesced or one at a time.
+  char buffer[sizeof(payload)];
+  size_t received = 0;
+  while (received < sizeof(payload)) {
+    Datagram datagram(buffer + received, sizeof(buffer) - received);
+    size_t num_datagrams;
+    ASSERT_TRUE(server->ReceiveBatch(&datagram, 1, &num_datagrams));
+    ASSERT_EQ(1U, num_datagrams);
+    if (datagram.segment_size == 0) {
+      EXPECT_EQ(segment_size, datagram.num_bytes);
+    } else {
+      EXPECT_EQ(segment_size, datagram.segment_size);
+      EXPECT_EQ(0, datagram.num_bytes % segment_size);
+    }
+    received += datagram.num_bytes;
+  }
+  EXPECT_EQ(sizeof(payload), received);
+  EXPECT_EQ(0, memcmp(payload, buffer, sizeof(payload)));
+}
+
+TEST(SocketTest, UDPTimestamping) {
+  const uint16_t timestamp_port = 5012;
+  const size_t kNumDatagrams = 2;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(timestamp_port, SOCKETTYPE_UDP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), timestamp_port,
+                                      SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+
+  if (!client->EnableTimestamping(false) ||
+      !server->EnableTimestamping(false)) {
+    LOG(WARNING, "Timestamping unsupported; skipping.");
+    return;
+  }
+  // The kernel turns on receive timestamps from a deferred work item, so warm
+  // up from another socket until they show up.
+  mlab::scoped_ptr<mlab::ClientSocket> warmer(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), timestamp_port,
+                                      SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+  const uint64_t deadline_us = mlab::Socket::DeadlineAfterMs(1000);
+  bool stamped = false;
+  while (!stamped && mlab::MonotonicNowUs() < deadline_us) {
+    ssize_t num_bytes;
+    ASSERT_TRUE(warmer->SendFrom("warm", 4, &num_bytes));
+    char buffer[16];
+    Datagram datagram(buffer, sizeof(buffer));
+    size_t num_datagrams;
+    ASSERT_TRUE(server->ReceiveBatch(&datagram, 1, &num_datagrams));
+    stamped = datagram.timestamp.software_ns > 0;
+  }
+  ASSERT_TRUE(stamped);
+
+  PacketTimestamp sent[kNumDatagrams];
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    ssize_t num_bytes;
+    EXPECT_TRUE(client->SendFrom("ping", 4, &num_bytes));
+    ASSERT_TRUE(client->GetSendTimestamp(&sent[i], 1000));
+    EXPECT_EQ(i, sent[i].id);
+    EXPECT_GT(sent[i].software_ns, 0U);
+  }
+  EXPECT_LE(sent[0].software_ns, sent[1].software_ns);
+
+  // Nothing more was sent.
+  PacketTimestamp extra;
+  EXPECT_FALSE(client->GetSendTimestamp(&extra, 0));
+
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    char buffer[16];
+    Datagram datagram(buffer, sizeof(buffer));
+    size_t num_datagrams;
+    ASSERT_TRUE(server->ReceiveBatch(&datagram, 1, &num_datagrams));
+    ASSERT_EQ(1U, num_datagrams);
+    EXPECT_EQ(4, datagram.num_bytes);
+    EXPECT_GE(datagram.timestamp.software_ns, sent[i].software_ns);
+  }
+}
+
+TEST(SocketTest, TCPZeroCopy) {
+  const uint16_t zerocopy_port = 5003;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(zerocopy_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), zerocopy_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+
+  if (!client->EnableZeroCopy()) {
+    LOG(WARNING, "Zero-copy send unsupported; skipping.");
+    return;
+  }
+
+  Packet payload(std::string(4096, 'z'));
+  ssize_t num_bytes;
+  EXPECT_TRUE(client->SendZeroCopy(payload, &num_bytes));
+  EXPECT_EQ(payload.length(), static_cast<size_t>(num_bytes));
+
+  const char message[] = "zero-copy";
+  uint32_t send_id;
+  EXPECT_TRUE(client->SendFromZeroCopy(message, strlen(message), &num_bytes,
+                                       &send_id));
+  EXPECT_EQ(strlen(message), static_cast<size_t>(num_bytes));
+
+  while (client->ReapZeroCopyCompletions(true) > 0) { }
+  EXPECT_TRUE(client->IsZeroCopyComplete(send_id));
+  EXPECT_FALSE(client->IsZeroCopyComplete(send_id + 1));
+
+  const size_t total = payload.length() + strlen(message);
+  char buffer[8192];
+  size_t received = 0;
+  while (received < total) {
+    ASSERT_TRUE(server->ReceiveInto(buffer + received, total - received,
+                                    &num_bytes));
+    ASSERT_GT(num_bytes, 0);
+    received += num_bytes;
+  }
+  EXPECT_EQ(payload.str() + message, std::string(buffer, total));
+}
+
+TEST(SocketTest, SendFileAndSplice) {
+  const uint16_t bulk_port = 5004;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(bulk_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), bulk_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+
+  std::string contents;
+  for (int i = 0; i < 1000; ++i)
+    contents += static_cast<char>('a' + i % 26);
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  ASSERT_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), file));
+  fflush(file);
+
+  // sendfile from an offset into the file.
+  ssize_t num_bytes;
+  EXPECT_TRUE(server->SendFile(fileno(file), 10, 100, &num_bytes));
+  EXPECT_EQ(100, num_bytes);
+
+  // splice from the file's current position, through an internal pipe.
+  rewind(file);
+  EXPECT_TRUE(server->Splice(fileno(file), 50, &num_bytes));
+  EXPECT_EQ(50, num_bytes);
+
+  // splice straight from a pipe.
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  ASSERT_EQ(5, write(pipe_fds[1], "piped", 5));
+  close(pipe_fds[1]);
+  EXPECT_TRUE(server->Splice(pipe_fds[0], 100, &num_bytes));
+  EXPECT_EQ(5, num_bytes);
+  close(pipe_fds[0]);
+
+  // Stops at end of file.
+  EXPECT_TRUE(server->SendFile(fileno(file), 990, 100, &num_bytes));
+  EXPECT_EQ(10, num_bytes);
+  fclose(file);
+
+  const std::string expected = contents.substr(10, 100) +
+      contents.substr(0, 50) + "piped" + contents.substr(990);
+  std::string received;
+  char buffer[256];
+  while (received.size() < expected.size()) {
+    ASSERT_TRUE(client->ReceiveInto(buffer, sizeof(buffer), &num_bytes));
+    ASSERT_GT(num_bytes, 0);
+    received.append(buffer, num_bytes);
+  }
+  EXPECT_EQ(expected, received);
+}
+
+TEST(SocketTest, SpliceNonBlocking) {
+  const uint16_t splice_port = 5022;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(splice_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), splice_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  ASSERT_TRUE(server->SetNonBlocking(true));
+  ASSERT_TRUE(server->SetSendBufferSize(4096));
+
+  // Far more than the socket buffers hold, so the socket fills while bytes
+  // are still in the internal pipe.
+  std::string contents;
+  for (int i = 0; i < (1 << 20); ++i)
+    contents += static_cast<char>('a' + i % 26);
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  ASSERT_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), file));
+  fflush(file);
+  rewind(file);
+
+  Drain drain;
+  drain.socket = client.get();
+  drain.length = contents.size();
+  pthread_t drain_thread;
+  ASSERT_EQ(0, pthread_create(&drain_thread, NULL, &DrainThread, &drain));
+
+  // Every byte taken from the file reaches the peer.
+  ssize_t num_bytes;
+  EXPECT_TRUE(server->Splice(fileno(file), contents.size(), &num_bytes));
+  EXPECT_EQ(static_cast<ssize_t>(contents.size()), num_bytes);
+  // Closing the sender ends the drain even if bytes went missing.
+  shutdown(server->raw(), SHUT_WR);
+  pthread_join(drain_thread, NULL);
+  fclose(file);
+  EXPECT_TRUE(drain.received == contents);
+}
+
+TEST(SocketTest, BulkSendNoSigPipe) {
+  const uint16_t sigpipe_port = 5023;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(sigpipe_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::ClientSocket* client =
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), sigpipe_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4);
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  ASSERT_TRUE(server->SetNoSigPipe());
+
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  ASSERT_EQ(100U, fwrite(std::string(100, 'x').data(), 1, 100, file));
+  fflush(file);
+
+  // The first send after the peer closes draws a reset; later ones fail with
+  // EPIPE, which would raise SIGPIPE and end the test.
+  delete client;
+  ssize_t num_bytes;
+  int attempts = 0;
+  while (attempts < 10 && server->SendFile(fileno(file), 0, 100, &num_bytes))
+    ++attempts;
+  EXPECT_LT(attempts, 10);
+  EXPECT_TRUE(errno == EPIPE || errno == ECONNRESET);
+
+  rewind(file);
+  EXPECT_FALSE(server->Splice(fileno(file), 100, &num_bytes));
+  EXPECT_EQ(EPIPE, errno);
+  fclose(file);
+}
+
+TEST(SocketTest, ListenGroup) {
+  const uint16_t group_port = 5006;
+  const size_t kGroupSize = 3;
+
+  std::vector<mlab::ListenSocket*> group;
+  ASSERT_TRUE(mlab::ListenSocket::CreateGroup(group_port, SOCKETTYPE_TCP,
+                                              SOCKETFAMILY_IPV4, 16, kGroupSize,
+                                              &group));
+  ASSERT_EQ(kGroupSize, group.size());
+  for (size_t i = 0; i < kGroupSize; ++i) {
+    EXPECT_TRUE(group[i]->IsNonBlocking());
+    for (size_t j = 0; j < i; ++j)
+      EXPECT_NE(group[j]->raw(), group[i]->raw());
+  }
+
+  // The connection lands in exactly one listener's queue.
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), group_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  size_t accepted = 0;
+  for (size_t i = 0; i < kGroupSize; ++i) {
+    mlab::scoped_ptr<mlab::AcceptedSocket> server(group[i]->Accept());
+    if (server.get() == NULL) {
+      EXPECT_EQ(EAGAIN, errno);
+      continue;
+    }
+    EXPECT_TRUE(server->IsNonBlocking());
+    ++accepted;
+  }
+  EXPECT_EQ(1U, accepted);
+
+  for (size_t i = 0; i < kGroupSize; ++i)
+    delete group[i];
+}
+
+#if defined(OS_LINUX)
+TEST(SocketTest, ListenGroupPortInUse) {
+  const uint16_t busy_port = 5021;
+
+  // A listener without SO_REUSEPORT keeps the group off its port, which
+  // fails the group rather than the process.
+  mlab::scoped_ptr<mlab::ListenSocket> listener(
+      mlab::ListenSocket::CreateOrDie(busy_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  std::vector<mlab::ListenSocket*> group;
+  EXPECT_FALSE(mlab::ListenSocket::CreateGroup(busy_port, SOCKETTYPE_TCP,
+                                               SOCKETFAMILY_IPV4, 16, 2,
+                                               &group));
+  EXPECT_TRUE(group.empty());
+  EXPECT_TRUE(mlab::ListenSocket::Create(busy_port, SOCKETTYPE_TCP,
+                                         SOCKETFAMILY_IPV4) == NULL);
+}
+
+TEST(SocketTest, OptionProfile) {
+  const uint16_t options_port = 5015;
+
+  SocketOptions listen_options;
+  listen_options.set_nodelay(true);
+  listen_options.set_notsent_lowat(16384);
+  listen_options.set_congestion("reno");
+  listen_options.set_priority(3);
+  listen_options.set_send_buffer_size(64 * 1024);
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(options_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4,
+                                      mlab::ListenSocket::kDefaultBacklog,
+                                      listen_options));
+  EXPECT_EQ(listen_options.options(), listen_socket->honored_options());
+
+  // An algorithm the kernel doesn't have isn't honored; the rest still are.
+  SocketOptions client_options;
+  client_options.set_nodelay(true);
+  client_options.set_congestion("no-such-algorithm");
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), options_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4,
+                                      client_options));
+  EXPECT_EQ(SOCKETOPTION_NODELAY, client->honored_options());
+
+  // Accepted sockets inherit the listener's profile.
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  EXPECT_EQ(listen_options.options(), server->honored_options());
+  int nodelay = 0;
+  socklen_t nodelay_len = sizeof(nodelay);
+  ASSERT_EQ(0, getsockopt(server->raw(), IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                          &nodelay_len));
+  EXPECT_NE(0, nodelay);
+  char congestion[16] = { 0 };
+  socklen_t congestion_len = sizeof(congestion) - 1;
+  ASSERT_EQ(0, getsockopt(server->raw(), IPPROTO_TCP, TCP_CONGESTION,
+                          congestion, &congestion_len));
+  EXPECT_STREQ("reno", congestion);
+
+  // TCP options are skipped on UDP sockets.
+  SocketOptions udp_options;
+  udp_options.set_nodelay(true);
+  udp_options.set_recv_buffer_size(64 * 1024);
+  udp_options.set_recv_timeout_ms(250);
+  mlab::scoped_ptr<mlab::ClientSocket> udp_client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), options_port,
+                                      SOCKETTYPE_UDP, SOCKETFAMILY_IPV4,
+                                      udp_options));
+  EXPECT_EQ(SOCKETOPTION_RECV_BUFFER | SOCKETOPTION_RECV_TIMEOUT,
+            udp_client->honored_options());
+  EXPECT_EQ(250U, udp_client->recv_timeout_ms());
+}
+#endif
+
+#if defined(OS_LINUX)
+TEST(SocketTest, Pacing) {
+  const uint16_t pacing_port = 5016;
+
+  // UDP is paced in user space: 50 kB at 1 MB/s, less the initial burst,
+  // takes about 50 ms.
+  mlab::scoped_ptr<mlab::ListenSocket> udp_listen(
+      mlab::ListenSocket::CreateOrDie(pacing_port, SOCKETTYPE_UDP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::ClientSocket> udp_client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), pacing_port,
+                                      SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+  EXPECT_EQ(mlab::PACING_OFF, udp_client->pacing_mode());
+  uint64_t bytes, elapsed_us;
+  EXPECT_FALSE(udp_client->ReadPacingInterval(&bytes, &elapsed_us));
+
+  ASSERT_EQ(mlab::PACING_USER_SPACE, udp_client->EnablePacing(8 * 1000 * 1000));
+  const std::vector<char> payload(1000, 'p');
+  const uint64_t start_us = mlab::MonotonicNowUs();
+  for (int i = 0; i < 50; ++i) {
+    ssize_t num_bytes;
+    ASSERT_TRUE(udp_client->SendFrom(&payload[0], payload.size(), &num_bytes));
+    ASSERT_EQ(1000, num_bytes);
+  }
+  EXPECT_GE(mlab::MonotonicNowUs() - start_us, 40U * 1000);
+
+  ASSERT_TRUE(udp_client->ReadPacingInterval(&bytes, &elapsed_us));
+  EXPECT_EQ(50000U, bytes);
+  EXPECT_GT(elapsed_us, 0U);
+
+  // A batch is paced per datagram, not sent in one burst.
+  std::vector<Datagram> batch(50, Datagram(const_cast<char*>(&payload[0]),
+                                           payload.size()));
+  size_t num_datagrams = 0;
+  const uint64_t batch_start_us = mlab::MonotonicNowUs();
+  ASSERT_TRUE(udp_client->SendBatch(&batch[0], batch.size(), &num_datagrams));
+  EXPECT_EQ(batch.size(), num_datagrams);
+  EXPECT_GE(mlab::MonotonicNowUs() - batch_start_us, 40U * 1000);
+  ASSERT_TRUE(udp_client->ReadPacingInterval(&bytes, &elapsed_us));
+  EXPECT_EQ(50000U, bytes);
+
+  EXPECT_EQ(mlab::PACING_OFF, udp_client->EnablePacing(0));
+
+  // TCP paces itself in the kernel, so sends don't wait.
+  mlab::scoped_ptr<mlab::ListenSocket> tcp_listen(
+      mlab::ListenSocket::CreateOrDie(pacing_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::ClientSocket> tcp_client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), pacing_port,
+                                      SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  EXPECT_EQ(mlab::PACING_KERNEL, tcp_client->EnablePacing(8 * 1000 * 1000));
+  uint32_t rate = 0;
+  socklen_t rate_len = sizeof(rate);
+  ASSERT_EQ(0, getsockopt(tcp_client->raw(), SOL_SOCKET, SO_MAX_PACING_RATE,
+                          &rate, &rate_len));
+  EXPECT_EQ(1000U * 1000, rate);
+
+  // Rates too fast for 32 bits reach the kernel whole, where it takes them.
+  EXPECT_EQ(mlab::PACING_KERNEL,
+            tcp_client->EnablePacing(8 * 5000ULL * 1000 * 1000));
+  uint64_t fast_rate = 0;
+  rate_len = sizeof(fast_rate);
+  ASSERT_EQ(0, getsockopt(tcp_client->raw(), SOL_SOCKET, SO_MAX_PACING_RATE,
+                          &fast_rate, &rate_len));
+  if (rate_len == sizeof(fast_rate)) {
+    EXPECT_EQ(5000ULL * 1000 * 1000, fast_rate);
+  }
+  EXPECT_EQ(mlab::PACING_KERNEL, tcp_client->EnablePacing(8 * 1000 * 1000));
+
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(tcp_listen->AcceptOrDie());
+  ssize_t num_bytes;
+  ASSERT_TRUE(tcp_client->SendFrom(&payload[0], payload.size(), &num_bytes));
+  ASSERT_TRUE(tcp_client->ReadPacingInterval(&bytes, &elapsed_us));
+  EXPECT_EQ(static_cast<uint64_t>(num_bytes), bytes);
+}
+#endif
+
+TEST(SocketTest, Deadlines) {
+  const uint16_t deadline_port = 5017;
+
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(deadline_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  EXPECT_EQ(mlab::ListenSocket::kDefaultTimeoutMs,
+            listen_socket->recv_timeout_ms());
+
+  // Nobody connects, so the select times out rather than aborting.
+  uint64_t start_us = mlab::MonotonicNowUs();
+  EXPECT_EQ(SOCKETSTATUS_TIMEOUT,
+            listen_socket->SelectUntil(mlab::Socket::DeadlineAfterMs(30)));
+  EXPECT_GE(mlab::MonotonicNowUs() - start_us, 30U * 1000);
+
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateOrDie(mlab::Host("127.0.0.1"), deadline_port));
+  EXPECT_EQ(0U, client->recv_timeout_ms());
+  EXPECT_EQ(SOCKETSTATUS_OK, listen_socket->SelectWithTimeout(5));
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  EXPECT_EQ(mlab::ListenSocket::kDefaultTimeoutMs, server->send_timeout_ms());
+
+  // Nothing has been sent, so the receive times out.
+  char buffer[64];
+  ssize_t num_bytes;
+  start_us = mlab::MonotonicNowUs();
+  EXPECT_EQ(SOCKETSTATUS_TIMEOUT,
+            client->ReceiveUntil(buffer, sizeof(buffer),
+                                 mlab::Socket::DeadlineAfterMs(30),
+                                 &num_bytes));
+  const uint64_t waited_us = mlab::MonotonicNowUs() - start_us;
+  EXPECT_GE(waited_us, 30U * 1000);
+  EXPECT_LT(waited_us, 1000U * 1000);
+  EXPECT_EQ(0, num_bytes);
+
+  // A plain blocking receive gives up after the socket's own timeout.
+  ASSERT_TRUE(client->SetRecvTimeout(20));
+  EXPECT_FALSE(client->ReceiveInto(buffer, sizeof(buffer), &num_bytes));
+  EXPECT_TRUE(errno == EAGAIN || errno == EWOULDBLOCK);
+
+  ASSERT_TRUE(server->SendFrom("deadline", 8, &num_bytes));
+  EXPECT_EQ(SOCKETSTATUS_OK,
+            client->ReceiveUntil(buffer, sizeof(buffer),
+                                 mlab::Socket::DeadlineAfterMs(1000),
+                                 &num_bytes));
+  EXPECT_EQ(8, num_bytes);
+
+  // The server never reads, so a large blocking send stops at the deadline
+  // having sent only part of it.
+  ASSERT_TRUE(client->SetSendBufferSize(16 * 1024));
+  const std::vector<char> payload(16 * 1024 * 1024, 'd');
+  start_us = mlab::MonotonicNowUs();
+  EXPECT_EQ(SOCKETSTATUS_TIMEOUT,
+            client->SendUntil(&payload[0], payload.size(),
+                              mlab::Socket::DeadlineAfterMs(50),
+                              &num_bytes));
+  EXPECT_LT(mlab::MonotonicNowUs() - start_us, 1000U * 1000);
+  EXPECT_GT(num_bytes, 0);
+  EXPECT_LT(static_cast<size_t>(num_bytes), payload.size());
+  EXPECT_EQ(0U, client->send_timeout_ms());
+}
+
+TEST(SocketTest, HappyEyeballs) {
+  const uint16_t eyeballs_port = 5009;
+
+  // Only IPv4 is listening, so an IPv6 attempt for localhost is refused and
+  // the IPv4 attempt wins.
+  mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
+      mlab::ListenSocket::CreateOrDie(eyeballs_port, SOCKETTYPE_TCP,
+                                      SOCKETFAMILY_IPV4));
+  mlab::scoped_ptr<mlab::ClientSocket> client(
+      mlab::ClientSocket::CreateHappyEyeballs(mlab::Host("localhost"),
+                                              eyeballs_port, 2000));
+  ASSERT_TRUE(client.get() != NULL);
+  EXPECT_EQ(SOCKETFAMILY_IPV4, client->family());
+  EXPECT_FALSE(client->IsNonBlocking());
+  EXPECT_NE(0, fcntl(client->raw(), F_GETFD) & FD_CLOEXEC);
+
+  mlab::scoped_ptr<mlab::AcceptedSocket> server(listen_socket->AcceptOrDie());
+  ssize_t num_bytes;
+  EXPECT_TRUE(client->SendFrom("hello", 5, &num_bytes));
+  char buffer[8];
+  EXPECT_TRUE(server->ReceiveInto(buffer, sizeof(buffer), &num_bytes));
+  EXPECT_EQ("hello", std::string(buffer, num_bytes));
+
+  // Nothing is listening here, so every attempt is refused.
+  EXPECT_TRUE(mlab::ClientSocket::CreateHappyEyeballs(
+      mlab::Host("127.0.0.1"), eyeballs_port + 1, 2000) == NULL);
+}
+
 TEST(SocketTest, BufferSize) {
   mlab::scoped_ptr<mlab::ListenSocket> listen_socket(
       mlab::ListenSocket::CreateOrDie(1234, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
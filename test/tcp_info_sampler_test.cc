@@ -0,0 +1,156 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/tcp_info_sampler.h"
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/event_loop.h"
+#include "mlab/host.h"
+#include "mlab/listen_socket.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+namespace {
+const uint16_t kSamplerPort = 5013;
+
+// Stops |loop| after |count| timer callbacks.
+class StopAfter : public EventLoop::TimerHandler {
+ public:
+  StopAfter(EventLoop* loop, int count) : loop_(loop), count_(count) { }
+
+  virtual void OnTimer(uint32_t) {
+    if (--count_ == 0)
+      loop_->Stop();
+    else
+      loop_->AddTimer(10, this);
+  }
+
+ private:
+  EventLoop* loop_;
+  int count_;
+};
+}  // namespace
+
+class TcpInfoSamplerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    listener_ = ListenSocket::CreateOrDie(kSamplerPort, SOCKETTYPE_TCP,
+                                          SOCKETFAMILY_IPV4);
+    client_ = ClientSocket::CreateOrDie(Host("127.0.0.1"), kSamplerPort,
+                                        SOCKETTYPE_TCP, SOCKETFAMILY_IPV4);
+    server_ = listener_->AcceptOrDie();
+
+    // Move some bytes so the counters have something to show.
+    char buffer[1024] = { 0 };
+    ssize_t num_bytes;
+    ASSERT_TRUE(client_->SendFrom(buffer, sizeof(buffer), &num_bytes));
+    size_t received = 0;
+    while (received < sizeof(buffer)) {
+      ASSERT_TRUE(server_->ReceiveInto(buffer, sizeof(buffer), &num_bytes));
+      received += num_bytes;
+    }
+  }
+
+  virtual void TearDown() {
+    delete server_;
+    delete client_;
+    delete listener_;
+  }
+
+  ListenSocket* listener_;
+  ClientSocket* client_;
+  AcceptedSocket* server_;
+};
+
+TEST_F(TcpInfoSamplerTest, SampleNow) {
+  scoped_ptr<TcpInfoSampler> sampler(TcpInfoSampler::CreateOrDie(10, 8));
+  const uint32_t client_flow = sampler->Add(client_);
+  const uint32_t server_flow = sampler->Add(server_);
+  EXPECT_NE(client_flow, server_flow);
+  EXPECT_EQ(2U, sampler->num_flows());
+
+  EXPECT_EQ(2U, sampler->SampleNow());
+  TcpInfoSample samples[4];
+  ASSERT_EQ(2U, sampler->Read(samples, 4));
+  EXPECT_EQ(0U, sampler->size());
+
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_GT(samples[i].time_us, 0U);
+    EXPECT_GT(samples[i].snd_cwnd, 0U);
+    EXPECT_GT(samples[i].snd_mss, 0U);
+    if (samples[i].flow == client_flow) {
+      EXPECT_GE(samples[i].bytes_acked, 1024U);
+    } else {
+      EXPECT_EQ(server_flow, samples[i].flow);
+      EXPECT_GE(samples[i].bytes_received, 1024U);
+    }
+  }
+
+  // A removed flow's id is reused.
+  sampler->Remove(client_flow);
+  EXPECT_EQ(1U, sampler->SampleNow());
+  EXPECT_EQ(client_flow, sampler->Add(client_));
+}
+
+TEST_F(TcpInfoSamplerTest, RingOverwritesOldest) {
+  scoped_ptr<TcpInfoSampler> sampler(TcpInfoSampler::CreateOrDie(10, 3));
+  sampler->Add(client_);
+  for (int i = 0; i < 5; ++i)
+    sampler->SampleNow();
+
+  EXPECT_EQ(3U, sampler->size());
+  EXPECT_EQ(2U, sampler->overwritten());
+
+  TcpInfoSample samples[3];
+  ASSERT_EQ(3U, sampler->Read(samples, 3));
+  EXPECT_LE(samples[0].time_us, samples[1].time_us);
+  EXPECT_LE(samples[1].time_us, samples[2].time_us);
+}
+
+TEST_F(TcpInfoSamplerTest, EventLoop) {
+  scoped_ptr<EventLoop> loop(EventLoop::CreateOrDie());
+  scoped_ptr<TcpInfoSampler> sampler(TcpInfoSampler::CreateOrDie(10, 64));
+  sampler->Add(client_);
+  ASSERT_TRUE(sampler->Start(loop.get()));
+  EXPECT_FALSE(sampler->StartThread());
+
+  StopAfter stop(loop.get(), 5);
+  loop->AddTimer(10, &stop);
+  loop->Run();
+  sampler->Stop();
+
+  EXPECT_GE(sampler->size(), 3U);
+}
+
+TEST_F(TcpInfoSamplerTest, Thread) {
+  scoped_ptr<TcpInfoSampler> sampler(TcpInfoSampler::CreateOrDie(10, 64));
+  sampler->Add(client_);
+  ASSERT_TRUE(sampler->StartThread());
+  usleep(100 * 1000);
+  sampler->Stop();
+
+  const size_t taken = sampler->size();
+  EXPECT_GE(taken, 3U);
+  EXPECT_LE(taken, 12U);
+
+  // Nothing is sampled once stopped.
+  usleep(30 * 1000);
+  EXPECT_EQ(taken, sampler->size());
+}
+
+}  // namespace mlab
@@ -0,0 +1,103 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/capture_socket.h"
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "mlab/client_socket.h"
+#include "mlab/host.h"
+#include "mlab/listen_socket.h"
+#include "mlab/socket.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+
+TEST(CaptureSocketTest, Loopback) {
+  const uint16_t kPort = 5019;
+  const int kNumPackets = 200;
+
+  CaptureOptions options;
+  options.interface = "lo";
+  options.protocol = 0x0800;  // IPv4
+  options.block_size = 1 << 16;
+  options.num_blocks = 8;
+  scoped_ptr<CaptureSocket> capture(CaptureSocket::CreateOrDie(options));
+
+  // A burst of datagrams, more than fit in one block, to a bound port so
+  // no ICMP errors fail the sends.
+  scoped_ptr<ListenSocket> server(
+      ListenSocket::CreateOrDie(kPort, SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+  scoped_ptr<ClientSocket> client(ClientSocket::CreateOrDie(
+      Host("127.0.0.1"), kPort, SOCKETTYPE_UDP, SOCKETFAMILY_IPV4));
+  char payload[512];
+  memset(payload, 'x', sizeof(payload));
+  for (int i = 0; i < kNumPackets; ++i) {
+    ssize_t num_bytes;
+    ASSERT_TRUE(client->SendFrom(payload, sizeof(payload), &num_bytes));
+  }
+
+  // Loopback shows each packet going out and coming in; count the latter.
+  // The link layer header is 14 zero bytes, then the IP and UDP headers.
+  const size_t kUDPOffset = 14 + 20;
+  int received = 0;
+  size_t blocks = 0;
+  const uint64_t deadline_us = Socket::DeadlineAfterMs(2000);
+  while (received < kNumPackets &&
+         capture->WaitForBlock(deadline_us) == SOCKETSTATUS_OK) {
+    ++blocks;
+    CapturedPacket packet;
+    while (capture->NextPacket(&packet)) {
+      EXPECT_EQ(0x0800, packet.protocol);
+      EXPECT_GT(packet.timestamp_ns, 0U);
+      if (packet.packet_type != PACKET_HOST ||
+          packet.data.length() < kUDPOffset + 8 + sizeof(payload)) {
+        continue;
+      }
+      uint16_t port;
+      memcpy(&port, packet.data.buffer() + kUDPOffset + 2, sizeof(port));
+      if (ntohs(port) != kPort)
+        continue;
+      EXPECT_EQ(packet.data.length(), packet.original_length);
+      EXPECT_EQ(0, memcmp(payload, packet.data.buffer() + kUDPOffset + 8,
+                          sizeof(payload)));
+      ++received;
+    }
+  }
+  EXPECT_EQ(kNumPackets, received);
+  EXPECT_GT(blocks, 1U);
+
+  CaptureStats stats;
+  ASSERT_TRUE(capture->GetStats(&stats));
+  EXPECT_GE(stats.packets, static_cast<uint64_t>(kNumPackets));
+  EXPECT_EQ(0U, stats.drops);
+}
+
+TEST(CaptureSocketTest, Timeout) {
+  CaptureOptions options;
+  options.interface = "lo";
+  options.protocol = 0x88b5;  // Local experimental ethertype, never sent.
+  options.block_size = 1 << 16;
+  options.num_blocks = 2;
+  scoped_ptr<CaptureSocket> capture(CaptureSocket::CreateOrDie(options));
+  EXPECT_EQ(SOCKETSTATUS_TIMEOUT,
+            capture->WaitForBlock(Socket::DeadlineAfterMs(50)));
+  CapturedPacket packet;
+  EXPECT_FALSE(capture->NextPacket(&packet));
+}
+
+}  // namespace mlab
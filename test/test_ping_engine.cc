@@ -0,0 +1,88 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/ping_engine.h"
+
+#include "clock.h"
+#include "gtest/gtest.h"
+#include "mlab/host.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+
+TEST(PingEngineTest, LoopbackIPv4) {
+  scoped_ptr<PingEngine> engine(
+      PingEngine::CreateOrDie(SOCKETFAMILY_IPV4, 256, 1000));
+  // Every address in 127/8 answers.
+  ASSERT_EQ(0, engine->AddDestination(Host("127.0.0.1")));
+  ASSERT_EQ(1, engine->AddDestination(Host("127.0.0.2")));
+  EXPECT_EQ(-1, engine->AddDestination(Host("::1")));
+
+  // 4000 probes at 20000 a second take about 200 ms.
+  const uint64_t start_us = MonotonicNowUs();
+  ASSERT_TRUE(engine->Run(2000, 20000));
+  const uint64_t elapsed_us = MonotonicNowUs() - start_us;
+  EXPECT_GE(elapsed_us, 150U * 1000);
+  EXPECT_LT(elapsed_us, 1000U * 1000);
+
+  EXPECT_EQ(0U, engine->outstanding());
+  for (size_t i = 0; i < engine->num_destinations(); ++i) {
+    const PingStats& stats = engine->stats(i);
+    EXPECT_EQ(2000U, stats.sent);
+    EXPECT_EQ(2000U, stats.received);
+    EXPECT_EQ(0U, stats.lost);
+    EXPECT_EQ(0U, stats.late);
+    EXPECT_EQ(2000U, stats.rtt.count());
+    EXPECT_LT(stats.rtt.PercentileUs(50), 100U * 1000);
+  }
+}
+
+TEST(PingEngineTest, LoopbackIPv6) {
+  scoped_ptr<PingEngine> engine(
+      PingEngine::CreateOrDie(SOCKETFAMILY_IPV6, 16, 1000));
+  ASSERT_EQ(0, engine->AddDestination(Host("::1")));
+
+  // Fill the outstanding probes before receiving any reply.
+  for (int i = 0; i < 16; ++i)
+    ASSERT_TRUE(engine->Send(0));
+  EXPECT_FALSE(engine->Send(0));
+  EXPECT_EQ(16U, engine->outstanding());
+
+  ASSERT_TRUE(engine->Finish());
+  EXPECT_EQ(0U, engine->outstanding());
+  EXPECT_EQ(16U, engine->stats(0).received);
+  EXPECT_EQ(0U, engine->stats(0).lost);
+}
+
+TEST(PingEngineTest, Timeout) {
+  scoped_ptr<PingEngine> engine(
+      PingEngine::CreateOrDie(SOCKETFAMILY_IPV4, 16, 100));
+  // TEST-NET-2, which never answers.
+  ASSERT_EQ(0, engine->AddDestination(Host("198.51.100.1")));
+  ASSERT_TRUE(engine->Send(0));
+  ASSERT_TRUE(engine->Send(0));
+
+  const uint64_t start_us = MonotonicNowUs();
+  ASSERT_TRUE(engine->Finish());
+  const uint64_t elapsed_us = MonotonicNowUs() - start_us;
+  EXPECT_GE(elapsed_us, 90U * 1000);
+  EXPECT_LT(elapsed_us, 500U * 1000);
+
+  EXPECT_EQ(0U, engine->outstanding());
+  EXPECT_EQ(2U, engine->stats(0).sent);
+  EXPECT_EQ(0U, engine->stats(0).received);
+  EXPECT_EQ(2U, engine->stats(0).lost);
+}
+
+}  // namespace mlab
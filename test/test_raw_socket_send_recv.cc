@@ -23,10 +23,12 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdlib.h>
+#include <unistd.h>
 #if defined(OS_WINDOWS)
 #include <winsock2.h>
 #endif
 
+#include "clock.h"
 #include "gtest/gtest.h"
 #include "log.h"
 #include "mlab/host.h"
@@ -186,9 +188,9 @@ TEST_F(RawSocketTest, IPv4Raw) {
 
   EXPECT_GT(magic_ttl, 0);
 
-  pos = recvbuf.buffer() + sizeof(IP4Header);
-  pos += sizeof(ICMP4Header);  // come to payload
-  recvbuf = Packet(pos, (len - sizeof(ICMP4Header) - sizeof(IP4Header)));
+  // come to payload
+  recvbuf = recvbuf.Slice(sizeof(IP4Header) + sizeof(ICMP4Header),
+                          len - sizeof(ICMP4Header) - sizeof(IP4Header));
 
   // test sent packet integrity
   EXPECT_STREQ(payload.str().c_str(), recvbuf.str().c_str());
@@ -325,6 +327,94 @@ TEST_F(RawSocketTest, RawICMP) {
   EXPECT_EQ(temp6_ptr->icmp6_data32, ntohl(0xcdef5678));
 }
 
+TEST_F(RawSocketTest, VectoredICMP) {
+  scoped_ptr<RawSocket> icmp_socket_ptr(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV4));
+
+  // Send the ICMP header and payload from separate buffers.
+  iovec send_iov[2];
+  send_iov[0].iov_base = const_cast<char*>(icmp4packet_er->buffer());
+  send_iov[0].iov_len = sizeof(ICMP4Header);
+  send_iov[1].iov_base =
+      const_cast<char*>(icmp4packet_er->buffer() + sizeof(ICMP4Header));
+  send_iov[1].iov_len = icmp4packet_er->length() - sizeof(ICMP4Header);
+
+  ssize_t num_bytes;
+  EXPECT_TRUE(icmp_socket_ptr->SendToV(local4, send_iov, 2, &num_bytes));
+  EXPECT_EQ(icmp4packet_er->length(), static_cast<size_t>(num_bytes));
+
+  // Receive the IP header, ICMP header and payload into separate buffers.
+  char ip_header[sizeof(IP4Header)];
+  char icmp_header[sizeof(ICMP4Header)];
+  char payload_buffer[64] = { 0 };
+  iovec recv_iov[3];
+  recv_iov[0].iov_base = ip_header;
+  recv_iov[0].iov_len = sizeof(ip_header);
+  recv_iov[1].iov_base = icmp_header;
+  recv_iov[1].iov_len = sizeof(icmp_header);
+  recv_iov[2].iov_base = payload_buffer;
+  recv_iov[2].iov_len = sizeof(payload_buffer);
+
+  int magic_ttl = 5;
+  while (magic_ttl) {
+    ASSERT_TRUE(icmp_socket_ptr->ReceiveV(recv_iov, 3, &num_bytes));
+    const ICMP4Header* hd = reinterpret_cast<ICMP4Header*>(icmp_header);
+    if (hd->icmp_type == ICMP_ECHOREPLY &&
+        ntohl(hd->icmp_rest) == 0xabcd1234)
+      break;
+    magic_ttl--;
+  }
+
+  EXPECT_GT(magic_ttl, 0);
+  EXPECT_EQ(sizeof(IP4Header) + icmp4packet_er->length(),
+            static_cast<size_t>(num_bytes));
+  EXPECT_EQ(0, memcmp(payload.buffer(), payload_buffer,
+                      payload.length() - 1));
+}
+
+TEST_F(RawSocketTest, TimestampedICMP) {
+  scoped_ptr<RawSocket> icmp_socket_ptr(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV4));
+  if (!icmp_socket_ptr->EnableTimestamping(false)) {
+    LOG(WARNING, "Timestamping unsupported; skipping.");
+    return;
+  }
+  // The kernel turns on receive timestamps from a deferred work item, so
+  // repeat the echo until its reply is stamped.
+  const uint64_t deadline_us = Socket::DeadlineAfterMs(1000);
+  for (uint32_t attempt = 0; ; ++attempt) {
+    ssize_t num_bytes;
+    EXPECT_TRUE(icmp_socket_ptr->SendTo(local4, *icmp4packet_er, &num_bytes));
+    PacketTimestamp sent;
+    ASSERT_TRUE(icmp_socket_ptr->GetSendTimestamp(&sent, 1000));
+    EXPECT_EQ(attempt, sent.id);
+    EXPECT_GT(sent.software_ns, 0U);
+
+    // The socket sees its own echo reply, received after it was sent.
+    char buffer[128];
+    Datagram datagram(buffer, sizeof(buffer));
+    int magic_ttl = 5;
+    while (magic_ttl) {
+      size_t num_datagrams;
+      ASSERT_TRUE(icmp_socket_ptr->ReceiveBatch(&datagram, 1,
+                                                &num_datagrams));
+      ASSERT_EQ(1U, num_datagrams);
+      const ICMP4Header* hd =
+          reinterpret_cast<ICMP4Header*>(buffer + sizeof(IP4Header));
+      if (hd->icmp_type == ICMP_ECHOREPLY &&
+          ntohl(hd->icmp_rest) == 0xabcd1234)
+        break;
+      magic_ttl--;
+    }
+    EXPECT_GT(magic_ttl, 0);
+    if (datagram.timestamp.software_ns > 0) {
+      EXPECT_GE(datagram.timestamp.software_ns, sent.software_ns);
+      break;
+    }
+    ASSERT_LT(MonotonicNowUs(), deadline_us);
+  }
+}
+
 TEST_F(RawSocketTest, TestSetBufsize) {
   LOG(INFO, "test set/get buffer size.");
   SetGetBufsize(SOCKETTYPE_RAW, SOCKETFAMILY_IPV4);
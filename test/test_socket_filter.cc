@@ -0,0 +1,176 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/socket_filter.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "gtest/gtest.h"
+#include "mlab/host.h"
+#include "mlab/protocol_header.h"
+#include "mlab/raw_socket.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+namespace {
+
+void SendEcho(const RawSocket& socket, SocketFamily family,
+              const char* address, uint16_t id) {
+  char packet[sizeof(ICMP4Header) + 8];
+  memset(packet, 0, sizeof(packet));
+  ICMP4Header header(family == SOCKETFAMILY_IPV4 ? 8 : 128, 0, 0,
+                     htonl(static_cast<uint32_t>(id) << 16 | 1));
+  memcpy(packet, &header, sizeof(header));
+  if (family == SOCKETFAMILY_IPV4) {
+    header.icmp_checksum = InternetCheckSum(packet, sizeof(packet));
+    memcpy(packet, &header, sizeof(header));
+  }
+  ssize_t num_bytes;
+  ASSERT_TRUE(socket.SendTo(Host(address), Packet(packet, sizeof(packet)),
+                            &num_bytes));
+}
+
+// The identifier of the echo reply received next, or -1 if none comes.
+int ReceiveEchoId(const RawSocket& socket, SocketFamily family) {
+  char packet[256];
+  ssize_t num_bytes;
+  if (socket.ReceiveUntil(packet, sizeof(packet), Socket::DeadlineAfterMs(100),
+                          &num_bytes) != SOCKETSTATUS_OK) {
+    return -1;
+  }
+  const size_t offset = family == SOCKETFAMILY_IPV4 ? sizeof(IP4Header) : 0;
+  uint16_t id;
+  memcpy(&id, packet + offset + 4, sizeof(id));
+  return ntohs(id);
+}
+
+void SendUDP(const RawSocket& socket, uint16_t source_port) {
+  const char kPayload[] = "filter";
+  const size_t length =
+      sizeof(IP4Header) + sizeof(UDPHeader) + sizeof(kPayload);
+  IP4Header ip(length, 64, IPPROTO_UDP, "127.0.0.1");
+  ip.id = htons(source_port);
+  UDPHeader udp(source_port, 33434, sizeof(UDPHeader) + sizeof(kPayload), 0);
+  iovec iov[3];
+  iov[0].iov_base = &ip;
+  iov[0].iov_len = sizeof(ip);
+  iov[1].iov_base = &udp;
+  iov[1].iov_len = sizeof(udp);
+  iov[2].iov_base = const_cast<char*>(kPayload);
+  iov[2].iov_len = sizeof(kPayload);
+  ssize_t num_bytes;
+  ASSERT_TRUE(socket.SendToV(Host("127.0.0.1"), iov, 3, &num_bytes));
+}
+
+}  // namespace
+
+TEST(SocketFilterTest, EchoReplyIPv4) {
+  scoped_ptr<RawSocket> socket(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV4));
+  ASSERT_TRUE(socket->AttachFilter(
+      EchoReplyFilter(SOCKETFAMILY_IPV4, 0x1110, 0x1111)));
+
+  // Neither the requests nor the other reply get through.
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV4, "127.0.0.1", 0x2222);
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV4, "127.0.0.1", 0x1111);
+  EXPECT_EQ(0x1111, ReceiveEchoId(*socket.get(), SOCKETFAMILY_IPV4));
+  EXPECT_EQ(-1, ReceiveEchoId(*socket.get(), SOCKETFAMILY_IPV4));
+
+  ASSERT_TRUE(socket->DetachFilter());
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV4, "127.0.0.1", 0x2222);
+  EXPECT_EQ(0x2222, ReceiveEchoId(*socket.get(), SOCKETFAMILY_IPV4));
+}
+
+TEST(SocketFilterTest, EchoReplyIPv6Wraps) {
+  scoped_ptr<RawSocket> socket(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV6));
+  ASSERT_TRUE(socket->AttachFilter(
+      EchoReplyFilter(SOCKETFAMILY_IPV6, 0xfffe, 0x0001)));
+
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV6, "::1", 0x8000);
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV6, "::1", 0x0001);
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV6, "::1", 0xffff);
+  EXPECT_EQ(0x0001, ReceiveEchoId(*socket.get(), SOCKETFAMILY_IPV6));
+  EXPECT_EQ(0xffff, ReceiveEchoId(*socket.get(), SOCKETFAMILY_IPV6));
+  EXPECT_EQ(-1, ReceiveEchoId(*socket.get(), SOCKETFAMILY_IPV6));
+}
+
+TEST(SocketFilterTest, UDPErrors) {
+  scoped_ptr<RawSocket> probe_socket(
+      RawSocket::CreateOrDie(SOCKETTYPE_RAW, SOCKETFAMILY_IPV4));
+  ASSERT_TRUE(probe_socket->SetIPHDRINCL());
+  scoped_ptr<RawSocket> icmp_socket(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV4));
+  ASSERT_TRUE(icmp_socket->AttachFilter(
+      UDPErrorFilter(SOCKETFAMILY_IPV4, 40100, 40199)));
+
+  // Only the port unreachable quoting a port in range gets through.
+  SendUDP(*probe_socket.get(), 40000);
+  SendUDP(*probe_socket.get(), 40150);
+  SendEcho(*icmp_socket.get(), SOCKETFAMILY_IPV4, "127.0.0.1", 0x1111);
+
+  char packet[256];
+  ssize_t num_bytes;
+  ASSERT_EQ(SOCKETSTATUS_OK,
+            icmp_socket->ReceiveUntil(packet, sizeof(packet),
+                                      Socket::DeadlineAfterMs(100),
+                                      &num_bytes));
+  const size_t quoted = sizeof(IP4Header) + sizeof(ICMP4Header);
+  EXPECT_EQ(3, packet[sizeof(IP4Header)]);
+  uint16_t port;
+  memcpy(&port, packet + quoted + sizeof(IP4Header), sizeof(port));
+  EXPECT_EQ(40150, ntohs(port));
+  EXPECT_NE(SOCKETSTATUS_OK,
+            icmp_socket->ReceiveUntil(packet, sizeof(packet),
+                                      Socket::DeadlineAfterMs(100),
+                                      &num_bytes));
+}
+
+TEST(SocketFilterTest, ICMP6Filter) {
+  ICMP6Filter filter;
+  EXPECT_TRUE(filter.passes(129));
+  EXPECT_TRUE(filter.passes(1));
+  EXPECT_TRUE(filter.passes(3));
+  EXPECT_FALSE(filter.passes(128));
+
+  // Pass only echo requests, so the socket sees its own and no replies.
+  filter.BlockAll();
+  filter.Pass(128);
+  EXPECT_TRUE(filter.passes(128));
+  EXPECT_FALSE(filter.passes(129));
+
+  scoped_ptr<RawSocket> socket(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV6));
+  ASSERT_TRUE(socket->SetICMP6Filter(filter));
+  SendEcho(*socket.get(), SOCKETFAMILY_IPV6, "::1", 0x3333);
+
+  char packet[256];
+  ssize_t num_bytes;
+  ASSERT_EQ(SOCKETSTATUS_OK,
+            socket->ReceiveUntil(packet, sizeof(packet),
+                                 Socket::DeadlineAfterMs(100), &num_bytes));
+  EXPECT_EQ(128, static_cast<uint8_t>(packet[0]));
+  EXPECT_NE(SOCKETSTATUS_OK,
+            socket->ReceiveUntil(packet, sizeof(packet),
+                                 Socket::DeadlineAfterMs(100), &num_bytes));
+
+  scoped_ptr<RawSocket> ipv4(
+      RawSocket::CreateOrDie(SOCKETTYPE_ICMP, SOCKETFAMILY_IPV4));
+  EXPECT_FALSE(ipv4->SetICMP6Filter(filter));
+}
+
+}  // namespace mlab
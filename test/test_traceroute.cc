@@ -0,0 +1,70 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/traceroute.h"
+
+#include "clock.h"
+#include "gtest/gtest.h"
+#include "mlab/host.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+
+TEST(TracerouteTest, ParisLoopback) {
+  scoped_ptr<TracerouteEngine> engine(TracerouteEngine::CreateOrDie());
+
+  // Loopback doesn't count hops, so every probe reaches the destination and
+  // the trace ends at the first.
+  TracerouteOptions options;
+  options.max_ttl = 5;
+  TracerouteResult result;
+  const uint64_t start_us = MonotonicNowUs();
+  ASSERT_TRUE(engine->Trace(Host("127.0.0.1"), options, &result));
+  EXPECT_LT(MonotonicNowUs() - start_us, 1000U * 1000);
+
+  EXPECT_TRUE(result.reached);
+  EXPECT_EQ(1, result.destination_ttl);
+  ASSERT_EQ(1U, result.probes.size());
+  EXPECT_TRUE(result.probes[0].answered);
+  EXPECT_EQ(1, result.probes[0].ttl);
+  EXPECT_EQ("127.0.0.1", result.probes[0].responder);
+  EXPECT_EQ(3, result.probes[0].icmp_type);  // Destination unreachable,
+  EXPECT_EQ(3, result.probes[0].icmp_code);  // port unreachable.
+}
+
+TEST(TracerouteTest, ClassicProbesPerHop) {
+  scoped_ptr<TracerouteEngine> engine(TracerouteEngine::CreateOrDie());
+
+  TracerouteOptions options;
+  options.max_ttl = 3;
+  options.probes_per_hop = 3;
+  options.paris = false;
+  TracerouteResult result;
+  ASSERT_TRUE(engine->Trace(Host("127.0.0.1"), options, &result));
+
+  EXPECT_TRUE(result.reached);
+  ASSERT_EQ(3U, result.probes.size());
+  for (size_t i = 0; i < result.probes.size(); ++i) {
+    EXPECT_TRUE(result.probes[i].answered);
+    EXPECT_EQ(static_cast<int>(i), result.probes[i].attempt);
+    EXPECT_EQ("127.0.0.1", result.probes[i].responder);
+  }
+
+  // A second trace picks its own source port and sees only its own replies.
+  ASSERT_TRUE(engine->Trace(Host("127.0.0.1"), options, &result));
+  EXPECT_TRUE(result.reached);
+  EXPECT_EQ(3U, result.probes.size());
+}
+
+}  // namespace mlab
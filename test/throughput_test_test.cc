@@ -0,0 +1,111 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/throughput_test.h"
+
+#include <pthread.h>
+
+#include "gtest/gtest.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/listen_socket.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+namespace {
+const uint16_t kThroughputPort = 5011;
+const uint16_t kEarlyClosePort = 5020;
+const size_t kNumStreams = 4;
+
+class CountingObserver : public ThroughputTest::Observer {
+ public:
+  CountingObserver() : intervals(0), interval_total(0) { }
+
+  virtual void OnInterval(const ThroughputTest& test) {
+    ++intervals;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < test.num_streams(); ++i)
+      sum += test.interval_bytes(i);
+    EXPECT_EQ(sum, test.interval_bytes());
+    interval_total += sum;
+  }
+
+  int intervals;
+  uint64_t interval_total;
+};
+
+void* RunReceiver(void* receiver) {
+  // Runs until the sender closes its streams.
+  static_cast<ThroughputTest*>(receiver)->Run(10000, 100, NULL);
+  return NULL;
+}
+}  // namespace
+
+TEST(ThroughputTestTest, ParallelStreams) {
+  scoped_ptr<ListenSocket> listener(ListenSocket::CreateOrDie(
+      kThroughputPort, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  ThroughputTest* sender = ThroughputTest::CreateClient(
+      Host("127.0.0.1"), kThroughputPort, SOCKETFAMILY_IPV4, kNumStreams,
+      THROUGHPUT_SEND);
+  ASSERT_TRUE(sender != NULL);
+  scoped_ptr<ThroughputTest> receiver(ThroughputTest::CreateServer(
+      *listener.get(), kNumStreams, THROUGHPUT_RECEIVE));
+  ASSERT_TRUE(receiver.get() != NULL);
+  EXPECT_EQ(kNumStreams, receiver->num_streams());
+
+  pthread_t receiver_thread;
+  ASSERT_EQ(0, pthread_create(&receiver_thread, NULL, &RunReceiver,
+                              receiver.get()));
+
+  CountingObserver observer;
+  EXPECT_TRUE(sender->Run(200, 50, &observer));
+  EXPECT_GE(observer.intervals, 4);
+  EXPECT_EQ(sender->total_bytes(), observer.interval_total);
+  EXPECT_GT(sender->TotalMbps(), 0.0);
+  for (size_t i = 0; i < kNumStreams; ++i) {
+    EXPECT_TRUE(sender->active(i));
+    EXPECT_GT(sender->total_bytes(i), 0U);
+  }
+
+  // Closing the sender's streams ends the receiver, which by then has all of
+  // the bytes.
+  const uint64_t sent = sender->total_bytes();
+  delete sender;
+  pthread_join(receiver_thread, NULL);
+  EXPECT_EQ(sent, receiver->total_bytes());
+  for (size_t i = 0; i < kNumStreams; ++i)
+    EXPECT_FALSE(receiver->active(i));
+}
+
+TEST(ThroughputTestTest, ReceiverStopsFirst) {
+  scoped_ptr<ListenSocket> listener(ListenSocket::CreateOrDie(
+      kEarlyClosePort, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+  scoped_ptr<ThroughputTest> sender(ThroughputTest::CreateClient(
+      Host("127.0.0.1"), kEarlyClosePort, SOCKETFAMILY_IPV4, kNumStreams,
+      THROUGHPUT_SEND));
+  ASSERT_TRUE(sender.get() != NULL);
+
+  // The receiver closes before the sender starts. Its kernel resets the
+  // streams on the first bytes sent, after which sends fail with EPIPE.
+  for (size_t i = 0; i < kNumStreams; ++i)
+    delete listener->Accept();
+
+  // Each stream drops out rather than SIGPIPE ending the process, and the
+  // run ends once they all have.
+  EXPECT_TRUE(sender->Run(10000, 100, NULL));
+  EXPECT_LT(sender->elapsed_ms(), 10000U);
+  for (size_t i = 0; i < kNumStreams; ++i)
+    EXPECT_FALSE(sender->active(i));
+}
+
+}  // namespace mlab
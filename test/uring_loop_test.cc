@@ -0,0 +1,124 @@
+// Copyright 2012 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mlab/uring_loop.h"
+
+#include <errno.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "log.h"
+#include "mlab/accepted_socket.h"
+#include "mlab/client_socket.h"
+#include "mlab/listen_socket.h"
+#include "scoped_ptr.h"
+
+namespace mlab {
+namespace {
+const uint16_t kUringPort = 5008;
+
+// Echoes on the server side; sends a ping and reads the echo on the client.
+class PingHandler : public UringLoop::Handler {
+ public:
+  explicit PingHandler(UringLoop* loop)
+      : cancelled(0), loop_(loop), accepted_(NULL), connected_(NULL) { }
+
+  virtual ~PingHandler() {
+    delete accepted_;
+    delete connected_;
+  }
+
+  virtual void OnAccept(ListenSocket* listener, AcceptedSocket* accepted,
+                        int result) {
+    if (result == -ECANCELED) {
+      ++cancelled;
+      return;
+    }
+    ASSERT_GE(result, 0);
+    accepted_ = accepted;
+    EXPECT_TRUE(loop_->ReceiveMultishot(accepted_, this));
+  }
+
+  virtual void OnConnect(ClientSocket* connected, int result) {
+    ASSERT_EQ(0, result);
+    connected_ = connected;
+    EXPECT_TRUE(loop_->Send(connected_, "ping", 4, this));
+    EXPECT_TRUE(loop_->Receive(connected_, echo_buffer_, sizeof(echo_buffer_),
+                               this));
+  }
+
+  virtual void OnSend(Socket*, int result) { EXPECT_EQ(4, result); }
+
+  virtual void OnReceive(Socket* socket, const void* buffer, int result) {
+    if (result == -ECANCELED) {
+      ++cancelled;
+      return;
+    }
+    ASSERT_GT(result, 0);
+    if (socket == accepted_) {
+      // |buffer| is only valid during the callback, so copy it.
+      server_received.assign(static_cast<const char*>(buffer), result);
+      EXPECT_TRUE(loop_->Send(accepted_, server_received.data(),
+                              server_received.size(), this));
+    } else {
+      echo.assign(static_cast<const char*>(buffer), result);
+    }
+  }
+
+  AcceptedSocket* accepted() const { return accepted_; }
+
+  std::string server_received;
+  std::string echo;
+  int cancelled;
+
+ private:
+  UringLoop* loop_;
+  AcceptedSocket* accepted_;
+  ClientSocket* connected_;
+  char echo_buffer_[16];
+};
+}  // namespace
+
+TEST(UringLoopTest, Echo) {
+  if (!UringLoop::IsSupported()) {
+    LOG(WARNING, "io_uring unsupported; skipping.");
+    return;
+  }
+
+  scoped_ptr<UringLoop> loop(UringLoop::CreateOrDie(64));
+  ASSERT_TRUE(loop->ProvideReceiveBuffers(8, 256));
+  scoped_ptr<ListenSocket> listen_socket(
+      ListenSocket::CreateOrDie(kUringPort, SOCKETTYPE_TCP, SOCKETFAMILY_IPV4));
+
+  PingHandler handler(loop.get());
+  ASSERT_TRUE(loop->Accept(listen_socket.get(), true, &handler));
+  ASSERT_TRUE(loop->Connect(Host("127.0.0.1"), kUringPort, SOCKETTYPE_TCP,
+                            SOCKETFAMILY_IPV4, &handler));
+
+  while (handler.echo.empty())
+    ASSERT_GE(loop->RunOnce(1000), 0);
+  EXPECT_EQ("ping", handler.server_received);
+  EXPECT_EQ("ping", handler.echo);
+
+  // The multishot accept and receive are still armed until cancelled.
+  EXPECT_EQ(2U, loop->pending());
+  EXPECT_TRUE(loop->Cancel(listen_socket.get()));
+  EXPECT_TRUE(loop->Cancel(handler.accepted()));
+  loop->Run();
+  EXPECT_EQ(0U, loop->pending());
+  EXPECT_EQ(2, handler.cancelled);
+}
+
+}  // namespace mlab